@@ -0,0 +1,96 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_BOUNDS_HPP
+#define OPENGLPLAYGROUND_BOUNDS_HPP
+
+#define GLM_FORCE_RADIANS
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Axis aligned bounding box
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    // Create empty box
+    AABB()
+            : min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()) {}
+
+    AABB(const glm::vec3& mi, const glm::vec3& ma)
+            : min(mi), max(ma) {}
+
+    // Check if the box contains at least one point
+    inline bool isValid() const noexcept {
+        return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+    }
+
+    // Grow box to include point or box
+    inline void extend(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    inline void extend(const AABB& box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    inline glm::vec3 getCenter() const {
+        return 0.5f * (min + max);
+    }
+
+    inline glm::vec3 getExtent() const {
+        return max - min;
+    }
+
+    // Get box containing this box transformed by the matrix
+    inline AABB transform(const glm::mat4& matrix) const {
+        // Center is transformed, half extent is projected on the absolute axes of the matrix
+        const glm::vec3 center = glm::vec3(matrix * glm::vec4(getCenter(), 1.f));
+        const glm::vec3 half = 0.5f * getExtent();
+        const glm::vec3 extent = glm::abs(glm::vec3(matrix[0])) * half.x + glm::abs(glm::vec3(matrix[1])) * half.y +
+                                 glm::abs(glm::vec3(matrix[2])) * half.z;
+        return AABB(center - extent, center + extent);
+    }
+};
+
+// Bounding sphere
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+
+    // Create empty sphere
+    BoundingSphere()
+            : center(0.f), radius(-1.f) {}
+
+    BoundingSphere(const glm::vec3& c, float r)
+            : center(c), radius(r) {}
+
+    // Check if the sphere contains at least one point
+    inline bool isValid() const noexcept {
+        return radius >= 0.f;
+    }
+
+    // Sphere centered on the box containing the points, tighter than the one around the box
+    static inline BoundingSphere fromPoints(const AABB& box, const glm::vec3 *points, std::size_t count,
+                                            std::size_t stride = sizeof(glm::vec3)) {
+        if (!box.isValid()) {
+            return BoundingSphere();
+        }
+        const glm::vec3 center = box.getCenter();
+        float radius2 = 0.f;
+        auto bytes = reinterpret_cast<const unsigned char *>(points);
+        for (std::size_t i = 0; i < count; ++i) {
+            const glm::vec3 d = *reinterpret_cast<const glm::vec3 *>(bytes + i * stride) - center;
+            radius2 = std::max(radius2, glm::dot(d, d));
+        }
+        return BoundingSphere(center, std::sqrt(radius2));
+    }
+};
+
+#endif //OPENGLPLAYGROUND_BOUNDS_HPP
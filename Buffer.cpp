@@ -3,19 +3,22 @@
 //
 
 #include "Buffer.hpp"
+#include "MemoryStats.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 Buffer::Buffer(GLenum target, GLenum usage)
-        : m_id(0), m_target(target), m_usage(usage), m_is_binded(false) {
+        : m_id(0), m_target(target), m_usage(usage), m_size(0) {
     // Generate buffer
     glGenBuffers(1, &m_id);
     GL_CHECK();
 }
 
 void Buffer::destroy() {
-    // Unbind buffer
-    unbind();
-    // Destroy
-    glDeleteBuffers(1, &m_id);
+    // Destroy, GL unbinds it from the targets it is bound to
+    GLState::getGlobal().deleteBuffer(m_id);
+    setAllocatedSize(0);
 }
 
 void Buffer::allocateSpace(GLsizeiptr size) {
@@ -24,6 +27,100 @@ void Buffer::allocateSpace(GLsizeiptr size) {
     // Allocate space
     glBufferData(m_target, size, nullptr, m_usage);
     GL_CHECK();
+    setAllocatedSize(static_cast<std::size_t>(size));
     // Unbind
     unbind();
 }
+
+void Buffer::submitBytes(const void *data, std::size_t size) {
+    if (!isBinded()) {
+        std::cerr << "Trying to submit data to unbinded buffer\n";
+        return;
+    }
+    glBufferData(m_target, static_cast<GLsizeiptr>(size), data, m_usage);
+    GL_CHECK();
+    setAllocatedSize(size);
+    MemoryStats::getGlobal().addUpload(size);
+}
+
+void Buffer::updateBytes(const void *data, std::size_t size, std::size_t offset, BufferUpdate mode) {
+    if (!isBinded()) {
+        std::cerr << "Trying to submit data to unbinded buffer\n";
+        return;
+    }
+    if (size == 0) {
+        return;
+    }
+    const auto gl_offset = static_cast<GLintptr>(offset);
+    const auto gl_size = static_cast<GLsizeiptr>(size);
+    switch (mode) {
+        case BufferUpdate::SubData:
+            glBufferSubData(m_target, gl_offset, gl_size, data);
+            break;
+        case BufferUpdate::Orphan: {
+            // New storage of the same size, grown if the range goes past the end
+            const std::size_t storage = std::max(m_size, offset + size);
+            glBufferData(m_target, static_cast<GLsizeiptr>(storage), nullptr, m_usage);
+            setAllocatedSize(storage);
+            glBufferSubData(m_target, gl_offset, gl_size, data);
+            break;
+        }
+        case BufferUpdate::MapInvalidate:
+        case BufferUpdate::MapUnsynchronized: {
+            const GLbitfield access = GL_MAP_WRITE_BIT | (mode == BufferUpdate::MapInvalidate
+                                                          ? GL_MAP_INVALIDATE_RANGE_BIT
+                                                          : GL_MAP_UNSYNCHRONIZED_BIT);
+            void *mapped = glMapBufferRange(m_target, gl_offset, gl_size, access);
+            if (mapped != nullptr) {
+                std::memcpy(mapped, data, size);
+                glUnmapBuffer(m_target);
+            } else {
+                glBufferSubData(m_target, gl_offset, gl_size, data);
+            }
+            break;
+        }
+    }
+    GL_CHECK();
+    MemoryStats::getGlobal().addUpload(size);
+}
+
+void Buffer::allocateStorage(GLsizeiptr size, GLbitfield flags) {
+    bind();
+    glBufferStorage(m_target, size, nullptr, flags);
+    GL_CHECK();
+    setAllocatedSize(static_cast<std::size_t>(size));
+    unbind();
+}
+
+void *Buffer::mapRange(GLintptr offset, GLsizeiptr size, GLbitfield access) {
+    // Buffer bound by the caller is bound back, unless its binding is not known
+    const GLuint previous = GLState::getGlobal().getBuffer(m_target);
+    bind();
+    void *data = glMapBufferRange(m_target, offset, size, access);
+    GL_CHECK();
+    if (previous != GLState::UNKNOWN_BINDING) {
+        GLState::getGlobal().bindBuffer(m_target, previous);
+    }
+    return data;
+}
+
+void Buffer::unmap() {
+    const GLuint previous = GLState::getGlobal().getBuffer(m_target);
+    bind();
+    glUnmapBuffer(m_target);
+    GL_CHECK();
+    if (previous != GLState::UNKNOWN_BINDING) {
+        GLState::getGlobal().bindBuffer(m_target, previous);
+    }
+}
+
+void Buffer::setAllocatedSize(std::size_t size) {
+    // Report the difference, the storage is replaced as a whole
+    const MemoryCategory category = getMemoryCategory(m_target);
+    if (size > m_size) {
+        MemoryStats::getGlobal().allocateGpu(category, size - m_size);
+    } else if (size < m_size) {
+        MemoryStats::getGlobal().releaseGpu(category, m_size - size);
+    }
+    m_size = size;
+}
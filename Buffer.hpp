@@ -6,8 +6,23 @@
 #define OPENGLPLAYGROUND_BUFFER_HPP
 
 #include "GLUtils.hpp"
+#include "GLState.hpp"
 #include <vector>
 #include <iostream>
+#include <type_traits>
+
+// How a range of a buffer is rewritten
+enum class BufferUpdate {
+    // glBufferSubData, the driver copies the data and may wait for the draws reading the range
+    SubData,
+    // Re-specify the storage before writing, draws still reading get the old storage. The rest of the buffer is
+    // undefined afterwards, so it suits data rewritten as a whole
+    Orphan,
+    // Map the range with GL_MAP_INVALIDATE_RANGE_BIT, its previous content is discarded
+    MapInvalidate,
+    // Map the range with GL_MAP_UNSYNCHRONIZED_BIT, the caller guarantees the GPU does not use it
+    MapUnsynchronized
+};
 
 class Buffer {
 private:
@@ -17,8 +32,8 @@ private:
     GLenum m_target;
     // Buffer usage
     GLenum m_usage;
-    // Bind bool
-    mutable bool m_is_binded;
+    // Size of the allocated storage in bytes, reported to the memory statistics
+    std::size_t m_size;
 
 public:
     Buffer(GLenum target, GLenum usage);
@@ -35,53 +50,102 @@ public:
     template<typename T>
     void submitData(const std::vector<T>& data);
 
+    // Submit data to whole buffer from a raw array of elements
+    template<typename T>
+    void submitData(const T *data, std::size_t count);
+
     // Initialise empty space
     void allocateSpace(GLsizeiptr size);
 
+    // Allocate immutable storage with the glBufferStorage flags, needs ARB_buffer_storage. The storage can not be
+    // respecified afterwards, only destroyed with the buffer
+    void allocateStorage(GLsizeiptr size, GLbitfield flags);
+
+    // Map a range of the buffer with the glMapBufferRange access flags, returns null on failure. Persistent mappings
+    // stay valid while the buffer is unbound
+    void *mapRange(GLintptr offset, GLsizeiptr size, GLbitfield access);
+
+    // Unmap the buffer
+    void unmap();
+
+    // Record the size of the storage, for storage allocated with direct GL calls, e.g. while a VAO is bound
+    void setAllocatedSize(std::size_t size);
+
+    // Get size of the allocated storage in bytes
+    inline std::size_t getSize() const noexcept {
+        return m_size;
+    }
+
+    // Get buffer type
+    inline GLenum getTarget() const noexcept {
+        return m_target;
+    }
+
+    // Get buffer usage
+    inline GLenum getUsage() const noexcept {
+        return m_usage;
+    }
+
     template<typename T>
     void submitSubData(const std::vector<T>& data, GLintptr offset);
 
-    // Check if buffer is binded
+    // Submit whole buffer from raw bytes
+    void submitBytes(const void *data, std::size_t size);
+
+    // Write bytes at offset with the given strategy, the buffer must be bound. Makes no allocation, the data can live
+    // anywhere, e.g. in a mapped file or on the stack
+    void updateBytes(const void *data, std::size_t size, std::size_t offset = 0,
+                     BufferUpdate mode = BufferUpdate::SubData);
+
+    // Write count elements at a byte offset
+    template<typename T>
+    void update(const T *data, std::size_t count, std::size_t offset = 0, BufferUpdate mode = BufferUpdate::SubData);
+
+    // Write a single value at a byte offset, e.g. one matrix of a uniform block
+    template<typename T>
+    void updateValue(const T& value, std::size_t offset = 0, BufferUpdate mode = BufferUpdate::SubData);
+
+    // Check if buffer is binded, from the bindings shadowed by the GLState so binding another buffer is seen
     inline bool isBinded() const noexcept {
-        return m_is_binded;
+        return GLState::getGlobal().getBuffer(m_target) == m_id;
     }
 
-    // Bind / unbind buffer
+    // Bind / unbind buffer, through the GLState so binding an already bound buffer makes no call
     inline void bind() const {
-        if (!isBinded()) {
-            glBindBuffer(m_target, m_id);
-            m_is_binded = true;
-        }
+        GLState::getGlobal().bindBuffer(m_target, m_id);
     }
 
     inline void unbind() const {
         if (isBinded()) {
-            glBindBuffer(m_target, 0);
-            m_is_binded = false;
+            GLState::getGlobal().bindBuffer(m_target, 0);
         }
     }
 };
 
 template<typename T>
 void Buffer::submitData(const std::vector<T>& data) {
-    if (isBinded()) {
-        // Submit data
-        glBufferData(m_target, data.size() * sizeof(T), data.data(), m_usage);
-        GL_CHECK();
-    } else {
-        std::cerr << "Trying to submit data to unbinded buffer\n";
-    }
+    submitData(data.data(), data.size());
+}
+
+template<typename T>
+void Buffer::submitData(const T *data, std::size_t count) {
+    submitBytes(data, count * sizeof(T));
 }
 
 template<typename T>
 void Buffer::submitSubData(const std::vector<T>& data, GLintptr offset) {
-    if (isBinded()) {
-        // Submit data
-        glBufferSubData(m_target, offset, data.size() * sizeof(T), data.data());
-        GL_CHECK();
-    } else {
-        std::cerr << "Trying to submit data to unbinded buffer\n";
-    }
+    update(data.data(), data.size(), static_cast<std::size_t>(offset));
+}
+
+template<typename T>
+void Buffer::update(const T *data, std::size_t count, std::size_t offset, BufferUpdate mode) {
+    static_assert(std::is_trivially_copyable<T>::value, "Buffer data must be trivially copyable");
+    updateBytes(data, count * sizeof(T), offset, mode);
+}
+
+template<typename T>
+void Buffer::updateValue(const T& value, std::size_t offset, BufferUpdate mode) {
+    update(&value, 1, offset, mode);
 }
 
 #endif //OPENGLPLAYGROUND_BUFFER_HPP
@@ -0,0 +1,381 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "DynamicBVH.hpp"
+
+#include <utility>
+
+namespace {
+
+// Surface area heuristic, the probability of a random ray or box hitting a node is proportional to it
+inline float surfaceArea(const AABB& box) {
+    const glm::vec3 d = box.getExtent();
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+inline AABB merge(const AABB& a, const AABB& b) {
+    return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+inline bool contains(const AABB& outer, const AABB& inner) {
+    return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z &&
+           inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+}
+
+inline bool overlaps(const AABB& a, const AABB& b) {
+    return a.min.x <= b.max.x && b.min.x <= a.max.x && a.min.y <= b.max.y && b.min.y <= a.max.y &&
+           a.min.z <= b.max.z && b.min.z <= a.max.z;
+}
+
+inline bool overlaps(const AABB& box, const BoundingSphere& sphere) {
+    const glm::vec3 closest = glm::clamp(sphere.center, box.min, box.max);
+    const glm::vec3 d = closest - sphere.center;
+    return glm::dot(d, d) <= sphere.radius * sphere.radius;
+}
+
+// Bit set for each plane the box is entirely inside of
+constexpr unsigned int ALL_PLANES = (1u << 6) - 1;
+
+} // namespace
+
+constexpr int DynamicBVH::NULL_NODE;
+
+DynamicBVH::DynamicBVH(float margin)
+        : m_root(NULL_NODE), m_free_list(NULL_NODE), m_num_objects(0), m_margin(margin) {}
+
+int DynamicBVH::allocateNode() {
+    if (m_free_list == NULL_NODE) {
+        // Grow pool and chain the new nodes in the free list
+        const auto first = static_cast<int>(m_nodes.size());
+        const auto count = std::max<int>(16, first);
+        m_nodes.resize(static_cast<std::size_t>(first + count));
+        for (int i = first; i < first + count; ++i) {
+            m_nodes[i].parent = i + 1 < first + count ? i + 1 : NULL_NODE;
+            m_nodes[i].height = -1;
+        }
+        m_free_list = first;
+    }
+    const int node = m_free_list;
+    m_free_list = m_nodes[node].parent;
+    m_nodes[node].parent = NULL_NODE;
+    m_nodes[node].left = NULL_NODE;
+    m_nodes[node].right = NULL_NODE;
+    m_nodes[node].height = 0;
+    m_nodes[node].user_data = 0;
+    return node;
+}
+
+void DynamicBVH::freeNode(int node) {
+    m_nodes[node].parent = m_free_list;
+    m_nodes[node].height = -1;
+    m_free_list = node;
+}
+
+int DynamicBVH::insert(const AABB& box, std::size_t user_data) {
+    const int leaf = allocateNode();
+    m_nodes[leaf].object_box = box;
+    m_nodes[leaf].box = AABB(box.min - glm::vec3(m_margin), box.max + glm::vec3(m_margin));
+    m_nodes[leaf].user_data = user_data;
+    insertLeaf(leaf);
+    ++m_num_objects;
+    return leaf;
+}
+
+void DynamicBVH::remove(int proxy) {
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --m_num_objects;
+}
+
+bool DynamicBVH::move(int proxy, const AABB& box) {
+    m_nodes[proxy].object_box = box;
+    if (contains(m_nodes[proxy].box, box)) {
+        return false;
+    }
+    removeLeaf(proxy);
+    m_nodes[proxy].box = AABB(box.min - glm::vec3(m_margin), box.max + glm::vec3(m_margin));
+    insertLeaf(proxy);
+    return true;
+}
+
+void DynamicBVH::refit(int proxy, const AABB& box) {
+    m_nodes[proxy].object_box = box;
+    if (contains(m_nodes[proxy].box, box)) {
+        return;
+    }
+    m_nodes[proxy].box = AABB(box.min - glm::vec3(m_margin), box.max + glm::vec3(m_margin));
+    // Grow the ancestors until one already contains the new box, shrinking is left to the next reinsertion
+    for (int node = m_nodes[proxy].parent; node != NULL_NODE; node = m_nodes[node].parent) {
+        if (contains(m_nodes[node].box, m_nodes[proxy].box)) {
+            break;
+        }
+        m_nodes[node].box = merge(m_nodes[m_nodes[node].left].box, m_nodes[m_nodes[node].right].box);
+    }
+}
+
+void DynamicBVH::clear() {
+    m_nodes.clear();
+    m_root = NULL_NODE;
+    m_free_list = NULL_NODE;
+    m_num_objects = 0;
+}
+
+void DynamicBVH::insertLeaf(int leaf) {
+    if (m_root == NULL_NODE) {
+        m_root = leaf;
+        m_nodes[leaf].parent = NULL_NODE;
+        return;
+    }
+
+    // Descend to the sibling minimising the area added to the tree
+    const AABB box = m_nodes[leaf].box;
+    int index = m_root;
+    while (!m_nodes[index].isLeaf()) {
+        const Node& node = m_nodes[index];
+        const float area = surfaceArea(node.box);
+        const float combined_area = surfaceArea(merge(node.box, box));
+        // Cost of making a new parent for this node and the leaf
+        const float cost = 2.f * combined_area;
+        // Minimum cost of pushing the leaf further down, every ancestor grows
+        const float inheritance_cost = 2.f * (combined_area - area);
+
+        const auto descend_cost = [&](int child) {
+            const AABB merged = merge(m_nodes[child].box, box);
+            if (m_nodes[child].isLeaf()) {
+                return surfaceArea(merged) + inheritance_cost;
+            }
+            return surfaceArea(merged) - surfaceArea(m_nodes[child].box) + inheritance_cost;
+        };
+        const float left_cost = descend_cost(node.left);
+        const float right_cost = descend_cost(node.right);
+
+        if (cost < left_cost && cost < right_cost) {
+            break;
+        }
+        index = left_cost < right_cost ? node.left : node.right;
+    }
+    const int sibling = index;
+
+    // New parent of the leaf and its sibling, allocating may move the nodes so indices are used from here on
+    const int old_parent = m_nodes[sibling].parent;
+    const int new_parent = allocateNode();
+    m_nodes[new_parent].parent = old_parent;
+    m_nodes[new_parent].box = merge(box, m_nodes[sibling].box);
+    m_nodes[new_parent].height = m_nodes[sibling].height + 1;
+    m_nodes[new_parent].left = sibling;
+    m_nodes[new_parent].right = leaf;
+    m_nodes[sibling].parent = new_parent;
+    m_nodes[leaf].parent = new_parent;
+
+    if (old_parent == NULL_NODE) {
+        m_root = new_parent;
+    } else if (m_nodes[old_parent].left == sibling) {
+        m_nodes[old_parent].left = new_parent;
+    } else {
+        m_nodes[old_parent].right = new_parent;
+    }
+
+    refitAncestors(leaf);
+}
+
+void DynamicBVH::removeLeaf(int leaf) {
+    if (leaf == m_root) {
+        m_root = NULL_NODE;
+        return;
+    }
+
+    // Replace the parent by the sibling
+    const int parent = m_nodes[leaf].parent;
+    const int grand_parent = m_nodes[parent].parent;
+    const int sibling = m_nodes[parent].left == leaf ? m_nodes[parent].right : m_nodes[parent].left;
+
+    if (grand_parent == NULL_NODE) {
+        m_root = sibling;
+        m_nodes[sibling].parent = NULL_NODE;
+        freeNode(parent);
+        return;
+    }
+
+    if (m_nodes[grand_parent].left == parent) {
+        m_nodes[grand_parent].left = sibling;
+    } else {
+        m_nodes[grand_parent].right = sibling;
+    }
+    m_nodes[sibling].parent = grand_parent;
+    freeNode(parent);
+
+    refitAncestors(sibling);
+}
+
+void DynamicBVH::refitAncestors(int node) {
+    for (int index = m_nodes[node].parent; index != NULL_NODE; index = m_nodes[index].parent) {
+        index = balance(index);
+        const Node& left = m_nodes[m_nodes[index].left];
+        const Node& right = m_nodes[m_nodes[index].right];
+        m_nodes[index].height = 1 + std::max(left.height, right.height);
+        m_nodes[index].box = merge(left.box, right.box);
+    }
+}
+
+int DynamicBVH::balance(int a) {
+    Node& node_a = m_nodes[a];
+    if (node_a.isLeaf() || node_a.height < 2) {
+        return a;
+    }
+
+    const int b = node_a.left;
+    const int c = node_a.right;
+    Node& node_b = m_nodes[b];
+    Node& node_c = m_nodes[c];
+    const int difference = node_c.height - node_b.height;
+
+    // Rotate the higher child up, a takes the place of the child and the lower grandchild goes under a
+    if (difference > 1 || difference < -1) {
+        const bool rotate_right = difference > 1;
+        const int up = rotate_right ? c : b;
+        const int kept = rotate_right ? b : c;
+        Node& node_up = m_nodes[up];
+        const int f = node_up.left;
+        const int g = node_up.right;
+
+        // Up takes the place of a
+        node_up.left = a;
+        node_up.parent = node_a.parent;
+        node_a.parent = up;
+        if (node_up.parent == NULL_NODE) {
+            m_root = up;
+        } else if (m_nodes[node_up.parent].left == a) {
+            m_nodes[node_up.parent].left = up;
+        } else {
+            m_nodes[node_up.parent].right = up;
+        }
+
+        // Higher grandchild stays under up, the other one replaces up under a
+        const bool f_higher = m_nodes[f].height > m_nodes[g].height;
+        const int stays = f_higher ? f : g;
+        const int moves = f_higher ? g : f;
+        node_up.right = stays;
+        if (rotate_right) {
+            node_a.right = moves;
+        } else {
+            node_a.left = moves;
+        }
+        m_nodes[moves].parent = a;
+
+        node_a.box = merge(m_nodes[kept].box, m_nodes[moves].box);
+        node_a.height = 1 + std::max(m_nodes[kept].height, m_nodes[moves].height);
+        node_up.box = merge(node_a.box, m_nodes[stays].box);
+        node_up.height = 1 + std::max(node_a.height, m_nodes[stays].height);
+        return up;
+    }
+    return a;
+}
+
+void DynamicBVH::collectLeaves(int node, std::vector<std::size_t>& results) const {
+    std::vector<int> stack;
+    stack.push_back(node);
+    while (!stack.empty()) {
+        const Node& current = m_nodes[stack.back()];
+        stack.pop_back();
+        if (current.isLeaf()) {
+            results.push_back(current.user_data);
+        } else {
+            stack.push_back(current.left);
+            stack.push_back(current.right);
+        }
+    }
+}
+
+void DynamicBVH::query(const Frustum& frustum, std::vector<std::size_t>& results) const {
+    if (m_root == NULL_NODE) {
+        return;
+    }
+    // Each entry carries the planes its parent was entirely inside of, they are not tested again
+    std::vector<std::pair<int, unsigned int>> stack;
+    stack.emplace_back(m_root, 0u);
+    while (!stack.empty()) {
+        const int index = stack.back().first;
+        unsigned int inside = stack.back().second;
+        stack.pop_back();
+        const Node& node = m_nodes[index];
+
+        const glm::vec3 center = node.box.getCenter();
+        const glm::vec3 half = 0.5f * node.box.getExtent();
+        bool outside = false;
+        for (unsigned int p = 0; p < 6 && !outside; ++p) {
+            if (inside & (1u << p)) {
+                continue;
+            }
+            const glm::vec4& plane = frustum.getPlane(p);
+            const float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            const float radius = glm::dot(glm::abs(glm::vec3(plane)), half);
+            if (distance + radius < 0.f) {
+                outside = true;
+            } else if (distance - radius >= 0.f) {
+                inside |= 1u << p;
+            }
+        }
+        if (outside) {
+            continue;
+        }
+
+        if (node.isLeaf()) {
+            // Exact box of the object, the enlarged one may touch the frustum alone
+            if (inside == ALL_PLANES || frustum.intersects(node.object_box)) {
+                results.push_back(node.user_data);
+            }
+        } else if (inside == ALL_PLANES) {
+            collectLeaves(index, results);
+        } else {
+            stack.emplace_back(node.left, inside);
+            stack.emplace_back(node.right, inside);
+        }
+    }
+}
+
+void DynamicBVH::query(const AABB& box, std::vector<std::size_t>& results) const {
+    if (m_root == NULL_NODE) {
+        return;
+    }
+    std::vector<int> stack;
+    stack.push_back(m_root);
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (!overlaps(node.box, box)) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            if (overlaps(node.object_box, box)) {
+                results.push_back(node.user_data);
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
+
+void DynamicBVH::query(const BoundingSphere& sphere, std::vector<std::size_t>& results) const {
+    if (m_root == NULL_NODE) {
+        return;
+    }
+    std::vector<int> stack;
+    stack.push_back(m_root);
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (!overlaps(node.box, sphere)) {
+            continue;
+        }
+        if (node.isLeaf()) {
+            if (overlaps(node.object_box, sphere)) {
+                results.push_back(node.user_data);
+            }
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+}
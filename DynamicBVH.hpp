@@ -0,0 +1,123 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_DYNAMICBVH_HPP
+#define OPENGLPLAYGROUND_DYNAMICBVH_HPP
+
+#include "Frustum.hpp"
+
+// Bounding volume hierarchy over moving objects. Leaves store a box enlarged by a margin so small moves do not touch
+// the tree, larger moves reinsert the leaf. The tree is kept balanced with rotations on insertion and removal, so
+// queries visit a logarithmic number of nodes for a small result
+class DynamicBVH {
+public:
+    // Invalid node index
+    static constexpr int NULL_NODE = -1;
+
+private:
+    struct Node {
+        // Box containing the subtree, enlarged box of the object for leaves
+        AABB box;
+        // Exact box of the object, leaves only
+        AABB object_box;
+        // Value given on insertion, leaves only
+        std::size_t user_data;
+        // Parent index, next free node when the node is in the free list
+        int parent;
+        // Children indices, NULL_NODE for leaves
+        int left;
+        int right;
+        // Height of the subtree, 0 for leaves and -1 for free nodes
+        int height;
+
+        inline bool isLeaf() const noexcept {
+            return left == NULL_NODE;
+        }
+    };
+
+    // Node pool
+    std::vector<Node> m_nodes;
+    // Root index
+    int m_root;
+    // First free node
+    int m_free_list;
+    // Number of objects
+    std::size_t m_num_objects;
+    // Margin added to the boxes of the leaves
+    float m_margin;
+
+    // Get a node from the free list, grows the pool if needed
+    int allocateNode();
+
+    // Put a node back in the free list
+    void freeNode(int node);
+
+    // Link a leaf in the tree, the sibling is chosen with the surface area heuristic
+    void insertLeaf(int leaf);
+
+    // Unlink a leaf from the tree, the node stays allocated
+    void removeLeaf(int leaf);
+
+    // Rotate the subtree if it is unbalanced, returns the new root of the subtree
+    int balance(int node);
+
+    // Recompute box and height of the ancestors of a node, rebalancing them
+    void refitAncestors(int node);
+
+    // Append the user data of all the leaves of a subtree
+    void collectLeaves(int node, std::vector<std::size_t>& results) const;
+
+public:
+    // Create empty hierarchy, margin is added on each side of the leaf boxes
+    explicit DynamicBVH(float margin = 0.1f);
+
+    // Insert object, returns its proxy
+    int insert(const AABB& box, std::size_t user_data);
+
+    // Remove object
+    void remove(int proxy);
+
+    // Update the box of an object. Nothing changes in the tree while the box stays in the enlarged box of the leaf,
+    // the leaf is reinserted otherwise. Returns true if it was reinserted
+    bool move(int proxy, const AABB& box);
+
+    // Update the box of an object and refit the ancestors in place without reinsertion. Cheaper than move for
+    // objects that move a lot in a small area but the quality of the tree degrades over time
+    void refit(int proxy, const AABB& box);
+
+    // Remove all the objects
+    void clear();
+
+    // Get user data of an object
+    inline std::size_t getUserData(int proxy) const {
+        return m_nodes[proxy].user_data;
+    }
+
+    // Get exact box of an object
+    inline const AABB& getBox(int proxy) const {
+        return m_nodes[proxy].object_box;
+    }
+
+    // Get number of objects
+    inline std::size_t size() const noexcept {
+        return m_num_objects;
+    }
+
+    // Get height of the tree, -1 when empty
+    inline int getHeight() const noexcept {
+        return m_root == NULL_NODE ? -1 : m_nodes[m_root].height;
+    }
+
+    // Append the user data of the objects whose box intersects the frustum. Subtrees entirely inside the frustum are
+    // taken without testing the planes again
+    void query(const Frustum& frustum, std::vector<std::size_t>& results) const;
+
+    // Append the user data of the objects whose box intersects the box
+    void query(const AABB& box, std::vector<std::size_t>& results) const;
+
+    // Append the user data of the objects whose box intersects the sphere
+    void query(const BoundingSphere& sphere, std::vector<std::size_t>& results) const;
+};
+
+#endif //OPENGLPLAYGROUND_DYNAMICBVH_HPP
@@ -6,6 +6,11 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+// POSIX includes
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 std::string loadFile(const std::string& file_name) {
     // Source file stream
@@ -30,3 +35,47 @@ std::string loadFile(const std::string& file_name) {
         return std::string();
     }
 }
+
+bool getFileModificationTime(const std::string& file_name, std::int64_t& mtime) {
+    struct stat file_stat{};
+    if (stat(file_name.c_str(), &file_stat) != 0) {
+        return false;
+    }
+    mtime = static_cast<std::int64_t>(file_stat.st_mtime);
+    return true;
+}
+
+MappedFile::MappedFile()
+        : m_data(nullptr), m_size(0) {}
+
+MappedFile::MappedFile(const std::string& file_name)
+        : m_data(nullptr), m_size(0) {
+    // Open file
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    // Get file size
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return;
+    }
+    // Map the whole file, the descriptor is not needed after the mapping
+    void *data = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Error mapping file: " << file_name << "\n";
+        return;
+    }
+    m_data = data;
+    m_size = static_cast<std::size_t>(file_stat.st_size);
+}
+
+void MappedFile::destroy() {
+    if (isValid()) {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
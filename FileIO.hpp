@@ -6,8 +6,46 @@
 #define OPENGLPLAYGROUND_FILEIO_HPP
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
 
 // Read file into string
 std::string loadFile(const std::string& file_name);
 
+// Get last modification time of a file, returns false if the file can not be accessed
+bool getFileModificationTime(const std::string& file_name, std::int64_t& mtime);
+
+// Read only memory mapping of a whole file
+class MappedFile {
+private:
+    // Pointer to the mapped memory
+    void *m_data;
+    // Size of the mapping in bytes
+    std::size_t m_size;
+
+public:
+    // Create empty mapping
+    MappedFile();
+
+    // Map given file, check isValid() to know if the mapping succeeded
+    explicit MappedFile(const std::string& file_name);
+
+    // Unmap file
+    void destroy();
+
+    // Check if file is mapped
+    inline bool isValid() const noexcept {
+        return m_data != nullptr;
+    }
+
+    // Access mapped memory
+    inline const unsigned char *getData() const noexcept {
+        return static_cast<const unsigned char *>(m_data);
+    }
+
+    inline std::size_t getSize() const noexcept {
+        return m_size;
+    }
+};
+
 #endif //OPENGLPLAYGROUND_FILEIO_HPP
@@ -0,0 +1,64 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "FrameUniforms.hpp"
+
+#include <cstring>
+
+FrameUniforms::FrameUniforms(std::size_t num_frames)
+        : m_ring(GL_UNIFORM_BUFFER, 1, num_frames), m_frame_size(0) {}
+
+void FrameUniforms::destroy() {
+    m_ring.destroy();
+    m_blocks.clear();
+}
+
+bool FrameUniforms::setupProgram(const Program& program, const std::string& block_name, GLuint binding) {
+    const GLuint index = glGetUniformBlockIndex(program.getID(), block_name.c_str());
+    if (index == GL_INVALID_INDEX) {
+        return false;
+    }
+    glUniformBlockBinding(program.getID(), index, binding);
+    GL_CHECK();
+    return true;
+}
+
+std::size_t FrameUniforms::addBlock(GLuint binding, std::size_t size) {
+    m_blocks.push_back({binding, std::vector<unsigned char>(size, 0), 0});
+    // Every block starts on the alignment, the region holds them all
+    const std::size_t alignment = m_ring.getAlignment();
+    m_frame_size += (size + alignment - 1) / alignment * alignment;
+    m_ring.reserve(m_frame_size);
+    return m_blocks.size() - 1;
+}
+
+void FrameUniforms::write(std::size_t block, const void *data, std::size_t size, std::size_t offset) {
+    std::vector<unsigned char>& bytes = m_blocks[block].data;
+    if (offset + size > bytes.size()) {
+        std::cerr << "Writing past the end of a frame uniform block\n";
+        return;
+    }
+    std::memcpy(bytes.data() + offset, data, size);
+}
+
+void FrameUniforms::update() {
+    // Region being reused is only waited on if the GPU still reads it
+    m_ring.beginFrame();
+    for (auto& block : m_blocks) {
+        const RingAllocation allocation = m_ring.allocate(block.data.size());
+        std::memcpy(allocation.data, block.data.data(), block.data.size());
+        block.offset = allocation.offset;
+    }
+    m_ring.flush();
+    bind();
+}
+
+void FrameUniforms::bind() const {
+    const GLuint buffer = m_ring.getBuffer().getID();
+    for (const auto& block : m_blocks) {
+        GLState::getGlobal().bindBufferRange(GL_UNIFORM_BUFFER, block.binding, buffer,
+                                             static_cast<GLintptr>(block.offset),
+                                             static_cast<GLsizeiptr>(block.data.size()));
+    }
+}
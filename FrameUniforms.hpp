@@ -0,0 +1,87 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_FRAMEUNIFORMS_HPP
+#define OPENGLPLAYGROUND_FRAMEUNIFORMS_HPP
+
+#include "RingBuffer.hpp"
+#include "Shader.hpp"
+
+#include <glm/glm.hpp>
+#include <type_traits>
+
+// Binding point of the Matrices uniform block
+constexpr GLuint MATRICES_BLOCK_BINDING = 0;
+
+// Camera matrices as laid out in the Matrices uniform block with std140
+struct MatricesConstants {
+    glm::mat4 view;
+    glm::mat4 proj;
+};
+
+// Uniform blocks rewritten every frame, e.g. the camera matrices. Each block keeps a host copy of its data. update
+// writes all the copies to the next region of a uniform RingBuffer, each one on the uniform buffer offset alignment,
+// and binds every block to its range with glBindBufferRange. The GPU reads the regions of the previous frames while
+// the next one is written, so the CPU only waits when it runs more frames ahead than there are regions
+class FrameUniforms {
+private:
+    // Block bound to a binding point
+    struct Block {
+        GLuint binding;
+        // Data written on each update
+        std::vector<unsigned char> data;
+        // Offset of the range written by the last update
+        std::size_t offset;
+    };
+
+    // Buffer with one region per frame in flight
+    RingBuffer m_ring;
+    // Blocks, in the order they were added
+    std::vector<Block> m_blocks;
+    // Bytes used in a region by all the blocks
+    std::size_t m_frame_size;
+
+public:
+    // Create without blocks, needs the context for the offset alignment
+    explicit FrameUniforms(std::size_t num_frames = RING_BUFFER_FRAMES);
+
+    // Destroy buffer
+    void destroy();
+
+    // Assign a block of a linked program to a binding point, before prefetching the block. Returns false when the
+    // program has no such block, e.g. a shader variant that does not read it
+    static bool setupProgram(const Program& program, const std::string& block_name, GLuint binding);
+
+    // Add a block of size bytes bound to a binding point, returns its index. The regions grow, which waits for the GPU,
+    // so blocks are added before the first frame
+    std::size_t addBlock(GLuint binding, std::size_t size);
+
+    // Write bytes into the host copy of a block, they are uploaded by every update until written again
+    void write(std::size_t block, const void *data, std::size_t size, std::size_t offset = 0);
+
+    // Write a value into the host copy of a block, e.g. a struct laid out like the block
+    template<typename T>
+    inline void set(std::size_t block, const T& value, std::size_t offset = 0) {
+        static_assert(std::is_trivially_copyable<T>::value, "Uniform data must be trivially copyable");
+        write(block, &value, sizeof(T), offset);
+    }
+
+    // Write the blocks to the next region and bind them, once per frame before the draws
+    void update();
+
+    // Bind the ranges of the last update, e.g. after another range was bound to one of the binding points
+    void bind() const;
+
+    // Get offset of the range of a block written by the last update
+    inline std::size_t getOffset(std::size_t block) const noexcept {
+        return m_blocks[block].offset;
+    }
+
+    // Get number of updates that waited for the GPU
+    inline std::size_t getNumWaits() const noexcept {
+        return m_ring.getNumWaits();
+    }
+};
+
+#endif //OPENGLPLAYGROUND_FRAMEUNIFORMS_HPP
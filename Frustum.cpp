@@ -0,0 +1,276 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "Frustum.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Boxes are tested by blocks of this many, the arrays are padded to a multiple of it
+constexpr std::size_t CULLING_BLOCK = 8;
+// Boxes per task when culling on the thread pool, large sets are bandwidth bound and scale with the cores
+constexpr std::size_t CULLING_TASK_SIZE = 16384;
+
+#if defined(__AVX__)
+// Value of a plane component in every lane of a block
+using PlaneLanes = __m256;
+
+inline PlaneLanes broadcast(float value) {
+    return _mm256_set1_ps(value);
+}
+#elif defined(__SSE2__)
+using PlaneLanes = __m128;
+
+inline PlaneLanes broadcast(float value) {
+    return _mm_set1_ps(value);
+}
+#else
+using PlaneLanes = float;
+
+inline PlaneLanes broadcast(float value) {
+    return value;
+}
+#endif
+
+// Planes split in components, broadcast to the SIMD lanes once per cull instead of once per block
+struct PlaneComponents {
+    PlaneLanes nx[6];
+    PlaneLanes ny[6];
+    PlaneLanes nz[6];
+    PlaneLanes w[6];
+    // Absolute values of the normals, project the half extents
+    PlaneLanes ax[6];
+    PlaneLanes ay[6];
+    PlaneLanes az[6];
+
+    explicit PlaneComponents(const Frustum& frustum) {
+        for (std::size_t p = 0; p < 6; ++p) {
+            const glm::vec4& plane = frustum.getPlane(p);
+            nx[p] = broadcast(plane.x);
+            ny[p] = broadcast(plane.y);
+            nz[p] = broadcast(plane.z);
+            w[p] = broadcast(plane.w);
+            ax[p] = broadcast(std::fabs(plane.x));
+            ay[p] = broadcast(std::fabs(plane.y));
+            az[p] = broadcast(std::fabs(plane.z));
+        }
+    }
+};
+
+// Index of the lowest set bit, mask must not be 0
+inline unsigned int findLowestBit(unsigned int mask) noexcept {
+#if defined(__GNUC__)
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#elif defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, mask);
+    return static_cast<unsigned int>(bit);
+#else
+    unsigned int bit = 0;
+    while ((mask & 1u) == 0) {
+        mask >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Test a block of boxes starting at first, returns one bit per visible box
+inline unsigned int cullBlock(const PlaneComponents& planes, const float *cx, const float *cy, const float *cz,
+                              const float *ex, const float *ey, const float *ez, std::size_t first) {
+#if defined(__AVX__)
+    const __m256 center_x = _mm256_loadu_ps(cx + first);
+    const __m256 center_y = _mm256_loadu_ps(cy + first);
+    const __m256 center_z = _mm256_loadu_ps(cz + first);
+    const __m256 extent_x = _mm256_loadu_ps(ex + first);
+    const __m256 extent_y = _mm256_loadu_ps(ey + first);
+    const __m256 extent_z = _mm256_loadu_ps(ez + first);
+    __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (std::size_t p = 0; p < 6; ++p) {
+        // Signed distance of the center plus the projected radius of the box must be positive
+        const __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(planes.nx[p], center_x), _mm256_mul_ps(planes.ny[p], center_y)),
+                _mm256_add_ps(_mm256_mul_ps(planes.nz[p], center_z), planes.w[p]));
+        const __m256 radius = _mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(planes.ax[p], extent_x), _mm256_mul_ps(planes.ay[p], extent_y)),
+                _mm256_mul_ps(planes.az[p], extent_z));
+        visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(distance, radius), _mm256_setzero_ps(),
+                                                       _CMP_GE_OQ));
+    }
+    return static_cast<unsigned int>(_mm256_movemask_ps(visible));
+#elif defined(__SSE2__)
+    unsigned int mask = 0;
+    for (std::size_t half = 0; half < CULLING_BLOCK; half += 4) {
+        const std::size_t i = first + half;
+        const __m128 center_x = _mm_loadu_ps(cx + i);
+        const __m128 center_y = _mm_loadu_ps(cy + i);
+        const __m128 center_z = _mm_loadu_ps(cz + i);
+        const __m128 extent_x = _mm_loadu_ps(ex + i);
+        const __m128 extent_y = _mm_loadu_ps(ey + i);
+        const __m128 extent_z = _mm_loadu_ps(ez + i);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (std::size_t p = 0; p < 6; ++p) {
+            // Signed distance of the center plus the projected radius of the box must be positive
+            const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes.nx[p], center_x),
+                                                          _mm_mul_ps(planes.ny[p], center_y)),
+                                               _mm_add_ps(_mm_mul_ps(planes.nz[p], center_z), planes.w[p]));
+            const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes.ax[p], extent_x),
+                                                        _mm_mul_ps(planes.ay[p], extent_y)),
+                                             _mm_mul_ps(planes.az[p], extent_z));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+        }
+        mask |= static_cast<unsigned int>(_mm_movemask_ps(visible)) << half;
+    }
+    return mask;
+#else
+    unsigned int mask = 0;
+    for (std::size_t b = 0; b < CULLING_BLOCK; ++b) {
+        const std::size_t i = first + b;
+        bool visible = true;
+        for (std::size_t p = 0; p < 6 && visible; ++p) {
+            const float distance = planes.nx[p] * cx[i] + planes.ny[p] * cy[i] + planes.nz[p] * cz[i] + planes.w[p];
+            const float radius = planes.ax[p] * ex[i] + planes.ay[p] * ey[i] + planes.az[p] * ez[i];
+            visible = distance + radius >= 0.f;
+        }
+        mask |= static_cast<unsigned int>(visible) << b;
+    }
+    return mask;
+#endif
+}
+
+} // namespace
+
+Frustum::Frustum(const glm::mat4& clip) {
+    // Rows of the matrix, glm is column major
+    glm::vec4 rows[4];
+    for (int r = 0; r < 4; ++r) {
+        rows[r] = glm::vec4(clip[0][r], clip[1][r], clip[2][r], clip[3][r]);
+    }
+    // A point is inside when -w <= x, y, z <= w
+    m_planes[0] = rows[3] + rows[0];
+    m_planes[1] = rows[3] - rows[0];
+    m_planes[2] = rows[3] + rows[1];
+    m_planes[3] = rows[3] - rows[1];
+    m_planes[4] = rows[3] + rows[2];
+    m_planes[5] = rows[3] - rows[2];
+    // Normalise so that distances are in the units of the source space, needed for the sphere test
+    for (auto& plane : m_planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool Frustum::intersects(const AABB& box) const {
+    const glm::vec3 center = box.getCenter();
+    const glm::vec3 half = 0.5f * box.getExtent();
+    for (const auto& plane : m_planes) {
+        const glm::vec3 normal(plane);
+        if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), half) < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+    for (const auto& plane : m_planes) {
+        if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CullingVolumes::CullingVolumes()
+        : m_count(0) {}
+
+void CullingVolumes::clear() {
+    m_center_x.clear();
+    m_center_y.clear();
+    m_center_z.clear();
+    m_extent_x.clear();
+    m_extent_y.clear();
+    m_extent_z.clear();
+    m_count = 0;
+}
+
+std::size_t CullingVolumes::add(const AABB& box) {
+    const std::size_t index = m_count++;
+    // Grow by whole blocks, padding boxes have NaN centers so every comparison fails and they are never visible
+    if (index == m_center_x.size()) {
+        const std::size_t size = index + CULLING_BLOCK;
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        m_center_x.resize(size, nan);
+        m_center_y.resize(size, nan);
+        m_center_z.resize(size, nan);
+        m_extent_x.resize(size, 0.f);
+        m_extent_y.resize(size, 0.f);
+        m_extent_z.resize(size, 0.f);
+    }
+    set(index, box);
+    return index;
+}
+
+void CullingVolumes::set(std::size_t index, const AABB& box) {
+    const glm::vec3 center = box.getCenter();
+    const glm::vec3 half = 0.5f * box.getExtent();
+    m_center_x[index] = center.x;
+    m_center_y[index] = center.y;
+    m_center_z[index] = center.z;
+    m_extent_x[index] = half.x;
+    m_extent_y[index] = half.y;
+    m_extent_z[index] = half.z;
+}
+
+std::size_t CullingVolumes::cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const {
+    const PlaneComponents planes(frustum);
+    const std::size_t num_tasks = (m_count + CULLING_TASK_SIZE - 1) / CULLING_TASK_SIZE;
+    // Each task writes the indices of its range, they are concatenated in order afterwards
+    std::vector<std::vector<std::uint32_t>> task_visible(num_tasks);
+    ThreadPool::getGlobal().parallelFor(num_tasks, [&](std::size_t task) {
+        const std::size_t end = std::min(m_count, (task + 1) * CULLING_TASK_SIZE);
+        std::vector<std::uint32_t>& output = num_tasks == 1 ? visible : task_visible[task];
+        output.clear();
+        for (std::size_t first = task * CULLING_TASK_SIZE; first < end; first += CULLING_BLOCK) {
+            unsigned int mask = cullBlock(planes, m_center_x.data(), m_center_y.data(), m_center_z.data(),
+                                          m_extent_x.data(), m_extent_y.data(), m_extent_z.data(), first);
+            // Emit one index per set bit
+            while (mask != 0) {
+                output.push_back(static_cast<std::uint32_t>(first + findLowestBit(mask)));
+                mask &= mask - 1;
+            }
+        }
+    });
+    if (num_tasks != 1) {
+        visible.clear();
+        for (const auto& output : task_visible) {
+            visible.insert(visible.end(), output.begin(), output.end());
+        }
+    }
+    return visible.size();
+}
+
+void CullingVolumes::cull(const Frustum& frustum, std::vector<unsigned char>& visible) const {
+    const PlaneComponents planes(frustum);
+    // Padding is part of the last block, flags are written for it and dropped afterwards
+    visible.resize(m_center_x.size());
+    const std::size_t num_tasks = (m_count + CULLING_TASK_SIZE - 1) / CULLING_TASK_SIZE;
+    ThreadPool::getGlobal().parallelFor(num_tasks, [&](std::size_t task) {
+        const std::size_t end = std::min(m_count, (task + 1) * CULLING_TASK_SIZE);
+        for (std::size_t first = task * CULLING_TASK_SIZE; first < end; first += CULLING_BLOCK) {
+            const unsigned int mask = cullBlock(planes, m_center_x.data(), m_center_y.data(), m_center_z.data(),
+                                                m_extent_x.data(), m_extent_y.data(), m_extent_z.data(), first);
+            for (std::size_t b = 0; b < CULLING_BLOCK; ++b) {
+                visible[first + b] = static_cast<unsigned char>((mask >> b) & 1u);
+            }
+        }
+    });
+    visible.resize(m_count);
+}
@@ -0,0 +1,170 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "GLState.hpp"
+
+#include <algorithm>
+
+constexpr GLuint GLState::UNKNOWN_BINDING;
+
+GLState::GLState()
+        : m_vao(0), m_program(0), m_frame_calls(0), m_frame_avoided(0), m_last_frame_calls(0),
+          m_last_frame_avoided(0) {
+    // State of a new context, nothing bound
+    std::fill(m_buffers, m_buffers + NUM_TARGETS, 0u);
+}
+
+GLState& GLState::getGlobal() {
+    static GLState state;
+    return state;
+}
+
+void GLState::reset() {
+    std::fill(m_buffers, m_buffers + NUM_TARGETS, UNKNOWN_BINDING);
+    m_vao = UNKNOWN_BINDING;
+    m_program = UNKNOWN_BINDING;
+    m_uniform_ranges.clear();
+    m_capabilities.clear();
+}
+
+std::size_t GLState::getTargetSlot(GLenum target) noexcept {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_UNIFORM_BUFFER:
+            return 2;
+        case GL_COPY_READ_BUFFER:
+            return 3;
+        case GL_COPY_WRITE_BUFFER:
+            return 4;
+        case GL_DRAW_INDIRECT_BUFFER:
+            return 5;
+        case GL_PIXEL_PACK_BUFFER:
+            return 6;
+        case GL_PIXEL_UNPACK_BUFFER:
+            return 7;
+        default:
+            return NUM_TARGETS;
+    }
+}
+
+GLuint GLState::getBuffer(GLenum target) const noexcept {
+    const std::size_t slot = getTargetSlot(target);
+    return slot < NUM_TARGETS ? m_buffers[slot] : UNKNOWN_BINDING;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    const std::size_t slot = getTargetSlot(target);
+    if (slot < NUM_TARGETS && m_buffers[slot] == buffer) {
+        ++m_frame_avoided;
+        return;
+    }
+    glBindBuffer(target, buffer);
+    ++m_frame_calls;
+    if (slot < NUM_TARGETS) {
+        m_buffers[slot] = buffer;
+    }
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    // Only the uniform binding points are shadowed
+    if (target == GL_UNIFORM_BUFFER) {
+        if (index >= m_uniform_ranges.size()) {
+            m_uniform_ranges.resize(index + 1, {UNKNOWN_BINDING, 0, 0});
+        }
+        BufferRange& range = m_uniform_ranges[index];
+        if (range.buffer == buffer && range.offset == offset && range.size == size) {
+            ++m_frame_avoided;
+            return;
+        }
+        range = {buffer, offset, size};
+    }
+    glBindBufferRange(target, index, buffer, offset, size);
+    ++m_frame_calls;
+    const std::size_t slot = getTargetSlot(target);
+    if (slot < NUM_TARGETS) {
+        m_buffers[slot] = buffer;
+    }
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (m_vao == vao) {
+        ++m_frame_avoided;
+        return;
+    }
+    glBindVertexArray(vao);
+    ++m_frame_calls;
+    m_vao = vao;
+    m_buffers[getTargetSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN_BINDING;
+}
+
+void GLState::useProgram(GLuint program) {
+    if (m_program == program) {
+        ++m_frame_avoided;
+        return;
+    }
+    glUseProgram(program);
+    ++m_frame_calls;
+    m_program = program;
+}
+
+void GLState::setCapability(GLenum cap, bool enabled) {
+    auto it = std::find_if(m_capabilities.begin(), m_capabilities.end(),
+                           [cap](const std::pair<GLenum, bool>& capability) { return capability.first == cap; });
+    if (it != m_capabilities.end() && it->second == enabled) {
+        ++m_frame_avoided;
+        return;
+    }
+    if (enabled) {
+        glEnable(cap);
+    } else {
+        glDisable(cap);
+    }
+    ++m_frame_calls;
+    if (it != m_capabilities.end()) {
+        it->second = enabled;
+    } else {
+        m_capabilities.emplace_back(cap, enabled);
+    }
+}
+
+void GLState::deleteBuffer(GLuint buffer) {
+    glDeleteBuffers(1, &buffer);
+    // Identifier may be reused by the next buffer, none of the bindings must keep it
+    for (auto& binding : m_buffers) {
+        if (binding == buffer) {
+            binding = 0;
+        }
+    }
+    for (auto& range : m_uniform_ranges) {
+        if (range.buffer == buffer) {
+            range = {0, 0, 0};
+        }
+    }
+}
+
+void GLState::deleteVertexArray(GLuint vao) {
+    glDeleteVertexArrays(1, &vao);
+    if (m_vao == vao) {
+        m_vao = 0;
+        m_buffers[getTargetSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN_BINDING;
+    }
+}
+
+void GLState::deleteProgram(GLuint program) {
+    glDeleteProgram(program);
+    // Program in use is only deleted once another one is used, its identifier is not reused before
+    if (m_program == program) {
+        m_program = UNKNOWN_BINDING;
+    }
+}
+
+void GLState::endFrame() noexcept {
+    m_last_frame_calls = m_frame_calls;
+    m_last_frame_avoided = m_frame_avoided;
+    m_frame_calls = 0;
+    m_frame_avoided = 0;
+}
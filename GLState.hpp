@@ -0,0 +1,121 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_GLSTATE_HPP
+#define OPENGLPLAYGROUND_GLSTATE_HPP
+
+#include "GLUtils.hpp"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Shadow of the GL bindings of the context: buffer per target, VAO, program, uniform buffer ranges and enabled
+// capabilities. Changes that match the shadow are skipped, so wrappers can bind before each use without paying for
+// it. Every change of this state must go through the tracker or be followed by reset. The element array binding
+// belongs to the VAO, it is forgotten when the VAO changes. The application has a single context, so there is a
+// single tracker
+class GLState {
+private:
+    // Range bound to an indexed binding point
+    struct BufferRange {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    // Targets whose binding is shadowed, the others are always bound
+    static constexpr std::size_t NUM_TARGETS = 8;
+
+    // Binding per target, UNKNOWN_BINDING when not known
+    GLuint m_buffers[NUM_TARGETS];
+    // Bound VAO and program
+    GLuint m_vao;
+    GLuint m_program;
+    // Ranges bound to the uniform buffer binding points, by index
+    std::vector<BufferRange> m_uniform_ranges;
+    // Capabilities set through the tracker, with their state
+    std::vector<std::pair<GLenum, bool>> m_capabilities;
+    // Calls made and skipped in the current frame and in the last complete one
+    std::size_t m_frame_calls;
+    std::size_t m_frame_avoided;
+    std::size_t m_last_frame_calls;
+    std::size_t m_last_frame_avoided;
+
+    // Get slot of a target, NUM_TARGETS for the targets not shadowed
+    static std::size_t getTargetSlot(GLenum target) noexcept;
+
+    // Set a capability
+    void setCapability(GLenum cap, bool enabled);
+
+public:
+    // Binding of a target whose state is not known
+    static constexpr GLuint UNKNOWN_BINDING = ~GLuint(0);
+
+    GLState();
+
+    GLState(const GLState&) = delete;
+
+    GLState& operator=(const GLState&) = delete;
+
+    // Tracker of the context of the application
+    static GLState& getGlobal();
+
+    // Forget everything, e.g. after state was changed without the tracker. The next changes are all made
+    void reset();
+
+    // Bind a buffer to a target
+    void bindBuffer(GLenum target, GLuint buffer);
+
+    // Bind a range of a buffer to an indexed binding point, also binds the buffer to the target like GL does
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    // Bind a VAO, the element array binding is then the one of the VAO
+    void bindVertexArray(GLuint vao);
+
+    // Use a program
+    void useProgram(GLuint program);
+
+    // Enable / disable a capability
+    inline void enable(GLenum cap) {
+        setCapability(cap, true);
+    }
+
+    inline void disable(GLenum cap) {
+        setCapability(cap, false);
+    }
+
+    // Delete objects, GL unbinds them from everywhere they are bound
+    void deleteBuffer(GLuint buffer);
+
+    void deleteVertexArray(GLuint vao);
+
+    void deleteProgram(GLuint program);
+
+    // Get buffer bound to a target, UNKNOWN_BINDING for the targets not shadowed
+    GLuint getBuffer(GLenum target) const noexcept;
+
+    // Get bound VAO and program
+    inline GLuint getVertexArray() const noexcept {
+        return m_vao;
+    }
+
+    inline GLuint getProgram() const noexcept {
+        return m_program;
+    }
+
+    // Close the counters of the frame, once per frame
+    void endFrame() noexcept;
+
+    // Get number of binding calls made / skipped during the last complete frame
+    inline std::size_t getFrameCalls() const noexcept {
+        return m_last_frame_calls;
+    }
+
+    inline std::size_t getFrameAvoided() const noexcept {
+        return m_last_frame_avoided;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_GLSTATE_HPP
@@ -0,0 +1,79 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "InstanceBuffer.hpp"
+#include "ObjectTransforms.hpp"
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+// Instances fitting in a region of the ring initially, it grows with the number of instances
+constexpr std::size_t INSTANCE_INITIAL_COUNT = 1024;
+
+} // namespace
+
+InstanceBuffer::InstanceBuffer()
+        : m_ring(GL_ARRAY_BUFFER, INSTANCE_INITIAL_COUNT * sizeof(InstanceData)), m_offset(0), m_count(0) {}
+
+void InstanceBuffer::destroy() {
+    m_ring.destroy();
+}
+
+void InstanceBuffer::beginFrame() {
+    m_ring.beginFrame();
+}
+
+void InstanceBuffer::submit(const glm::mat4 *models, const glm::vec4 *colors, std::size_t count) {
+    const std::size_t size = count * sizeof(InstanceData);
+    RingAllocation allocation = m_ring.allocate(size);
+    if (allocation.data == nullptr) {
+        // Growing recreates the buffer, the draws of the previous submits keep reading the old one
+        m_ring.reserve(std::max(size, 2 * m_ring.getFrameSize()));
+        allocation = m_ring.allocate(size);
+    }
+    m_offset = allocation.offset;
+    m_count = static_cast<GLsizei>(count);
+
+    // Interleaved in place, the region may be mapped memory
+    auto instances = reinterpret_cast<InstanceData *>(allocation.data);
+    for (std::size_t i = 0; i < count; ++i) {
+        instances[i].model = models[i];
+        instances[i].color = colors != nullptr ? colors[i] : glm::vec4(1.f);
+        ObjectTransforms::computeNormalMatrix(models[i], instances[i].normal);
+    }
+    m_ring.flush();
+}
+
+void InstanceBuffer::submit(const std::vector<glm::mat4>& models, const std::vector<glm::vec4>& colors) {
+    submit(models.data(), colors.size() >= models.size() ? colors.data() : nullptr, models.size());
+}
+
+void InstanceBuffer::setup() const {
+    const Buffer& buffer = m_ring.getBuffer();
+    buffer.bind();
+    // A mat4 attribute takes four consecutive locations, one per column
+    for (GLuint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+        glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              reinterpret_cast<const void *>(m_offset + offsetof(InstanceData, model) +
+                                                             column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+    }
+    glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+    glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          reinterpret_cast<const void *>(m_offset + offsetof(InstanceData, color)));
+    glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+    // The mat3 normal attribute reads the xyz of three vec4 columns
+    for (GLuint column = 0; column < 3; ++column) {
+        glEnableVertexAttribArray(INSTANCE_NORMAL_LOCATION + column);
+        glVertexAttribPointer(INSTANCE_NORMAL_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              reinterpret_cast<const void *>(m_offset + offsetof(InstanceData, normal) +
+                                                             column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(INSTANCE_NORMAL_LOCATION + column, 1);
+    }
+    buffer.unbind();
+    GL_CHECK();
+}
@@ -0,0 +1,62 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_INSTANCEBUFFER_HPP
+#define OPENGLPLAYGROUND_INSTANCEBUFFER_HPP
+
+#include "RingBuffer.hpp"
+
+#include <glm/glm.hpp>
+
+// Attribute locations of the per instance data, after the vertex attributes
+constexpr GLuint INSTANCE_MODEL_LOCATION = 2;
+constexpr GLuint INSTANCE_COLOR_LOCATION = 6;
+constexpr GLuint INSTANCE_NORMAL_LOCATION = 7;
+
+// Per instance data as stored in the buffer
+struct InstanceData {
+    // Model matrix of the instance, applied after the model uniform
+    glm::mat4 model;
+    // Color of the instance
+    glm::vec4 color;
+    // Inverse transpose of the upper 3x3 of the model matrix, read as a mat3 with one column per vec4
+    glm::vec4 normal[3];
+};
+
+// Per instance attributes of instanced draws, read by the shaders compiled with the INSTANCED define
+class InstanceBuffer {
+private:
+    // Attribute ring buffer, one region per frame shared by the submits of the frame
+    RingBuffer m_ring;
+    // Offset of the instances of the last submit in the buffer
+    std::size_t m_offset;
+    // Number of instances
+    GLsizei m_count;
+
+public:
+    InstanceBuffer();
+
+    // Destroy buffer
+    void destroy();
+
+    // Start writing the next region of the ring, once per frame before the submits of the frame
+    void beginFrame();
+
+    // Replace the instances, colors can be null and default to white. They are written after the previous submits in
+    // the region of the frame, so the instances can change between draws without waiting for the previous ones
+    void submit(const glm::mat4 *models, const glm::vec4 *colors, std::size_t count);
+
+    // Replace the instances from arrays, colors can be empty
+    void submit(const std::vector<glm::mat4>& models, const std::vector<glm::vec4>& colors = {});
+
+    // Set the instance attributes pointers of the currently bound VAO
+    void setup() const;
+
+    // Get number of instances
+    inline GLsizei getCount() const noexcept {
+        return m_count;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_INSTANCEBUFFER_HPP
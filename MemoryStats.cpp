@@ -0,0 +1,142 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "MemoryStats.hpp"
+
+#include <iomanip>
+
+namespace {
+
+// Names of the categories, in the order of the enum
+const char *const CATEGORY_NAMES[] = {"vertex", "index", "uniform", "indirect", "staging", "other"};
+
+// Print a byte count in mebibytes
+void printBytes(std::ostream& stream, std::size_t bytes) {
+    stream << std::fixed << std::setprecision(2) << static_cast<double>(bytes) / (1024. * 1024.) << " MiB";
+}
+
+} // namespace
+
+const char *getMemoryCategoryName(MemoryCategory category) {
+    return CATEGORY_NAMES[static_cast<std::size_t>(category)];
+}
+
+MemoryCategory getMemoryCategory(GLenum target) {
+    switch (target) {
+        case GL_ARRAY_BUFFER:
+            return MemoryCategory::Vertex;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return MemoryCategory::Index;
+        case GL_UNIFORM_BUFFER:
+            return MemoryCategory::Uniform;
+        case GL_DRAW_INDIRECT_BUFFER:
+            return MemoryCategory::Indirect;
+        case GL_COPY_READ_BUFFER:
+        case GL_COPY_WRITE_BUFFER:
+            return MemoryCategory::Staging;
+        default:
+            return MemoryCategory::Other;
+    }
+}
+
+void MemoryStats::Counter::add(std::size_t size) {
+    const std::size_t current = bytes.fetch_add(size) + size;
+    // Raise the peak unless another thread already raised it higher
+    std::size_t previous = peak.load();
+    while (current > previous && !peak.compare_exchange_weak(previous, current)) {}
+}
+
+void MemoryStats::Counter::remove(std::size_t size) {
+    bytes.fetch_sub(size);
+}
+
+MemoryStats& MemoryStats::getGlobal() {
+    static MemoryStats stats;
+    return stats;
+}
+
+void MemoryStats::allocateGpu(MemoryCategory category, std::size_t size) {
+    m_gpu[static_cast<std::size_t>(category)].add(size);
+}
+
+void MemoryStats::releaseGpu(MemoryCategory category, std::size_t size) {
+    m_gpu[static_cast<std::size_t>(category)].remove(size);
+}
+
+void MemoryStats::allocateHost(std::size_t size) {
+    m_host.add(size);
+}
+
+void MemoryStats::releaseHost(std::size_t size) {
+    m_host.remove(size);
+}
+
+std::size_t MemoryStats::getTotalGpuBytes() const noexcept {
+    std::size_t total = 0;
+    for (const auto& counter : m_gpu) {
+        total += counter.bytes.load();
+    }
+    return total;
+}
+
+bool MemoryStats::isWithinBudgets() const noexcept {
+    for (const auto& counter : m_gpu) {
+        const std::size_t budget = counter.budget.load();
+        if (budget > 0 && counter.bytes.load() > budget) {
+            return false;
+        }
+    }
+    const std::size_t budget = m_host.budget.load();
+    return budget == 0 || m_host.bytes.load() <= budget;
+}
+
+void MemoryStats::printCounter(std::ostream& stream, const char *name, const Counter& counter) {
+    const std::size_t bytes = counter.bytes.load();
+    const std::size_t budget = counter.budget.load();
+    stream << "  " << std::left << std::setw(9) << name << std::right << " ";
+    printBytes(stream, bytes);
+    stream << ", peak ";
+    printBytes(stream, counter.peak.load());
+    if (budget > 0) {
+        stream << ", budget ";
+        printBytes(stream, budget);
+        if (bytes > budget) {
+            stream << " EXCEEDED";
+        }
+    }
+    stream << "\n";
+}
+
+void MemoryStats::print(std::ostream& stream) const {
+    // Formatting flags are restored, the stream is usually std::cout
+    const std::ios_base::fmtflags flags = stream.flags();
+    const std::streamsize precision = stream.precision();
+
+    stream << "GPU buffers ";
+    printBytes(stream, getTotalGpuBytes());
+    stream << "\n";
+    for (std::size_t c = 0; c < static_cast<std::size_t>(MemoryCategory::Count); ++c) {
+        printCounter(stream, CATEGORY_NAMES[c], m_gpu[c]);
+    }
+    stream << "  uploaded  ";
+    printBytes(stream, getFrameUploadBytes());
+    stream << " last frame\n";
+    stream << "Host import\n";
+    printCounter(stream, "host", m_host);
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+HostAllocation::HostAllocation()
+        : m_size(0) {}
+
+void HostAllocation::set(std::size_t size) {
+    if (size > m_size) {
+        MemoryStats::getGlobal().allocateHost(size - m_size);
+    } else if (size < m_size) {
+        MemoryStats::getGlobal().releaseHost(m_size - size);
+    }
+    m_size = size;
+}
@@ -0,0 +1,165 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MEMORYSTATS_HPP
+#define OPENGLPLAYGROUND_MEMORYSTATS_HPP
+
+#include "GLUtils.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Kind of GPU buffer memory, deduced from the target of the buffer
+enum class MemoryCategory {
+    Vertex,
+    Index,
+    Uniform,
+    Indirect,
+    // Copy sources and destinations of the uploads
+    Staging,
+    Other,
+    Count
+};
+
+// Get printable name of a category
+const char *getMemoryCategoryName(MemoryCategory category);
+
+// Get category of the buffers bound to a target
+MemoryCategory getMemoryCategory(GLenum target);
+
+// Byte counters shared by all the threads: live and peak GPU buffer memory per category, and the host memory of the
+// model imports. The counters only see what is reported, buffers created with Buffer report themselves
+class MemoryStats {
+private:
+    // Counter with its highest value
+    struct Counter {
+        std::atomic<std::size_t> bytes{0};
+        std::atomic<std::size_t> peak{0};
+        // Budget, 0 when there is none
+        std::atomic<std::size_t> budget{0};
+
+        void add(std::size_t size);
+
+        void remove(std::size_t size);
+    };
+
+    // GPU counters, one per category
+    Counter m_gpu[static_cast<std::size_t>(MemoryCategory::Count)];
+    // Host counter
+    Counter m_host;
+    // Bytes uploaded to buffers in the current frame and in the last complete one
+    std::atomic<std::size_t> m_frame_uploads{0};
+    std::atomic<std::size_t> m_last_frame_uploads{0};
+
+    // Print one counter, flags it when over budget
+    static void printCounter(std::ostream& stream, const char *name, const Counter& counter);
+
+public:
+    MemoryStats() = default;
+
+    MemoryStats(const MemoryStats&) = delete;
+
+    MemoryStats& operator=(const MemoryStats&) = delete;
+
+    // Registry of the application
+    static MemoryStats& getGlobal();
+
+    // Report GPU memory allocated or released
+    void allocateGpu(MemoryCategory category, std::size_t size);
+
+    void releaseGpu(MemoryCategory category, std::size_t size);
+
+    // Report host memory allocated or released
+    void allocateHost(std::size_t size);
+
+    void releaseHost(std::size_t size);
+
+    // Report bytes written to a buffer by the host
+    inline void addUpload(std::size_t size) noexcept {
+        m_frame_uploads.fetch_add(size);
+    }
+
+    // Close the upload count of the frame, once per frame
+    inline void endFrame() noexcept {
+        m_last_frame_uploads.store(m_frame_uploads.exchange(0));
+    }
+
+    // Get bytes uploaded during the last complete frame
+    inline std::size_t getFrameUploadBytes() const noexcept {
+        return m_last_frame_uploads.load();
+    }
+
+    // Get live and peak GPU bytes of a category
+    inline std::size_t getGpuBytes(MemoryCategory category) const noexcept {
+        return m_gpu[static_cast<std::size_t>(category)].bytes.load();
+    }
+
+    inline std::size_t getGpuPeakBytes(MemoryCategory category) const noexcept {
+        return m_gpu[static_cast<std::size_t>(category)].peak.load();
+    }
+
+    // Get live GPU bytes of all the categories
+    std::size_t getTotalGpuBytes() const noexcept;
+
+    // Get live and peak host bytes
+    inline std::size_t getHostBytes() const noexcept {
+        return m_host.bytes.load();
+    }
+
+    inline std::size_t getHostPeakBytes() const noexcept {
+        return m_host.peak.load();
+    }
+
+    // Restart the host peak from the live bytes, e.g. to measure a single import
+    inline void resetHostPeak() noexcept {
+        m_host.peak.store(m_host.bytes.load());
+    }
+
+    // Set budgets in bytes, 0 removes the budget
+    inline void setGpuBudget(MemoryCategory category, std::size_t budget) noexcept {
+        m_gpu[static_cast<std::size_t>(category)].budget.store(budget);
+    }
+
+    inline void setHostBudget(std::size_t budget) noexcept {
+        m_host.budget.store(budget);
+    }
+
+    // Check that the live bytes of every counter fit in its budget
+    bool isWithinBudgets() const noexcept;
+
+    // Print live, peak and budget of every counter, one line each
+    void print(std::ostream& stream) const;
+};
+
+// Host bytes held by an object and reported to the global registry. Setting a new size reports the difference, so it
+// can follow data that grows while it is processed. Not copyable, the bytes would be released twice
+class HostAllocation {
+private:
+    // Reported bytes
+    std::size_t m_size;
+
+public:
+    HostAllocation();
+
+    HostAllocation(const HostAllocation&) = delete;
+
+    HostAllocation& operator=(const HostAllocation&) = delete;
+
+    // Report the new size
+    void set(std::size_t size);
+
+    // Report the release of all the bytes
+    inline void release() {
+        set(0);
+    }
+
+    // Get reported bytes
+    inline std::size_t getSize() const noexcept {
+        return m_size;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_MEMORYSTATS_HPP
@@ -4,35 +4,87 @@
 
 #include "Mesh.hpp"
 
-void Mesh::setupMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) {
+#include <algorithm>
+#include <limits>
+
+MeshUploadData Mesh::prepare(const MeshDataView& data, VertexFormat format,
+                             const PositionQuantization& quantization) {
+    MeshUploadData upload{};
+    upload.layout = &VertexLayout::get(format);
+
+    // Use the ranges given or a single one spanning the whole index buffer
+    if (data.num_ranges > 0) {
+        upload.ranges.assign(data.ranges, data.ranges + data.num_ranges);
+    } else {
+        upload.ranges.push_back({0, static_cast<GLuint>(data.num_indices), 0});
+    }
+    if (data.num_lods > 0) {
+        upload.lods.assign(data.lods, data.lods + data.num_lods);
+    } else {
+        upload.lods.push_back({0, static_cast<GLuint>(upload.ranges.size()), 0.f});
+    }
+
+    // Pick the smallest index type that can address all the ranges
+    GLuint max_index = 0;
+    for (std::size_t i = 0; i < data.num_indices; ++i) {
+        max_index = std::max(max_index, data.indices[i]);
+    }
+    upload.index_type = max_index <= std::numeric_limits<GLushort>::max() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+
+    // Float vertices and 32 bit indices are referenced as they are
+    if (format == VertexFormat::Float) {
+        upload.vertex_source = reinterpret_cast<const unsigned char *>(data.vertices);
+        upload.vertex_size = data.num_vertices * sizeof(Vertex);
+    } else {
+        encodeVertices(data.vertices, data.num_vertices, *upload.layout, quantization, upload.vertex_storage);
+        upload.vertex_size = upload.vertex_storage.size();
+    }
+    if (upload.index_type == GL_UNSIGNED_SHORT) {
+        upload.index_storage.resize(data.num_indices * sizeof(GLushort));
+        auto short_indices = reinterpret_cast<GLushort *>(upload.index_storage.data());
+        for (std::size_t i = 0; i < data.num_indices; ++i) {
+            short_indices[i] = static_cast<GLushort>(data.indices[i]);
+        }
+        upload.index_size = upload.index_storage.size();
+    } else {
+        upload.index_source = reinterpret_cast<const unsigned char *>(data.indices);
+        upload.index_size = data.num_indices * sizeof(GLuint);
+    }
+
+    return upload;
+}
+
+void Mesh::setupMesh(const MeshUploadData& data, MeshUpload upload) {
+    m_ranges = data.ranges;
+    m_lods = data.lods;
+
     // Generate buffers
     glGenVertexArrays(1, &m_vao);
 
     // Bind VAO
-    glBindVertexArray(m_vao);
+    GLState::getGlobal().bindVertexArray(m_vao);
 
     // Bind buffer
     m_vertices.bind();
     m_indices.bind();
 
-    // Copy data to GPU
-    m_vertices.submitData(vertices);
-    m_indices.submitData(indices);
+    // Copy data to GPU or only allocate the storage
+    if (upload == MeshUpload::Immediate) {
+        m_vertices.submitData(data.getVertexBytes(), data.vertex_size);
+        m_indices.submitData(data.getIndexBytes(), data.index_size);
+    } else {
+        // Not through allocateSpace, it unbinds the buffers and the VAO would lose the index buffer
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(data.vertex_size), nullptr, GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(data.index_size), nullptr, GL_STATIC_DRAW);
+        m_vertices.setAllocatedSize(data.vertex_size);
+        m_indices.setAllocatedSize(data.index_size);
+    }
 
-    // Set attribute for position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0,
-                          3, GL_FLOAT, GL_FALSE,
-                          sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, position)));
-
-    // Set attribute for normal
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1,
-                          3, GL_FLOAT, GL_FALSE,
-                          sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, normal)));
+    // Set attributes from the layout
+    m_layout->setup();
 
     // Unbind
-    glBindVertexArray(0);
+    GLState::getGlobal().bindVertexArray(0);
     // CAREFUL The vertex array object MUST be unbinded before the buffers or it will lose the automatic binding
     m_vertices.unbind();
     m_indices.unbind();
@@ -40,24 +92,143 @@ void Mesh::setupMesh(const std::vector<Vertex>& vertices, const std::vector<GLui
     GL_CHECK();
 }
 
-Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, VertexFormat format,
+           const PositionQuantization& quantization)
+        : Mesh(MeshDataView{vertices.data(), vertices.size(), indices.data(), indices.size(), nullptr, 0, nullptr, 0},
+               format, quantization) {}
+
+Mesh::Mesh(const MeshDataView& data, VertexFormat format, const PositionQuantization& quantization)
+        : Mesh(prepare(data, format, quantization)) {}
+
+Mesh::Mesh(const MeshUploadData& data, MeshUpload upload)
         : m_vao(0), m_vertices(GL_ARRAY_BUFFER, GL_STATIC_DRAW), m_indices(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW),
-          m_num_elements(static_cast<GLsizei>(indices.size())) {
-    setupMesh(vertices, indices);
+          m_index_type(data.index_type), m_layout(data.layout), m_vertex_size(data.vertex_size),
+          m_index_size(data.index_size), m_shared(nullptr), m_allocation{INVALID_RANGE, INVALID_RANGE} {
+    setupMesh(data, upload);
+}
+
+Mesh::Mesh(const MeshUploadData& data, MeshBuffer& buffer, MeshUpload upload)
+        : m_vao(buffer.getVAO()), m_vertices(buffer.getVertexBuffer()), m_indices(buffer.getIndexBuffer()),
+          m_index_type(data.index_type), m_ranges(data.ranges), m_lods(data.lods), m_layout(data.layout),
+          m_vertex_size(data.vertex_size), m_index_size(data.index_size), m_shared(&buffer),
+          m_allocation{INVALID_RANGE, INVALID_RANGE} {
+    if (m_layout != &buffer.getVertexLayout()) {
+        std::cerr << "Mesh vertex layout does not match the layout of the shared buffer\n";
+        exit(EXIT_FAILURE);
+    }
+
+    m_allocation = buffer.allocate(data.vertex_size / m_layout->stride, data.index_size);
+
+    if (upload == MeshUpload::Immediate) {
+        buffer.submitVertices(getVertexOffset(), data.getVertexBytes(), data.vertex_size);
+        buffer.submitIndices(getIndexOffset(), data.getIndexBytes(), data.index_size);
+    }
 }
 
 void Mesh::destroy() {
-    glDeleteVertexArrays(1, &m_vao);
-    m_vertices.destroy();
-    m_indices.destroy();
+    // Shared buffers are destroyed by their owner, the ranges of the mesh are reused
+    if (m_shared != nullptr) {
+        m_shared->free(m_allocation);
+        m_shared = nullptr;
+    } else {
+        GLState::getGlobal().deleteVertexArray(m_vao);
+        m_vertices.destroy();
+        m_indices.destroy();
+    }
 }
 
-void Mesh::draw() const {
-    // Bind VAO
-    glBindVertexArray(m_vao);
-    // Draw command
-    glDrawElements(GL_TRIANGLES, m_num_elements, GL_UNSIGNED_INT, nullptr);
-    // Unbind VAO
-    glBindVertexArray(0);
+void Mesh::draw(std::size_t lod) const {
+    // Bind VAO, it stays bound so drawing the mesh again makes no bind call
+    GLState::getGlobal().bindVertexArray(m_vao);
+    // Draw commands
+    drawRanges(lod);
     GL_CHECK();
 }
+
+void Mesh::drawRanges(std::size_t lod) const {
+    const std::size_t index_size = m_index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    const std::size_t index_offset = getIndexOffset();
+    const GLint base_vertex = getBaseVertex();
+    const MeshLod& level = m_lods[std::min(lod, m_lods.size() - 1)];
+    // One draw command per range of the level, offset by the location of the mesh in the buffers
+    for (GLuint r = level.first_range; r < level.first_range + level.num_ranges; ++r) {
+        const DrawRange& range = m_ranges[r];
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(range.num_indices), m_index_type,
+                                 reinterpret_cast<const void *>(index_offset + range.first_index * index_size),
+                                 range.base_vertex + base_vertex);
+    }
+}
+
+void Mesh::draw(const std::vector<DrawRange>& ranges, MultiDrawArrays& arrays) const {
+    GLState::getGlobal().bindVertexArray(m_vao);
+    drawRanges(ranges, arrays);
+    GL_CHECK();
+}
+
+void Mesh::drawRanges(const std::vector<DrawRange>& ranges, MultiDrawArrays& arrays) const {
+    if (ranges.empty()) {
+        return;
+    }
+    const std::size_t index_size = m_index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    const std::size_t index_offset = getIndexOffset();
+    const GLint base_vertex = getBaseVertex();
+    // Culled meshes leave many small ranges, the driver gets them in a single call. The arrays keep their capacity,
+    // they only allocate while they grow
+    arrays.counts.resize(ranges.size());
+    arrays.offsets.resize(ranges.size());
+    arrays.base_vertices.resize(ranges.size());
+    for (std::size_t r = 0; r < ranges.size(); ++r) {
+        arrays.counts[r] = static_cast<GLsizei>(ranges[r].num_indices);
+        arrays.offsets[r] = reinterpret_cast<const void *>(index_offset + ranges[r].first_index * index_size);
+        arrays.base_vertices[r] = ranges[r].base_vertex + base_vertex;
+    }
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, arrays.counts.data(), m_index_type, arrays.offsets.data(),
+                                  static_cast<GLsizei>(ranges.size()), arrays.base_vertices.data());
+}
+
+void Mesh::drawInstanced(const InstanceBuffer& instances, std::size_t lod) const {
+    // Bind VAO and point the instance attributes to the buffer
+    GLState::getGlobal().bindVertexArray(m_vao);
+    instances.setup();
+    // Draw commands
+    drawRangesInstanced(instances.getCount(), lod);
+    GL_CHECK();
+}
+
+void Mesh::drawRangesInstanced(GLsizei num_instances, std::size_t lod) const {
+    const std::size_t index_size = m_index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    const std::size_t index_offset = getIndexOffset();
+    const GLint base_vertex = getBaseVertex();
+    const MeshLod& level = m_lods[std::min(lod, m_lods.size() - 1)];
+    for (GLuint r = level.first_range; r < level.first_range + level.num_ranges; ++r) {
+        const DrawRange& range = m_ranges[r];
+        glDrawElementsInstancedBaseVertex(
+                GL_TRIANGLES, static_cast<GLsizei>(range.num_indices), m_index_type,
+                reinterpret_cast<const void *>(index_offset + range.first_index * index_size), num_instances,
+                range.base_vertex + base_vertex);
+    }
+}
+
+void Mesh::appendCommands(std::size_t lod, std::vector<DrawElementsIndirectCommand>& commands) const {
+    const std::size_t index_size = m_index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    const std::size_t index_offset = getIndexOffset();
+    const GLint base_vertex = getBaseVertex();
+    const MeshLod& level = m_lods[std::min(lod, m_lods.size() - 1)];
+    // Index offset is aligned on 4 bytes, so it is a whole number of indices of either type
+    const auto first_index = static_cast<GLuint>(index_offset / index_size);
+    for (GLuint r = level.first_range; r < level.first_range + level.num_ranges; ++r) {
+        const DrawRange& range = m_ranges[r];
+        commands.push_back({range.num_indices, 1, first_index + range.first_index, range.base_vertex + base_vertex, 0});
+    }
+}
+
+void Mesh::appendCommands(const std::vector<DrawRange>& ranges,
+                          std::vector<DrawElementsIndirectCommand>& commands) const {
+    const std::size_t index_size = m_index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    const std::size_t index_offset = getIndexOffset();
+    const GLint base_vertex = getBaseVertex();
+    const auto first_index = static_cast<GLuint>(index_offset / index_size);
+    for (const DrawRange& range : ranges) {
+        commands.push_back({range.num_indices, 1, first_index + range.first_index, range.base_vertex + base_vertex, 0});
+    }
+}
@@ -7,11 +7,133 @@
 
 #include "Shader.hpp"
 #include "Buffer.hpp"
+#include "VertexLayout.hpp"
+#include "MeshBuffer.hpp"
+#include "InstanceBuffer.hpp"
 
-// Vertex data
-struct Vertex {
-    glm::vec3 position;
-    glm::vec3 normal;
+// Range of the index buffer drawn with a single draw call
+struct DrawRange {
+    // First index of the range
+    GLuint first_index;
+    // Number of indices
+    GLuint num_indices;
+    // Value added to each index of the range
+    GLint base_vertex;
+};
+
+// Command read by glMultiDrawElementsIndirect, layout fixed by the specification
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    // Must be 0 without ARB_base_instance
+    GLuint base_instance;
+};
+
+// Arguments of a glMultiDrawElementsBaseVertex call, kept by the caller so that drawing ranges does not allocate
+struct MultiDrawArrays {
+    std::vector<GLsizei> counts;
+    std::vector<const void *> offsets;
+    std::vector<GLint> base_vertices;
+};
+
+// Level of detail of a mesh, a set of consecutive draw ranges
+struct MeshLod {
+    // First range of the level
+    GLuint first_range;
+    // Number of ranges
+    GLuint num_ranges;
+    // Object space error of the level with respect to the full resolution mesh
+    float error;
+};
+
+// Non owning view on host mesh data, e.g. memory mapped data
+struct MeshDataView {
+    const Vertex *vertices;
+    std::size_t num_vertices;
+    const GLuint *indices;
+    std::size_t num_indices;
+    // Draw ranges, if empty the whole index buffer is drawn with base vertex 0
+    const DrawRange *ranges;
+    std::size_t num_ranges;
+    // Levels of detail, finest first. If empty all the ranges form a single level
+    const MeshLod *lods;
+    std::size_t num_lods;
+};
+
+// Host side mesh data, output of the model import
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    // Draw ranges, if empty the whole index buffer is drawn with base vertex 0
+    std::vector<DrawRange> ranges;
+    // Levels of detail, finest first. If empty all the ranges form a single level
+    std::vector<MeshLod> lods;
+
+    // Get view on data
+    inline MeshDataView getView() const noexcept {
+        return {vertices.data(), vertices.size(), indices.data(), indices.size(), ranges.data(), ranges.size(),
+                lods.data(), lods.size()};
+    }
+
+    // Get host memory held by the data, in bytes
+    inline std::size_t getHostBytes() const noexcept {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint) +
+               ranges.capacity() * sizeof(DrawRange) + lods.capacity() * sizeof(MeshLod);
+    }
+};
+
+// Mesh data encoded in the GPU formats, ready to be copied to the buffers. Preparing it only touches host memory
+struct MeshUploadData {
+    // Layout of the encoded vertices
+    const VertexLayout *layout;
+    // Type of the encoded indices
+    GLenum index_type;
+    // Source bytes, used when the data did not need any encoding
+    const unsigned char *vertex_source;
+    const unsigned char *index_source;
+    // Encoded bytes, used when not empty
+    std::vector<unsigned char> vertex_storage;
+    std::vector<unsigned char> index_storage;
+    // Size of the data in bytes
+    std::size_t vertex_size;
+    std::size_t index_size;
+    // Ranges and levels of detail
+    std::vector<DrawRange> ranges;
+    std::vector<MeshLod> lods;
+
+    // Get bytes to upload
+    inline const unsigned char *getVertexBytes() const noexcept {
+        return vertex_storage.empty() ? vertex_source : vertex_storage.data();
+    }
+
+    inline const unsigned char *getIndexBytes() const noexcept {
+        return index_storage.empty() ? index_source : index_storage.data();
+    }
+
+    // Get host memory held by the encoded data, in bytes. Referenced source bytes belong to the source
+    inline std::size_t getHostBytes() const noexcept {
+        return vertex_storage.capacity() + index_storage.capacity() + ranges.capacity() * sizeof(DrawRange) +
+               lods.capacity() * sizeof(MeshLod);
+    }
+};
+
+// Get host memory held by a set of encoded meshes, in bytes
+inline std::size_t getHostBytes(const std::vector<MeshUploadData>& uploads) {
+    std::size_t bytes = uploads.capacity() * sizeof(MeshUploadData);
+    for (const auto& upload : uploads) {
+        bytes += upload.getHostBytes();
+    }
+    return bytes;
+}
+
+// How the mesh buffers are filled on construction
+enum class MeshUpload {
+    // Data is copied immediately, meshes of a MeshBuffer queue it in the global UploadQueue
+    Immediate,
+    // Only the storage is allocated, the data is copied later by the caller into the buffers
+    Deferred
 };
 
 // Mesh class abstraction
@@ -23,21 +145,133 @@ private:
     Buffer m_vertices;
     // Indices buffer
     Buffer m_indices;
-    // Number of indices
-    std::size_t m_num_elements;
+    // Type of the indices, GL_UNSIGNED_SHORT when all ranges address less than 65536 vertices
+    GLenum m_index_type;
+    // Ranges drawn by each draw call
+    std::vector<DrawRange> m_ranges;
+    // Levels of detail, finest first
+    std::vector<MeshLod> m_lods;
+    // Layout of the vertices in the buffer
+    const VertexLayout *m_layout;
+    // Size of the data of the mesh in its buffers, in bytes
+    std::size_t m_vertex_size;
+    std::size_t m_index_size;
+    // Buffer the mesh is sub-allocated in, null when the VAO and the buffers belong to the mesh
+    MeshBuffer *m_shared;
+    // Ranges of the mesh in the shared buffer
+    MeshAllocation m_allocation;
 
     // Setup mesh, initialises buffers and copies data
-    void setupMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+    void setupMesh(const MeshUploadData& data, MeshUpload upload);
+
+    // Get offset of the first vertex in the buffers, read from the shared buffer as compactions move it
+    inline GLint getBaseVertex() const noexcept {
+        return m_shared != nullptr ? m_shared->getBaseVertex(m_allocation) : 0;
+    }
 
 public:
     // Construct mesh from given host data
-    Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices);
+    Mesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+         VertexFormat format = VertexFormat::Float, const PositionQuantization& quantization = PositionQuantization());
+
+    // Construct mesh from a view on host data. Quantized formats are encoded on the fly and need the dequantization
+    // matrix of the quantization folded into the model matrix when drawing
+    explicit Mesh(const MeshDataView& data, VertexFormat format = VertexFormat::Float,
+                  const PositionQuantization& quantization = PositionQuantization());
+
+    // Construct mesh from prepared data
+    explicit Mesh(const MeshUploadData& data, MeshUpload upload = MeshUpload::Immediate);
+
+    // Construct mesh from prepared data sub-allocated in a shared buffer, the layouts must match. The mesh uses the VAO
+    // and buffers of the shared buffer and only releases its ranges when destroyed, the buffer must outlive it
+    Mesh(const MeshUploadData& data, MeshBuffer& buffer, MeshUpload upload = MeshUpload::Immediate);
+
+    // Encode host data for upload, picks the index type. Data that needs no encoding is referenced, not copied, so
+    // the view must outlive the result
+    static MeshUploadData prepare(const MeshDataView& data, VertexFormat format,
+                                  const PositionQuantization& quantization);
+
+    // Get buffers, used to fill deferred meshes
+    inline const Buffer& getVertexBuffer() const noexcept {
+        return m_vertices;
+    }
+
+    inline const Buffer& getIndexBuffer() const noexcept {
+        return m_indices;
+    }
+
+    // Get offsets of the data of the mesh in its buffers, in bytes. They change when a shared buffer is compacted
+    inline std::size_t getVertexOffset() const noexcept {
+        return static_cast<std::size_t>(getBaseVertex()) * m_layout->stride;
+    }
+
+    inline std::size_t getIndexOffset() const noexcept {
+        return m_shared != nullptr ? m_shared->getIndexOffset(m_allocation) : 0;
+    }
+
+    // Get size of the data of the mesh in the GPU buffers, in bytes. Shared buffers only count the part of the mesh
+    inline std::size_t getGpuBytes() const noexcept {
+        return m_vertex_size + m_index_size;
+    }
+
+    // Get host memory held by the draw ranges and levels of detail, in bytes
+    inline std::size_t getHostBytes() const noexcept {
+        return m_ranges.capacity() * sizeof(DrawRange) + m_lods.capacity() * sizeof(MeshLod);
+    }
+
+    // Check if the VAO and buffers are shared with other meshes
+    inline bool isShared() const noexcept {
+        return m_shared != nullptr;
+    }
+
+    // Get vertex layout
+    inline const VertexLayout& getVertexLayout() const noexcept {
+        return *m_layout;
+    }
+
+    // Get type of the indices
+    inline GLenum getIndexType() const noexcept {
+        return m_index_type;
+    }
+
+    // Get number of levels of detail
+    inline std::size_t getNumLods() const noexcept {
+        return m_lods.size();
+    }
+
+    // Get a level of detail
+    inline const MeshLod& getLod(std::size_t lod) const noexcept {
+        return m_lods[lod];
+    }
 
     // Destroy mesh
     void destroy();
 
-    // Draw mesh
-    void draw() const;
+    // Draw mesh at the given level of detail
+    void draw(std::size_t lod = 0) const;
+
+    // Issue the draw calls of a level of detail without binding the VAO, used to draw meshes sharing a buffer
+    void drawRanges(std::size_t lod = 0) const;
+
+    // Draw given ranges of the index data of the mesh, e.g. the meshlets kept by a cull. The arguments of the multi
+    // draw are written to arrays, reused from one draw to the next
+    void draw(const std::vector<DrawRange>& ranges, MultiDrawArrays& arrays) const;
+
+    // Issue the draw of given ranges without binding the VAO, all the ranges are submitted with one multi draw
+    void drawRanges(const std::vector<DrawRange>& ranges, MultiDrawArrays& arrays) const;
+
+    // Draw instances of the mesh at the given level of detail, the instance attributes are set on the VAO
+    void drawInstanced(const InstanceBuffer& instances, std::size_t lod = 0) const;
+
+    // Issue the instanced draw calls of a level of detail without binding the VAO, the instance attributes must be set
+    void drawRangesInstanced(GLsizei num_instances, std::size_t lod = 0) const;
+
+    // Append the indirect commands of a level of detail, one per range. Offsets include the location of the mesh in
+    // its buffers so commands of meshes sharing a buffer can be submitted together
+    void appendCommands(std::size_t lod, std::vector<DrawElementsIndirectCommand>& commands) const;
+
+    // Append the indirect commands of given ranges of the index data of the mesh
+    void appendCommands(const std::vector<DrawRange>& ranges, std::vector<DrawElementsIndirectCommand>& commands) const;
 };
 
 #endif //OPENGLPLAYGROUND_MESH_HPP
@@ -0,0 +1,191 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "MeshBuffer.hpp"
+#include "MemoryStats.hpp"
+#include "UploadQueue.hpp"
+
+#include <algorithm>
+
+MeshBuffer::MeshBuffer(const VertexLayout& layout, std::size_t vertex_capacity, std::size_t index_capacity)
+        : m_vao(0), m_vertices(GL_ARRAY_BUFFER, GL_STATIC_DRAW), m_indices(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW),
+          m_layout(&layout), m_vertex_ranges(vertex_capacity * layout.stride),
+          m_index_ranges((index_capacity + 3) & ~std::size_t(3)), m_generation(0) {
+    // Generate VAO
+    glGenVertexArrays(1, &m_vao);
+    GLState::getGlobal().bindVertexArray(m_vao);
+
+    // Allocate storage, the buffers are bound directly because allocateSpace unbinds them
+    m_vertices.bind();
+    m_indices.bind();
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_vertex_ranges.getCapacity()), nullptr, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(m_index_ranges.getCapacity()), nullptr,
+                 GL_STATIC_DRAW);
+    m_vertices.setAllocatedSize(m_vertex_ranges.getCapacity());
+    m_indices.setAllocatedSize(m_index_ranges.getCapacity());
+
+    // Set attributes from the layout, meshes select their vertices with the base vertex
+    m_layout->setup();
+
+    // Unbind
+    GLState::getGlobal().bindVertexArray(0);
+    // CAREFUL The vertex array object MUST be unbinded before the buffers or it will lose the automatic binding
+    m_vertices.unbind();
+    m_indices.unbind();
+
+    GL_CHECK();
+}
+
+void MeshBuffer::destroy() {
+    GLState::getGlobal().deleteVertexArray(m_vao);
+    m_vertices.destroy();
+    m_indices.destroy();
+}
+
+void MeshBuffer::grow(Buffer& buffer, std::size_t used_size, std::size_t new_size) {
+    // Copy bindings are restored so callers streaming through them are not disturbed
+    GLState& state = GLState::getGlobal();
+    const GLuint read_binding = state.getBuffer(GL_COPY_READ_BUFFER);
+    const GLuint write_binding = state.getBuffer(GL_COPY_WRITE_BUFFER);
+
+    // Keep the used part in a temporary buffer while the storage is reallocated
+    GLuint temporary = 0;
+    if (used_size > 0) {
+        glGenBuffers(1, &temporary);
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, temporary);
+        glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(used_size), nullptr, GL_STREAM_COPY);
+        MemoryStats::getGlobal().allocateGpu(MemoryCategory::Staging, used_size);
+        state.bindBuffer(GL_COPY_READ_BUFFER, buffer.getID());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(used_size));
+    }
+
+    // Reallocate on the copy target, the identifier does not change so the VAO still references the buffer
+    state.bindBuffer(GL_COPY_WRITE_BUFFER, buffer.getID());
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(new_size), nullptr, GL_STATIC_DRAW);
+    buffer.setAllocatedSize(new_size);
+
+    if (used_size > 0) {
+        state.bindBuffer(GL_COPY_READ_BUFFER, temporary);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(used_size));
+        state.deleteBuffer(temporary);
+        MemoryStats::getGlobal().releaseGpu(MemoryCategory::Staging, used_size);
+    }
+    if (read_binding != GLState::UNKNOWN_BINDING) {
+        state.bindBuffer(GL_COPY_READ_BUFFER, read_binding);
+    }
+    if (write_binding != GLState::UNKNOWN_BINDING) {
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, write_binding);
+    }
+    GL_CHECK();
+}
+
+void MeshBuffer::reserveRanges(Buffer& buffer, RangeAllocator& ranges, std::size_t size) {
+    // Grow geometrically so that many small allocations do not copy the buffer each time
+    const std::size_t end = ranges.getAllocatedEnd();
+    if (end + size > ranges.getCapacity()) {
+        const std::size_t capacity = std::max(end + size, 2 * ranges.getCapacity());
+        grow(buffer, end, capacity);
+        ranges.grow(capacity);
+    }
+}
+
+std::uint32_t MeshBuffer::allocateRange(Buffer& buffer, RangeAllocator& ranges, std::size_t size,
+                                        std::size_t alignment) {
+    std::uint32_t range = ranges.allocate(size, alignment);
+    if (range == INVALID_RANGE) {
+        // The free range at the end of the grown buffer holds the allocation whatever its alignment
+        reserveRanges(buffer, ranges, std::max<std::size_t>(size, 1) + alignment);
+        range = ranges.allocate(size, alignment);
+    }
+    return range;
+}
+
+void MeshBuffer::reserve(std::size_t num_vertices, std::size_t index_size) {
+    reserveRanges(m_vertices, m_vertex_ranges, num_vertices * m_layout->stride);
+    reserveRanges(m_indices, m_index_ranges, (index_size + 3) & ~std::size_t(3));
+}
+
+MeshAllocation MeshBuffer::allocate(std::size_t num_vertices, std::size_t index_size) {
+    return {allocateRange(m_vertices, m_vertex_ranges, num_vertices * m_layout->stride, m_layout->stride),
+            allocateRange(m_indices, m_index_ranges, index_size, 4)};
+}
+
+void MeshBuffer::free(const MeshAllocation& allocation) {
+    m_vertex_ranges.free(allocation.vertex_range);
+    m_index_ranges.free(allocation.index_range);
+}
+
+void MeshBuffer::moveRanges(const Buffer& buffer, const std::vector<RangeMove>& moves) {
+    // Neighbours moved by the same distance are copied at once
+    std::vector<RangeMove> copies;
+    std::size_t total = 0;
+    for (const auto& move : moves) {
+        if (!copies.empty() && copies.back().old_offset + copies.back().size == move.old_offset &&
+            copies.back().new_offset + copies.back().size == move.new_offset) {
+            copies.back().size += move.size;
+        } else {
+            copies.push_back(move);
+        }
+        total += move.size;
+    }
+    if (copies.empty()) {
+        return;
+    }
+
+    GLState& state = GLState::getGlobal();
+    const GLuint read_binding = state.getBuffer(GL_COPY_READ_BUFFER);
+    const GLuint write_binding = state.getBuffer(GL_COPY_WRITE_BUFFER);
+
+    // Gather the moved ranges in a temporary buffer, then scatter them to their new offsets
+    GLuint temporary = 0;
+    glGenBuffers(1, &temporary);
+    state.bindBuffer(GL_COPY_WRITE_BUFFER, temporary);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(total), nullptr, GL_STREAM_COPY);
+    MemoryStats::getGlobal().allocateGpu(MemoryCategory::Staging, total);
+    state.bindBuffer(GL_COPY_READ_BUFFER, buffer.getID());
+    std::size_t offset = 0;
+    for (const auto& copy : copies) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(copy.old_offset),
+                            static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(copy.size));
+        offset += copy.size;
+    }
+    state.bindBuffer(GL_COPY_READ_BUFFER, temporary);
+    state.bindBuffer(GL_COPY_WRITE_BUFFER, buffer.getID());
+    offset = 0;
+    for (const auto& copy : copies) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(offset),
+                            static_cast<GLintptr>(copy.new_offset), static_cast<GLsizeiptr>(copy.size));
+        offset += copy.size;
+    }
+    state.deleteBuffer(temporary);
+    MemoryStats::getGlobal().releaseGpu(MemoryCategory::Staging, total);
+
+    if (read_binding != GLState::UNKNOWN_BINDING) {
+        state.bindBuffer(GL_COPY_READ_BUFFER, read_binding);
+    }
+    if (write_binding != GLState::UNKNOWN_BINDING) {
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, write_binding);
+    }
+    GL_CHECK();
+}
+
+void MeshBuffer::compact() {
+    // Queued writes use the offsets from before the moves
+    UploadQueue::getGlobal().flush();
+    std::vector<RangeMove> moves;
+    m_vertex_ranges.compact(moves);
+    moveRanges(m_vertices, moves);
+    moves.clear();
+    m_index_ranges.compact(moves);
+    moveRanges(m_indices, moves);
+    ++m_generation;
+}
+
+void MeshBuffer::submitVertices(std::size_t offset, const void *data, std::size_t size) const {
+    UploadQueue::getGlobal().write(m_vertices, offset, data, size);
+}
+
+void MeshBuffer::submitIndices(std::size_t offset, const void *data, std::size_t size) const {
+    UploadQueue::getGlobal().write(m_indices, offset, data, size);
+}
@@ -0,0 +1,143 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MESHBUFFER_HPP
+#define OPENGLPLAYGROUND_MESHBUFFER_HPP
+
+#include "Buffer.hpp"
+#include "RangeAllocator.hpp"
+#include "VertexLayout.hpp"
+
+// Ranges of a mesh inside a MeshBuffer. The offsets change when the buffer is compacted, they are read from the
+// buffer with the handles
+struct MeshAllocation {
+    // Handle of the vertex range
+    std::uint32_t vertex_range;
+    // Handle of the index range
+    std::uint32_t index_range;
+};
+
+// One vertex buffer and one index buffer with a single VAO, shared by many meshes of the same vertex layout. Meshes
+// are sub-allocated with a RangeAllocator per buffer and draw with a base vertex and an index offset, so drawing all
+// of them costs one VAO bind. Released ranges are reused, compact moves the meshes together when the free space is
+// too scattered. Indices of different types can be mixed, offsets are kept aligned on 4 bytes
+class MeshBuffer {
+private:
+    // VAO index
+    GLuint m_vao;
+    // Vertex buffer
+    Buffer m_vertices;
+    // Index buffer
+    Buffer m_indices;
+    // Layout of the vertices
+    const VertexLayout *m_layout;
+    // Ranges of the vertex buffer, in bytes aligned on the stride
+    RangeAllocator m_vertex_ranges;
+    // Ranges of the index buffer, in bytes aligned on 4
+    RangeAllocator m_index_ranges;
+    // Number of compactions, offsets read before the last one are outdated
+    std::size_t m_generation;
+
+    // Grow a buffer keeping its identifier and content, the VAO bindings stay valid
+    static void grow(Buffer& buffer, std::size_t used_size, std::size_t new_size);
+
+    // Grow a buffer and its ranges so that size more bytes fit after the last allocation
+    static void reserveRanges(Buffer& buffer, RangeAllocator& ranges, std::size_t size);
+
+    // Allocate a range, grows the buffer when it does not fit
+    static std::uint32_t allocateRange(Buffer& buffer, RangeAllocator& ranges, std::size_t size, std::size_t alignment);
+
+    // Copy moved ranges to their new offsets, through a temporary buffer since copies within a buffer must not overlap
+    static void moveRanges(const Buffer& buffer, const std::vector<RangeMove>& moves);
+
+public:
+    // Create buffers with the given initial capacity, in vertices and index bytes
+    explicit MeshBuffer(const VertexLayout& layout, std::size_t vertex_capacity = 0, std::size_t index_capacity = 0);
+
+    // Destroy buffers and VAO
+    void destroy();
+
+    // Make room for at least the given number of vertices and index bytes more, after the last allocations
+    void reserve(std::size_t num_vertices, std::size_t index_size);
+
+    // Allocate space for a mesh, grows the buffers if needed
+    MeshAllocation allocate(std::size_t num_vertices, std::size_t index_size);
+
+    // Release the space of a mesh, it is reused by the next allocations
+    void free(const MeshAllocation& allocation);
+
+    // Move all the meshes to the start of the buffers, the free space becomes one range at the end. Copies on the GPU
+    // with glCopyBufferSubData, the meshes read their new offsets with their handles. Indirect commands built before
+    // have to be rebuilt, getGeneration tells when
+    void compact();
+
+    // Queue data for the buffers in the global UploadQueue, offsets in bytes. The writes of consecutive meshes are
+    // merged, they reach the buffers on the next flush of the queue
+    void submitVertices(std::size_t offset, const void *data, std::size_t size) const;
+
+    void submitIndices(std::size_t offset, const void *data, std::size_t size) const;
+
+    // Get VAO index
+    inline GLuint getVAO() const noexcept {
+        return m_vao;
+    }
+
+    // Get buffers
+    inline const Buffer& getVertexBuffer() const noexcept {
+        return m_vertices;
+    }
+
+    inline const Buffer& getIndexBuffer() const noexcept {
+        return m_indices;
+    }
+
+    // Get vertex layout
+    inline const VertexLayout& getVertexLayout() const noexcept {
+        return *m_layout;
+    }
+
+    // Get offset of the first vertex of a mesh, in vertices. Added to the base vertex of the draw calls
+    inline GLint getBaseVertex(const MeshAllocation& allocation) const noexcept {
+        return static_cast<GLint>(m_vertex_ranges.getOffset(allocation.vertex_range) / m_layout->stride);
+    }
+
+    // Get offset of the first index of a mesh, in bytes
+    inline std::size_t getIndexOffset(const MeshAllocation& allocation) const noexcept {
+        return m_index_ranges.getOffset(allocation.index_range);
+    }
+
+    // Get number of compactions
+    inline std::size_t getGeneration() const noexcept {
+        return m_generation;
+    }
+
+    // Get used sizes
+    inline std::size_t getNumVertices() const noexcept {
+        return m_vertex_ranges.getUsed() / m_layout->stride;
+    }
+
+    inline std::size_t getIndexSize() const noexcept {
+        return m_index_ranges.getUsed();
+    }
+
+    // Get occupancy and fragmentation of the buffers, in bytes
+    inline RangeStatistics getVertexStatistics() const {
+        return m_vertex_ranges.getStatistics();
+    }
+
+    inline RangeStatistics getIndexStatistics() const {
+        return m_index_ranges.getStatistics();
+    }
+
+    // Bind / unbind VAO
+    inline void bind() const {
+        GLState::getGlobal().bindVertexArray(m_vao);
+    }
+
+    inline void unbind() const {
+        GLState::getGlobal().bindVertexArray(0);
+    }
+};
+
+#endif //OPENGLPLAYGROUND_MESHBUFFER_HPP
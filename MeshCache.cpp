@@ -0,0 +1,292 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "MeshCache.hpp"
+
+// STL includes
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+// POSIX includes
+#include <sys/stat.h>
+
+namespace {
+
+// Directory where cache files are stored
+const std::string cache_directory("cache");
+
+// Magic string at the beginning of each cache file
+constexpr char cache_magic[8] = {'O', 'G', 'L', 'P', 'M', 'E', 'S', 'H'};
+
+// Alignment of every data block in the file
+constexpr std::uint64_t block_alignment = 16;
+
+// File header
+struct MeshCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t import_flags;
+    std::int64_t source_mtime;
+    std::uint64_t options_hash;
+    std::uint64_t path_length;
+    std::uint64_t num_meshes;
+    std::uint64_t num_nodes;
+    std::uint64_t nodes_offset;
+    std::uint64_t names_offset;
+    std::uint64_t names_size;
+};
+
+// Node of the hierarchy, names are stored in a separate block
+struct MeshCacheNode {
+    std::int64_t parent;
+    std::uint64_t name_offset;
+    std::uint64_t name_length;
+    float local[16];
+};
+
+// Table entry for each mesh, offsets are from the beginning of the file
+struct MeshCacheEntry {
+    std::uint64_t num_vertices;
+    std::uint64_t num_indices;
+    std::uint64_t num_ranges;
+    std::uint64_t num_lods;
+    std::uint64_t vertices_offset;
+    std::uint64_t indices_offset;
+    std::uint64_t ranges_offset;
+    std::uint64_t lods_offset;
+    std::uint64_t node;
+};
+
+inline std::uint64_t alignOffset(std::uint64_t offset) {
+    return (offset + block_alignment - 1) & ~(block_alignment - 1);
+}
+
+// FNV-1a hash of the source path, used to name the cache file
+std::uint64_t hashString(const std::string& s) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (const char c : s) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Write zeros up to the given offset
+void padTo(std::ofstream& file, std::uint64_t& offset, std::uint64_t target) {
+    static const char zeros[block_alignment] = {};
+    file.write(zeros, static_cast<std::streamsize>(target - offset));
+    offset = target;
+}
+
+} // namespace
+
+constexpr std::uint32_t MeshCache::VERSION;
+
+std::string MeshCache::getCacheFileName(const MeshCacheKey& key) {
+    // Different options of the same source get different files so they do not overwrite each other
+    char name[40];
+    std::snprintf(name, sizeof(name), "%016llx_%016llx", static_cast<unsigned long long>(hashString(key.source_path)),
+                  static_cast<unsigned long long>(key.options_hash));
+    return cache_directory + "/" + name + ".mcache";
+}
+
+bool MeshCache::write(const MeshCacheKey& key, const std::vector<MeshData>& meshes, const SceneGraph& scene,
+                      const std::vector<std::uint32_t>& mesh_nodes) {
+    // Make sure the cache directory exists
+    mkdir(cache_directory.c_str(), 0755);
+
+    // Build header and mesh table
+    MeshCacheHeader header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = VERSION;
+    header.import_flags = key.import_flags;
+    header.source_mtime = key.source_mtime;
+    header.options_hash = key.options_hash;
+    header.path_length = key.source_path.size();
+    header.num_meshes = meshes.size();
+    header.num_nodes = scene.size();
+
+    // Node records and the concatenated names
+    std::vector<MeshCacheNode> nodes(scene.size());
+    std::string names;
+    for (std::uint32_t n = 0; n < scene.size(); ++n) {
+        nodes[n].parent = scene.getParent(n);
+        nodes[n].name_offset = names.size();
+        nodes[n].name_length = scene.getName(n).size();
+        std::memcpy(nodes[n].local, &scene.getLocalTransform(n)[0][0], sizeof(nodes[n].local));
+        names += scene.getName(n);
+    }
+
+    std::uint64_t offset = alignOffset(sizeof(MeshCacheHeader) + header.path_length);
+    const std::uint64_t table_offset = offset;
+    offset = alignOffset(offset + meshes.size() * sizeof(MeshCacheEntry));
+    header.nodes_offset = offset;
+    offset = alignOffset(offset + nodes.size() * sizeof(MeshCacheNode));
+    header.names_offset = offset;
+    header.names_size = names.size();
+    offset = alignOffset(offset + names.size());
+
+    std::vector<MeshCacheEntry> table(meshes.size());
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        table[i].node = mesh_nodes[i];
+        table[i].num_vertices = meshes[i].vertices.size();
+        table[i].num_indices = meshes[i].indices.size();
+        table[i].vertices_offset = offset;
+        offset = alignOffset(offset + table[i].num_vertices * sizeof(Vertex));
+        table[i].indices_offset = offset;
+        offset = alignOffset(offset + table[i].num_indices * sizeof(GLuint));
+        table[i].num_ranges = meshes[i].ranges.size();
+        table[i].ranges_offset = offset;
+        offset = alignOffset(offset + table[i].num_ranges * sizeof(DrawRange));
+        table[i].num_lods = meshes[i].lods.size();
+        table[i].lods_offset = offset;
+        offset = alignOffset(offset + table[i].num_lods * sizeof(MeshLod));
+    }
+
+    // Write to a temporary file and move it in place once complete, a reader never sees a partial cache
+    const std::string file_name = getCacheFileName(key);
+    const std::string tmp_file_name = file_name + ".tmp";
+    std::ofstream file(tmp_file_name, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Could not create mesh cache file: " << tmp_file_name << "\n";
+        return false;
+    }
+
+    std::uint64_t written = 0;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(MeshCacheHeader));
+    file.write(key.source_path.data(), static_cast<std::streamsize>(header.path_length));
+    written += sizeof(MeshCacheHeader) + header.path_length;
+    padTo(file, written, table_offset);
+    file.write(reinterpret_cast<const char *>(table.data()),
+               static_cast<std::streamsize>(table.size() * sizeof(MeshCacheEntry)));
+    written += table.size() * sizeof(MeshCacheEntry);
+    padTo(file, written, header.nodes_offset);
+    file.write(reinterpret_cast<const char *>(nodes.data()),
+               static_cast<std::streamsize>(nodes.size() * sizeof(MeshCacheNode)));
+    written += nodes.size() * sizeof(MeshCacheNode);
+    padTo(file, written, header.names_offset);
+    file.write(names.data(), static_cast<std::streamsize>(names.size()));
+    written += names.size();
+
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        padTo(file, written, table[i].vertices_offset);
+        file.write(reinterpret_cast<const char *>(meshes[i].vertices.data()),
+                   static_cast<std::streamsize>(table[i].num_vertices * sizeof(Vertex)));
+        written += table[i].num_vertices * sizeof(Vertex);
+        padTo(file, written, table[i].indices_offset);
+        file.write(reinterpret_cast<const char *>(meshes[i].indices.data()),
+                   static_cast<std::streamsize>(table[i].num_indices * sizeof(GLuint)));
+        written += table[i].num_indices * sizeof(GLuint);
+        padTo(file, written, table[i].ranges_offset);
+        file.write(reinterpret_cast<const char *>(meshes[i].ranges.data()),
+                   static_cast<std::streamsize>(table[i].num_ranges * sizeof(DrawRange)));
+        written += table[i].num_ranges * sizeof(DrawRange);
+        padTo(file, written, table[i].lods_offset);
+        file.write(reinterpret_cast<const char *>(meshes[i].lods.data()),
+                   static_cast<std::streamsize>(table[i].num_lods * sizeof(MeshLod)));
+        written += table[i].num_lods * sizeof(MeshLod);
+    }
+    file.close();
+
+    if (!file || std::rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+        std::cerr << "Error writing mesh cache file: " << file_name << "\n";
+        std::remove(tmp_file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool MeshCache::open(const MeshCacheKey& key) {
+    destroy();
+
+    m_file = MappedFile(getCacheFileName(key));
+    if (!m_file.isValid()) {
+        return false;
+    }
+
+    const unsigned char *data = m_file.getData();
+    const std::uint64_t size = m_file.getSize();
+
+    // Check header against key
+    MeshCacheHeader header{};
+    if (size < sizeof(MeshCacheHeader)) {
+        destroy();
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(MeshCacheHeader));
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != VERSION ||
+        header.import_flags != key.import_flags || header.source_mtime != key.source_mtime ||
+        header.options_hash != key.options_hash ||
+        header.path_length != key.source_path.size() || size - sizeof(MeshCacheHeader) < header.path_length ||
+        std::memcmp(data + sizeof(MeshCacheHeader), key.source_path.data(), key.source_path.size()) != 0) {
+        destroy();
+        return false;
+    }
+
+    // Read mesh table and validate all ranges against the file size
+    const std::uint64_t table_offset = alignOffset(sizeof(MeshCacheHeader) + header.path_length);
+    if (table_offset > size || header.num_meshes > (size - table_offset) / sizeof(MeshCacheEntry)) {
+        destroy();
+        return false;
+    }
+    const auto table = reinterpret_cast<const MeshCacheEntry *>(data + table_offset);
+
+    // Read the hierarchy, nodes are stored in depth first order
+    if (header.nodes_offset > size || header.num_nodes > (size - header.nodes_offset) / sizeof(MeshCacheNode) ||
+        header.names_offset > size || header.names_size > size - header.names_offset) {
+        std::cerr << "Corrupted mesh cache file for: " << key.source_path << "\n";
+        destroy();
+        return false;
+    }
+    const auto nodes = reinterpret_cast<const MeshCacheNode *>(data + header.nodes_offset);
+    const auto names = reinterpret_cast<const char *>(data + header.names_offset);
+    for (std::uint64_t n = 0; n < header.num_nodes; ++n) {
+        const MeshCacheNode& node = nodes[n];
+        if (node.name_offset > header.names_size || node.name_length > header.names_size - node.name_offset ||
+            node.parent < -1 || node.parent >= static_cast<std::int64_t>(n) ||
+            (node.parent >= 0 &&
+             node.parent + m_scene.getSubtreeSize(static_cast<std::uint32_t>(node.parent)) != static_cast<std::int64_t>(n))) {
+            std::cerr << "Corrupted mesh cache file for: " << key.source_path << "\n";
+            destroy();
+            return false;
+        }
+        glm::mat4 local;
+        std::memcpy(&local[0][0], node.local, sizeof(node.local));
+        m_scene.addNode(std::string(names + node.name_offset, node.name_length),
+                        static_cast<std::int32_t>(node.parent), local);
+    }
+
+    m_meshes.reserve(header.num_meshes);
+    for (std::uint64_t i = 0; i < header.num_meshes; ++i) {
+        const MeshCacheEntry& entry = table[i];
+        if (entry.vertices_offset > size || entry.num_vertices > (size - entry.vertices_offset) / sizeof(Vertex) ||
+            entry.indices_offset > size || entry.num_indices > (size - entry.indices_offset) / sizeof(GLuint) ||
+            entry.ranges_offset > size || entry.num_ranges > (size - entry.ranges_offset) / sizeof(DrawRange) ||
+            entry.lods_offset > size || entry.num_lods > (size - entry.lods_offset) / sizeof(MeshLod) ||
+            entry.node >= header.num_nodes || (!m_mesh_nodes.empty() && entry.node < m_mesh_nodes.back())) {
+            std::cerr << "Corrupted mesh cache file for: " << key.source_path << "\n";
+            destroy();
+            return false;
+        }
+        m_meshes.push_back({reinterpret_cast<const Vertex *>(data + entry.vertices_offset),
+                            static_cast<std::size_t>(entry.num_vertices),
+                            reinterpret_cast<const GLuint *>(data + entry.indices_offset),
+                            static_cast<std::size_t>(entry.num_indices),
+                            reinterpret_cast<const DrawRange *>(data + entry.ranges_offset),
+                            static_cast<std::size_t>(entry.num_ranges),
+                            reinterpret_cast<const MeshLod *>(data + entry.lods_offset),
+                            static_cast<std::size_t>(entry.num_lods)});
+        m_mesh_nodes.push_back(static_cast<std::uint32_t>(entry.node));
+    }
+
+    return true;
+}
+
+void MeshCache::destroy() {
+    m_meshes.clear();
+    m_scene.clear();
+    m_mesh_nodes.clear();
+    m_file.destroy();
+}
@@ -0,0 +1,80 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MESHCACHE_HPP
+#define OPENGLPLAYGROUND_MESHCACHE_HPP
+
+#include "Mesh.hpp"
+#include "FileIO.hpp"
+#include "SceneGraph.hpp"
+
+#include <cstdint>
+
+// Key identifying the source of a cached model
+struct MeshCacheKey {
+    // Path of the source file
+    std::string source_path;
+    // Modification time of the source file
+    std::int64_t source_mtime;
+    // Import flags used to produce the cached data
+    std::uint32_t import_flags;
+    // Hash of the processing options applied after the import
+    std::uint64_t options_hash;
+};
+
+// Versioned binary cache of imported models, the cache file is memory mapped on load so the data can be
+// submitted to the GPU without any parsing or copy
+class MeshCache {
+private:
+    // Mapped cache file
+    MappedFile m_file;
+    // Views on the cached meshes, they point directly into the mapped file
+    std::vector<MeshDataView> m_meshes;
+    // Node hierarchy of the model, small so it is copied out of the file
+    SceneGraph m_scene;
+    // Node of each mesh
+    std::vector<std::uint32_t> m_mesh_nodes;
+
+public:
+    // Format version, increase every time the layout of the file or of the cached data changes
+    static constexpr std::uint32_t VERSION = 5;
+
+    // Create empty cache
+    MeshCache() = default;
+
+    // Get the name of the cache file for a given key
+    static std::string getCacheFileName(const MeshCacheKey& key);
+
+    // Write cache file for the given key, meshes and node hierarchy, returns false on failure
+    static bool write(const MeshCacheKey& key, const std::vector<MeshData>& meshes, const SceneGraph& scene,
+                      const std::vector<std::uint32_t>& mesh_nodes);
+
+    // Map the cache file for the given key, returns false if there is no valid cache
+    bool open(const MeshCacheKey& key);
+
+    // Unmap cache file
+    void destroy();
+
+    // Get views on the cached meshes
+    inline const std::vector<MeshDataView>& getMeshes() const noexcept {
+        return m_meshes;
+    }
+
+    // Get node hierarchy
+    inline const SceneGraph& getSceneGraph() const noexcept {
+        return m_scene;
+    }
+
+    // Get node of each mesh
+    inline const std::vector<std::uint32_t>& getMeshNodes() const noexcept {
+        return m_mesh_nodes;
+    }
+
+    // Get size of the mapping in bytes, 0 when no cache is open
+    inline std::size_t getMappedSize() const noexcept {
+        return m_file.getSize();
+    }
+};
+
+#endif //OPENGLPLAYGROUND_MESHCACHE_HPP
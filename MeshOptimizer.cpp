@@ -0,0 +1,564 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "MeshOptimizer.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// Vertex to triangle adjacency in compressed form
+struct TriangleAdjacency {
+    // Offset of the triangles list for each vertex, num_vertices + 1 entries
+    std::vector<std::size_t> offsets;
+    // Triangles lists
+    std::vector<std::size_t> triangles;
+
+    TriangleAdjacency(const std::vector<GLuint>& indices, std::size_t num_vertices)
+            : offsets(num_vertices + 1, 0), triangles(indices.size()) {
+        for (const GLuint index : indices) {
+            ++offsets[index + 1];
+        }
+        for (std::size_t v = 0; v < num_vertices; ++v) {
+            offsets[v + 1] += offsets[v];
+        }
+        std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            triangles[fill[indices[i]]++] = i / 3;
+        }
+    }
+};
+
+// Tipsify dead end handling, first look at the recently used vertices then scan the input in order
+std::size_t skipDeadEnd(std::vector<std::size_t>& dead_end, const std::vector<std::size_t>& live_triangles,
+                        std::size_t& cursor, std::size_t num_vertices) {
+    while (!dead_end.empty()) {
+        const std::size_t d = dead_end.back();
+        dead_end.pop_back();
+        if (live_triangles[d] > 0) {
+            return d;
+        }
+    }
+    while (cursor < num_vertices) {
+        if (live_triangles[cursor] > 0) {
+            return cursor;
+        }
+        ++cursor;
+    }
+    return std::numeric_limits<std::size_t>::max();
+}
+
+// Number of vertices processed by each task of the parallel passes
+constexpr std::size_t weld_chunk_size = 1 << 16;
+
+// Number of independent hash tables used by the welding pass, power of two
+constexpr std::size_t weld_partitions = 64;
+
+// Quantised vertex used as welding key
+struct WeldKey {
+    std::int64_t values[6];
+
+    inline bool operator==(const WeldKey& other) const {
+        return std::memcmp(values, other.values, sizeof(values)) == 0;
+    }
+};
+
+inline std::int64_t quantize(float value, float inv_epsilon) {
+    if (inv_epsilon == 0.f) {
+        // Exact welding, compare bit patterns with both zeros mapped to the same key
+        std::int32_t bits;
+        const float v = value == 0.f ? 0.f : value;
+        std::memcpy(&bits, &v, sizeof(bits));
+        return bits;
+    }
+    return std::llround(static_cast<double>(value) * inv_epsilon);
+}
+
+inline WeldKey makeWeldKey(const Vertex& vertex, float inv_epsilon) {
+    return {{quantize(vertex.position.x, inv_epsilon), quantize(vertex.position.y, inv_epsilon),
+             quantize(vertex.position.z, inv_epsilon), quantize(vertex.normal.x, inv_epsilon),
+             quantize(vertex.normal.y, inv_epsilon), quantize(vertex.normal.z, inv_epsilon)}};
+}
+
+inline std::uint64_t hashWeldKey(const WeldKey& key) {
+    std::uint64_t hash = 0;
+    for (const std::int64_t value : key.values) {
+        // splitmix64 finaliser on the running combination
+        std::uint64_t x = hash ^ (static_cast<std::uint64_t>(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        hash = x ^ (x >> 31);
+    }
+    return hash;
+}
+
+inline std::size_t weldPartition(std::uint64_t hash) {
+    return static_cast<std::size_t>(hash >> 58) & (weld_partitions - 1);
+}
+
+} // namespace
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<GLuint>& indices, std::size_t num_vertices,
+                                         std::size_t cache_size) {
+    // Time at which each vertex entered the cache, a vertex is still cached if less than cache_size misses happened
+    std::vector<std::size_t> cache_time(num_vertices, 0);
+    std::vector<bool> referenced(num_vertices, false);
+    std::size_t time = cache_size + 1;
+    std::size_t misses = 0;
+    std::size_t unique = 0;
+
+    for (const GLuint index : indices) {
+        if (time - cache_time[index] > cache_size) {
+            cache_time[index] = time++;
+            ++misses;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            ++unique;
+        }
+    }
+
+    const std::size_t num_triangles = indices.size() / 3;
+    return {num_triangles > 0 ? static_cast<float>(misses) / num_triangles : 0.f,
+            unique > 0 ? static_cast<float>(misses) / unique : 0.f};
+}
+
+std::vector<std::size_t> optimizeVertexCache(std::vector<GLuint>& indices, std::size_t num_vertices,
+                                             std::size_t cache_size) {
+    const std::size_t num_triangles = indices.size() / 3;
+    std::vector<std::size_t> hard_boundaries;
+    if (num_triangles == 0) {
+        return hard_boundaries;
+    }
+
+    const TriangleAdjacency adjacency(indices, num_vertices);
+
+    // Number of non emitted triangles for each vertex
+    std::vector<std::size_t> live_triangles(num_vertices);
+    for (std::size_t v = 0; v < num_vertices; ++v) {
+        live_triangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+    }
+    std::vector<std::size_t> cache_time(num_vertices, 0);
+    std::vector<bool> emitted(num_triangles, false);
+    std::vector<std::size_t> dead_end;
+    std::vector<std::size_t> candidates;
+    std::vector<GLuint> output;
+    output.reserve(indices.size());
+
+    std::size_t time = cache_size + 1;
+    std::size_t cursor = 0;
+    std::size_t fanning = skipDeadEnd(dead_end, live_triangles, cursor, num_vertices);
+
+    while (fanning != std::numeric_limits<std::size_t>::max()) {
+        candidates.clear();
+        // Emit all the remaining triangles around the fanning vertex
+        for (std::size_t a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; ++a) {
+            const std::size_t t = adjacency.triangles[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (std::size_t k = 0; k < 3; ++k) {
+                const GLuint v = indices[3 * t + k];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live_triangles[v];
+                if (time - cache_time[v] > cache_size) {
+                    cache_time[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // Pick the candidate that will still be in cache after emitting all its triangles and entered it the longest
+        // ago, i.e. the oldest cache entry that can still be reused before it is evicted
+        std::size_t next = std::numeric_limits<std::size_t>::max();
+        std::size_t best_priority = 0;
+        bool found = false;
+        for (const std::size_t v : candidates) {
+            if (live_triangles[v] == 0) {
+                continue;
+            }
+            std::size_t priority = 0;
+            if (time - cache_time[v] + 2 * live_triangles[v] <= cache_size) {
+                priority = time - cache_time[v];
+            }
+            if (!found || priority > best_priority) {
+                best_priority = priority;
+                next = v;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            next = skipDeadEnd(dead_end, live_triangles, cursor, num_vertices);
+            // The traversal jumps, the cache content is unrelated to what comes next
+            if (output.size() < indices.size()) {
+                hard_boundaries.push_back(output.size() / 3);
+            }
+        }
+        fanning = next;
+    }
+
+    indices.swap(output);
+    return hard_boundaries;
+}
+
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+                      const std::vector<std::size_t>& hard_boundaries, float threshold, std::size_t cache_size) {
+    const std::size_t num_triangles = indices.size() / 3;
+    if (num_triangles == 0) {
+        return;
+    }
+
+    // Split the clusters further where the partial ACMR is already good, this gives more freedom to the sorting
+    const float acmr_threshold = analyzeVertexCache(indices, vertices.size(), cache_size).acmr * threshold;
+    std::vector<std::size_t> boundaries(1, 0);
+    {
+        std::vector<std::size_t> cache_time(vertices.size(), 0);
+        std::size_t time = cache_size + 1;
+        std::size_t cluster_misses = 0;
+        std::size_t cluster_start = 0;
+        std::size_t next_hard = 0;
+        for (std::size_t t = 0; t < num_triangles; ++t) {
+            // Hard boundaries reset the cache
+            if (next_hard < hard_boundaries.size() && hard_boundaries[next_hard] == t) {
+                ++next_hard;
+                if (t != cluster_start) {
+                    boundaries.push_back(t);
+                }
+                cluster_start = t;
+                cluster_misses = 0;
+                time += cache_size + 1;
+            }
+            for (std::size_t k = 0; k < 3; ++k) {
+                const GLuint v = indices[3 * t + k];
+                if (time - cache_time[v] > cache_size) {
+                    cache_time[v] = time++;
+                    ++cluster_misses;
+                }
+            }
+            // Soft boundary, the following triangles start with a cold cache
+            const std::size_t cluster_size = t + 1 - cluster_start;
+            if (cluster_size >= cache_size &&
+                static_cast<float>(cluster_misses) / cluster_size <= acmr_threshold && t + 1 < num_triangles) {
+                boundaries.push_back(t + 1);
+                cluster_start = t + 1;
+                cluster_misses = 0;
+                time += cache_size + 1;
+            }
+        }
+    }
+    boundaries.push_back(num_triangles);
+
+    // Mesh centroid, area weighted
+    glm::vec3 mesh_centroid(0.f);
+    float mesh_area = 0.f;
+    std::vector<glm::vec3> triangle_normals(num_triangles);
+    std::vector<glm::vec3> triangle_centroids(num_triangles);
+    std::vector<float> triangle_areas(num_triangles);
+    for (std::size_t t = 0; t < num_triangles; ++t) {
+        const glm::vec3& p0 = vertices[indices[3 * t]].position;
+        const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+        const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+        // Cross product length is twice the area, scale does not matter for the weights
+        triangle_normals[t] = glm::cross(p1 - p0, p2 - p0);
+        triangle_areas[t] = glm::length(triangle_normals[t]);
+        triangle_centroids[t] = (p0 + p1 + p2) / 3.f;
+        mesh_centroid += triangle_centroids[t] * triangle_areas[t];
+        mesh_area += triangle_areas[t];
+    }
+    if (mesh_area > 0.f) {
+        mesh_centroid /= mesh_area;
+    }
+
+    // Sort key of each cluster, the more a cluster points away from the center the earlier it is drawn
+    const std::size_t num_clusters = boundaries.size() - 1;
+    std::vector<float> sort_keys(num_clusters);
+    for (std::size_t c = 0; c < num_clusters; ++c) {
+        glm::vec3 centroid(0.f);
+        glm::vec3 normal(0.f);
+        float area = 0.f;
+        for (std::size_t t = boundaries[c]; t < boundaries[c + 1]; ++t) {
+            centroid += triangle_centroids[t] * triangle_areas[t];
+            normal += triangle_normals[t];
+            area += triangle_areas[t];
+        }
+        if (area > 0.f) {
+            centroid /= area;
+        }
+        const float normal_length = glm::length(normal);
+        sort_keys[c] = normal_length > 0.f ? glm::dot(centroid - mesh_centroid, normal / normal_length) : 0.f;
+    }
+
+    std::vector<std::size_t> order(num_clusters);
+    for (std::size_t c = 0; c < num_clusters; ++c) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sort_keys](std::size_t a, std::size_t b) {
+        return sort_keys[a] > sort_keys[b];
+    });
+
+    // Emit clusters in the new order
+    std::vector<GLuint> output;
+    output.reserve(indices.size());
+    for (const std::size_t c : order) {
+        output.insert(output.end(), indices.begin() + 3 * boundaries[c], indices.begin() + 3 * boundaries[c + 1]);
+    }
+    indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
+    constexpr GLuint unassigned = std::numeric_limits<GLuint>::max();
+    std::vector<GLuint> remap(vertices.size(), unassigned);
+    std::vector<Vertex> output;
+    output.reserve(vertices.size());
+
+    for (GLuint& index : indices) {
+        if (remap[index] == unassigned) {
+            remap[index] = static_cast<GLuint>(output.size());
+            output.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(output);
+}
+
+VertexWeldStatistics weldVertices(MeshData& data, float epsilon) {
+    const std::size_t num_vertices = data.vertices.size();
+    VertexWeldStatistics statistics{num_vertices, num_vertices, 0};
+    if (num_vertices == 0) {
+        return statistics;
+    }
+
+    ThreadPool& pool = ThreadPool::getGlobal();
+    const float inv_epsilon = epsilon > 0.f ? 1.f / epsilon : 0.f;
+    const std::size_t num_chunks = (num_vertices + weld_chunk_size - 1) / weld_chunk_size;
+    const auto chunkBegin = [](std::size_t c) { return c * weld_chunk_size; };
+    const auto chunkEnd = [num_vertices](std::size_t c) { return std::min(num_vertices, (c + 1) * weld_chunk_size); };
+
+    // Hash all vertices and count how many fall in each partition per chunk
+    std::vector<std::uint64_t> hashes(num_vertices);
+    std::vector<std::size_t> partition_counts(num_chunks * weld_partitions, 0);
+    pool.parallelFor(num_chunks, [&](std::size_t c) {
+        for (std::size_t v = chunkBegin(c); v < chunkEnd(c); ++v) {
+            hashes[v] = hashWeldKey(makeWeldKey(data.vertices[v], inv_epsilon));
+            ++partition_counts[c * weld_partitions + weldPartition(hashes[v])];
+        }
+    });
+
+    // Counting sort of the vertices by partition, order inside each partition follows the input order
+    std::vector<std::size_t> partition_offsets(weld_partitions + 1, 0);
+    std::vector<std::size_t> scatter_offsets(num_chunks * weld_partitions);
+    {
+        std::size_t offset = 0;
+        for (std::size_t p = 0; p < weld_partitions; ++p) {
+            partition_offsets[p] = offset;
+            for (std::size_t c = 0; c < num_chunks; ++c) {
+                scatter_offsets[c * weld_partitions + p] = offset;
+                offset += partition_counts[c * weld_partitions + p];
+            }
+        }
+        partition_offsets[weld_partitions] = offset;
+    }
+    std::vector<GLuint> sorted(num_vertices);
+    pool.parallelFor(num_chunks, [&](std::size_t c) {
+        std::size_t *offsets = &scatter_offsets[c * weld_partitions];
+        for (std::size_t v = chunkBegin(c); v < chunkEnd(c); ++v) {
+            sorted[offsets[weldPartition(hashes[v])]++] = static_cast<GLuint>(v);
+        }
+    });
+
+    // Find the first occurrence of each key, partitions are independent so each gets its own open addressing table
+    std::vector<GLuint> canonical(num_vertices);
+    pool.parallelFor(weld_partitions, [&](std::size_t p) {
+        const std::size_t begin = partition_offsets[p];
+        const std::size_t end = partition_offsets[p + 1];
+        std::size_t capacity = 16;
+        while (capacity < 2 * (end - begin)) {
+            capacity <<= 1;
+        }
+        constexpr GLuint empty = std::numeric_limits<GLuint>::max();
+        std::vector<GLuint> table(capacity, empty);
+        for (std::size_t s = begin; s < end; ++s) {
+            const GLuint v = sorted[s];
+            const WeldKey key = makeWeldKey(data.vertices[v], inv_epsilon);
+            std::size_t slot = static_cast<std::size_t>(hashes[v]) & (capacity - 1);
+            while (true) {
+                const GLuint candidate = table[slot];
+                if (candidate == empty) {
+                    table[slot] = v;
+                    canonical[v] = v;
+                    break;
+                }
+                if (hashes[candidate] == hashes[v] && makeWeldKey(data.vertices[candidate], inv_epsilon) == key) {
+                    canonical[v] = candidate;
+                    break;
+                }
+                slot = (slot + 1) & (capacity - 1);
+            }
+        }
+    });
+
+    // Assign new indices to the kept vertices, chunk counts first then a prefix sum
+    std::vector<std::size_t> kept_offsets(num_chunks + 1, 0);
+    pool.parallelFor(num_chunks, [&](std::size_t c) {
+        std::size_t kept = 0;
+        for (std::size_t v = chunkBegin(c); v < chunkEnd(c); ++v) {
+            kept += canonical[v] == v;
+        }
+        kept_offsets[c + 1] = kept;
+    });
+    for (std::size_t c = 0; c < num_chunks; ++c) {
+        kept_offsets[c + 1] += kept_offsets[c];
+    }
+    const std::size_t num_kept = kept_offsets[num_chunks];
+    if (num_kept == num_vertices) {
+        return statistics;
+    }
+
+    // Canonical vertices always come first in input order, so they get their index before being referenced
+    std::vector<GLuint> remap(num_vertices);
+    std::vector<Vertex> vertices(num_kept);
+    pool.parallelFor(num_chunks, [&](std::size_t c) {
+        std::size_t next = kept_offsets[c];
+        for (std::size_t v = chunkBegin(c); v < chunkEnd(c); ++v) {
+            if (canonical[v] == v) {
+                remap[v] = static_cast<GLuint>(next);
+                vertices[next++] = data.vertices[v];
+            }
+        }
+    });
+    pool.parallelFor(num_chunks, [&](std::size_t c) {
+        for (std::size_t v = chunkBegin(c); v < chunkEnd(c); ++v) {
+            if (canonical[v] != v) {
+                remap[v] = remap[canonical[v]];
+            }
+        }
+    });
+    data.vertices.swap(vertices);
+
+    // Remap indices and drop the triangles that collapsed
+    const std::size_t num_triangles = data.indices.size() / 3;
+    std::size_t write = 0;
+    for (std::size_t t = 0; t < num_triangles; ++t) {
+        const GLuint a = remap[data.indices[3 * t]];
+        const GLuint b = remap[data.indices[3 * t + 1]];
+        const GLuint c = remap[data.indices[3 * t + 2]];
+        if (a == b || b == c || a == c) {
+            ++statistics.degenerate_triangles;
+            continue;
+        }
+        data.indices[write++] = a;
+        data.indices[write++] = b;
+        data.indices[write++] = c;
+    }
+    // Indices that are not part of a triangle (points, lines) are only remapped
+    for (std::size_t i = 3 * num_triangles; i < data.indices.size(); ++i) {
+        data.indices[write++] = remap[data.indices[i]];
+    }
+    data.indices.resize(write);
+
+    statistics.vertices_after = num_kept;
+    return statistics;
+}
+
+std::size_t splitIndexRanges(MeshData& data, std::size_t max_vertices) {
+    if (data.vertices.size() <= max_vertices || data.indices.size() % 3 != 0) {
+        return std::max<std::size_t>(1, data.ranges.size());
+    }
+
+    // Work on explicit ranges and levels
+    if (data.ranges.empty()) {
+        data.ranges.push_back({0, static_cast<GLuint>(data.indices.size()), 0});
+    }
+    if (data.lods.empty()) {
+        data.lods.push_back({0, static_cast<GLuint>(data.ranges.size()), 0.f});
+    }
+
+    constexpr std::size_t no_range = std::numeric_limits<std::size_t>::max();
+    // Output range that last copied each vertex and index of the copy in that range
+    std::vector<std::size_t> owner(data.vertices.size(), no_range);
+    std::vector<GLuint> local(data.vertices.size(), 0);
+
+    std::vector<Vertex> vertices;
+    vertices.reserve(data.vertices.size());
+    std::vector<GLuint> indices;
+    indices.reserve(data.indices.size());
+    std::vector<DrawRange> ranges;
+    std::vector<MeshLod> lods;
+
+    std::size_t range_first_vertex = 0;
+    std::size_t range_first_index = 0;
+    const auto closeRange = [&]() {
+        if (indices.size() > range_first_index) {
+            ranges.push_back({static_cast<GLuint>(range_first_index),
+                              static_cast<GLuint>(indices.size() - range_first_index),
+                              static_cast<GLint>(range_first_vertex)});
+        }
+        range_first_vertex = vertices.size();
+        range_first_index = indices.size();
+    };
+
+    // Every level is split on its own, vertices shared between levels are duplicated
+    for (const auto& lod : data.lods) {
+        const std::size_t lod_first_range = ranges.size();
+        for (GLuint r = lod.first_range; r < lod.first_range + lod.num_ranges; ++r) {
+            const DrawRange& range = data.ranges[r];
+            for (std::size_t t = range.first_index; t < range.first_index + range.num_indices; t += 3) {
+                GLuint triangle[3];
+                for (std::size_t k = 0; k < 3; ++k) {
+                    triangle[k] = static_cast<GLuint>(data.indices[t + k] + range.base_vertex);
+                }
+                // Count the vertices the triangle would add to the current range
+                std::size_t added = 0;
+                for (std::size_t k = 0; k < 3; ++k) {
+                    const bool repeated = (k > 0 && triangle[k] == triangle[0]) ||
+                                          (k > 1 && triangle[k] == triangle[1]);
+                    added += !repeated && owner[triangle[k]] != ranges.size();
+                }
+                if (vertices.size() - range_first_vertex + added > max_vertices) {
+                    closeRange();
+                }
+                for (const GLuint v : triangle) {
+                    if (owner[v] != ranges.size()) {
+                        owner[v] = ranges.size();
+                        local[v] = static_cast<GLuint>(vertices.size() - range_first_vertex);
+                        vertices.push_back(data.vertices[v]);
+                    }
+                    indices.push_back(local[v]);
+                }
+            }
+        }
+        closeRange();
+        lods.push_back({static_cast<GLuint>(lod_first_range), static_cast<GLuint>(ranges.size() - lod_first_range),
+                        lod.error});
+    }
+
+    data.vertices.swap(vertices);
+    data.indices.swap(indices);
+    data.ranges.swap(ranges);
+    data.lods.swap(lods);
+    return data.ranges.size();
+}
+
+MeshOptimizationStatistics optimizeMesh(MeshData& data) {
+    MeshOptimizationStatistics statistics{};
+    statistics.before = analyzeVertexCache(data.indices, data.vertices.size());
+
+    // Only triangle lists are supported
+    if (data.indices.size() % 3 == 0) {
+        const auto hard_boundaries = optimizeVertexCache(data.indices, data.vertices.size());
+        optimizeOverdraw(data.indices, data.vertices, hard_boundaries);
+        optimizeVertexFetch(data.vertices, data.indices);
+    }
+
+    statistics.after = analyzeVertexCache(data.indices, data.vertices.size());
+    return statistics;
+}
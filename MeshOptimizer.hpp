@@ -0,0 +1,65 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MESHOPTIMIZER_HPP
+#define OPENGLPLAYGROUND_MESHOPTIMIZER_HPP
+
+#include "Mesh.hpp"
+
+// Size of the simulated FIFO post transform cache
+constexpr std::size_t VERTEX_CACHE_SIZE = 16;
+
+// Post transform cache statistics of an index buffer
+struct VertexCacheStatistics {
+    // Average cache miss ratio, vertex shader invocations per triangle (0.5 is the ideal, 3 the worst)
+    float acmr;
+    // Average transform to vertex ratio, vertex shader invocations per referenced vertex (1 is the ideal)
+    float atvr;
+};
+
+// Statistics of a whole optimisation pass
+struct MeshOptimizationStatistics {
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+};
+
+// Statistics of a vertex welding pass
+struct VertexWeldStatistics {
+    std::size_t vertices_before;
+    std::size_t vertices_after;
+    // Triangles removed because welding collapsed them
+    std::size_t degenerate_triangles;
+};
+
+// Simulate a FIFO post transform cache over the index buffer
+VertexCacheStatistics analyzeVertexCache(const std::vector<GLuint>& indices, std::size_t num_vertices,
+                                         std::size_t cache_size = VERTEX_CACHE_SIZE);
+
+// Reorder triangles for post transform cache locality (Tipsify), returns the offsets of the triangles where the
+// traversal jumped to a new part of the mesh, those are the hard cluster boundaries for the overdraw pass
+std::vector<std::size_t> optimizeVertexCache(std::vector<GLuint>& indices, std::size_t num_vertices,
+                                             std::size_t cache_size = VERTEX_CACHE_SIZE);
+
+// Reorder the clusters produced by optimizeVertexCache so that outward facing clusters are drawn first. Clusters
+// are split further where this does not raise the ACMR above threshold times the mesh one
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+                      const std::vector<std::size_t>& hard_boundaries, float threshold = 1.05f,
+                      std::size_t cache_size = VERTEX_CACHE_SIZE);
+
+// Reorder vertices in the order they are first referenced by the index buffer, unreferenced vertices are removed
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+// Collapse vertices whose position and normal fall in the same cell of a grid with the given spacing and remap the
+// indices, an epsilon of 0 only merges bitwise identical vertices. Vertices closer than epsilon but across a cell
+// border are kept apart. Hashing, partitioning and remapping run in parallel on the global thread pool
+VertexWeldStatistics weldVertices(MeshData& data, float epsilon);
+
+// Split the mesh in draw ranges addressing at most max_vertices vertices each, so every range can be drawn with 16 bit
+// indices and a base vertex. Vertices shared by two ranges are duplicated, returns the number of ranges
+std::size_t splitIndexRanges(MeshData& data, std::size_t max_vertices = 65536);
+
+// Run the full pipeline: vertex cache, overdraw and vertex fetch
+MeshOptimizationStatistics optimizeMesh(MeshData& data);
+
+#endif //OPENGLPLAYGROUND_MESHOPTIMIZER_HPP
@@ -0,0 +1,325 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+
+// Weight of the planes added along the open boundaries, keeps the silhouette of open meshes in place
+constexpr double boundary_weight = 10.0;
+
+// Minimum cosine between a triangle normal before and after a collapse
+constexpr float min_flip_cosine = 0.2f;
+
+// Symmetric 4x4 quadric, sum of squared distances to a set of planes
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    void addPlane(const glm::vec3& n, double d, double w) {
+        a2 += w * n.x * n.x;
+        ab += w * n.x * n.y;
+        ac += w * n.x * n.z;
+        ad += w * n.x * d;
+        b2 += w * n.y * n.y;
+        bc += w * n.y * n.z;
+        bd += w * n.y * d;
+        c2 += w * n.z * n.z;
+        cd += w * n.z * d;
+        d2 += w * d * d;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a2 += q.a2;
+        ab += q.ab;
+        ac += q.ac;
+        ad += q.ad;
+        b2 += q.b2;
+        bc += q.bc;
+        bd += q.bd;
+        c2 += q.c2;
+        cd += q.cd;
+        d2 += q.d2;
+        return *this;
+    }
+
+    double evaluate(const glm::vec3& p) const {
+        const double x = p.x, y = p.y, z = p.z;
+        return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+               c2 * z * z + 2 * cd * z + d2;
+    }
+};
+
+// Candidate collapse in the queue, valid only while the versions of both vertices are unchanged
+struct Collapse {
+    float cost;
+    GLuint from;
+    GLuint to;
+    std::uint32_t from_version;
+    std::uint32_t to_version;
+
+    bool operator>(const Collapse& other) const {
+        return cost > other.cost;
+    }
+};
+
+class Simplifier {
+private:
+    const std::vector<Vertex>& m_vertices;
+    // Working index buffer, collapses update it in place
+    std::vector<GLuint> m_indices;
+    std::vector<bool> m_dead_triangles;
+    std::size_t m_live_triangles;
+    // Triangles around each vertex, may contain dead triangles
+    std::vector<std::vector<GLuint>> m_vertex_triangles;
+    std::vector<Quadric> m_quadrics;
+    std::vector<bool> m_alive;
+    std::vector<std::uint32_t> m_versions;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> m_queue;
+
+    float collapseCost(GLuint from, GLuint to) const {
+        Quadric q = m_quadrics[from];
+        q += m_quadrics[to];
+        const glm::vec3& p_from = m_vertices[from].position;
+        const glm::vec3& p_to = m_vertices[to].position;
+        // The normal of the removed vertex is lost, penalise collapses between vertices with different normals
+        const glm::vec3 edge = p_to - p_from;
+        const double normal_penalty =
+                (1.0 - glm::dot(m_vertices[from].normal, m_vertices[to].normal)) * glm::dot(edge, edge);
+        return static_cast<float>(std::max(0.0, q.evaluate(p_to)) + normal_penalty);
+    }
+
+    void pushCollapse(GLuint from, GLuint to) {
+        m_queue.push({collapseCost(from, to), from, to, m_versions[from], m_versions[to]});
+    }
+
+    // Check that moving from onto to does not flip or degenerate any of the triangles that survive
+    bool isCollapseValid(GLuint from, GLuint to) const {
+        for (const GLuint t : m_vertex_triangles[from]) {
+            if (m_dead_triangles[t]) {
+                continue;
+            }
+            const GLuint *tri = &m_indices[3 * t];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                continue;
+            }
+            glm::vec3 p[3];
+            glm::vec3 q[3];
+            for (std::size_t k = 0; k < 3; ++k) {
+                p[k] = m_vertices[tri[k]].position;
+                q[k] = tri[k] == from ? m_vertices[to].position : p[k];
+            }
+            const glm::vec3 n_before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            const glm::vec3 n_after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            const float len_before = glm::length(n_before);
+            const float len_after = glm::length(n_after);
+            if (len_after <= 0.f || glm::dot(n_before, n_after) < min_flip_cosine * len_before * len_after) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void collapse(GLuint from, GLuint to) {
+        for (const GLuint t : m_vertex_triangles[from]) {
+            if (m_dead_triangles[t]) {
+                continue;
+            }
+            GLuint *tri = &m_indices[3 * t];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                m_dead_triangles[t] = true;
+                --m_live_triangles;
+                continue;
+            }
+            for (std::size_t k = 0; k < 3; ++k) {
+                if (tri[k] == from) {
+                    tri[k] = to;
+                }
+            }
+            m_vertex_triangles[to].push_back(t);
+        }
+        m_vertex_triangles[from].clear();
+        m_vertex_triangles[from].shrink_to_fit();
+        m_quadrics[to] += m_quadrics[from];
+        m_alive[from] = false;
+        ++m_versions[to];
+
+        // Drop dead triangles around the target and queue the new edges
+        auto& triangles = m_vertex_triangles[to];
+        triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+                                       [this](GLuint t) { return m_dead_triangles[t]; }), triangles.end());
+        for (const GLuint t : triangles) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                const GLuint w = m_indices[3 * t + k];
+                if (w != to) {
+                    pushCollapse(to, w);
+                    pushCollapse(w, to);
+                }
+            }
+        }
+    }
+
+    std::vector<GLuint> liveIndices() const {
+        std::vector<GLuint> output;
+        output.reserve(3 * m_live_triangles);
+        for (std::size_t t = 0; t < m_dead_triangles.size(); ++t) {
+            if (!m_dead_triangles[t]) {
+                output.insert(output.end(), m_indices.begin() + 3 * t, m_indices.begin() + 3 * t + 3);
+            }
+        }
+        return output;
+    }
+
+public:
+    Simplifier(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+            : m_vertices(vertices), m_indices(indices), m_dead_triangles(indices.size() / 3, false),
+              m_live_triangles(indices.size() / 3), m_vertex_triangles(vertices.size()), m_quadrics(vertices.size()),
+              m_alive(vertices.size(), true), m_versions(vertices.size(), 0) {
+        // Count how many triangles use each edge to find the boundaries
+        std::unordered_map<std::uint64_t, std::uint32_t> edge_count;
+        edge_count.reserve(m_indices.size());
+        const auto edgeKey = [](GLuint a, GLuint b) {
+            return (static_cast<std::uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+        };
+        const std::size_t num_triangles = m_dead_triangles.size();
+        std::vector<glm::vec3> normals(num_triangles);
+        for (std::size_t t = 0; t < num_triangles; ++t) {
+            // Zero area triangles are dead from the start, they are in no adjacency list and collapses never update
+            // them, so they must not reach the levels or the triangle counts
+            const GLuint *tri = &m_indices[3 * t];
+            const glm::vec3& p0 = m_vertices[tri[0]].position;
+            const glm::vec3 cross = glm::cross(m_vertices[tri[1]].position - p0, m_vertices[tri[2]].position - p0);
+            const float length = glm::length(cross);
+            if (length <= 0.f) {
+                m_dead_triangles[t] = true;
+                --m_live_triangles;
+                continue;
+            }
+            normals[t] = cross / length;
+            for (std::size_t k = 0; k < 3; ++k) {
+                ++edge_count[edgeKey(tri[k], tri[(k + 1) % 3])];
+            }
+        }
+
+        for (std::size_t t = 0; t < num_triangles; ++t) {
+            if (m_dead_triangles[t]) {
+                continue;
+            }
+            const GLuint *tri = &m_indices[3 * t];
+            const glm::vec3& p0 = m_vertices[tri[0]].position;
+            const glm::vec3& n = normals[t];
+            // Plane of the face
+            Quadric face;
+            face.addPlane(n, -glm::dot(n, p0), 1.0);
+            for (std::size_t k = 0; k < 3; ++k) {
+                m_quadrics[tri[k]] += face;
+                m_vertex_triangles[tri[k]].push_back(static_cast<GLuint>(t));
+            }
+            // Planes perpendicular to the face along the boundary edges
+            for (std::size_t k = 0; k < 3; ++k) {
+                const GLuint a = tri[k];
+                const GLuint b = tri[(k + 1) % 3];
+                if (edge_count[edgeKey(a, b)] != 1) {
+                    continue;
+                }
+                const glm::vec3 edge = m_vertices[b].position - m_vertices[a].position;
+                const float edge_length = glm::length(edge);
+                if (edge_length <= 0.f) {
+                    continue;
+                }
+                const glm::vec3 boundary_normal = glm::normalize(glm::cross(edge, n));
+                Quadric boundary;
+                boundary.addPlane(boundary_normal, -glm::dot(boundary_normal, m_vertices[a].position),
+                                  boundary_weight);
+                m_quadrics[a] += boundary;
+                m_quadrics[b] += boundary;
+            }
+        }
+
+        for (std::size_t t = 0; t < num_triangles; ++t) {
+            if (m_dead_triangles[t]) {
+                continue;
+            }
+            for (std::size_t k = 0; k < 3; ++k) {
+                const GLuint a = m_indices[3 * t + k];
+                const GLuint b = m_indices[3 * t + (k + 1) % 3];
+                if (a != b) {
+                    pushCollapse(a, b);
+                    pushCollapse(b, a);
+                }
+            }
+        }
+    }
+
+    std::vector<SimplifiedLevel> run(std::size_t num_levels, float ratio) {
+        std::vector<SimplifiedLevel> levels;
+        double max_cost = 0.0;
+        std::size_t target = static_cast<std::size_t>(m_live_triangles * ratio);
+
+        while (levels.size() < num_levels && !m_queue.empty()) {
+            const Collapse c = m_queue.top();
+            m_queue.pop();
+            if (!m_alive[c.from] || !m_alive[c.to] || m_versions[c.from] != c.from_version ||
+                m_versions[c.to] != c.to_version || !isCollapseValid(c.from, c.to)) {
+                continue;
+            }
+            collapse(c.from, c.to);
+            max_cost = std::max(max_cost, static_cast<double>(c.cost));
+
+            if (m_live_triangles <= target) {
+                levels.push_back({liveIndices(), static_cast<float>(std::sqrt(max_cost))});
+                target = static_cast<std::size_t>(m_live_triangles * ratio);
+            }
+        }
+        // Output what has been reached if the queue ran out before the last target
+        if (levels.size() < num_levels && !levels.empty() && m_live_triangles * 3 < levels.back().indices.size()) {
+            levels.push_back({liveIndices(), static_cast<float>(std::sqrt(max_cost))});
+        }
+        return levels;
+    }
+};
+
+} // namespace
+
+std::vector<SimplifiedLevel> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+                                          std::size_t num_levels, float ratio) {
+    if (num_levels == 0 || indices.size() % 3 != 0 || indices.empty()) {
+        return {};
+    }
+    Simplifier simplifier(vertices, indices);
+    return simplifier.run(num_levels, ratio);
+}
+
+std::size_t generateLods(MeshData& data, std::size_t num_levels, float ratio) {
+    // Levels are built from a single range addressing the vertices directly, i.e. before splitIndexRanges
+    if (data.ranges.size() > 1 || (data.ranges.size() == 1 && data.ranges.front().base_vertex != 0)) {
+        std::cerr << "LOD generation must run before the mesh is split in ranges\n";
+        return std::max<std::size_t>(1, data.lods.size());
+    }
+    if (data.ranges.size() == 1) {
+        const DrawRange& range = data.ranges.front();
+        data.indices = std::vector<GLuint>(data.indices.begin() + range.first_index,
+                                           data.indices.begin() + range.first_index + range.num_indices);
+    }
+    auto levels = simplifyMesh(data.vertices, data.indices, num_levels, ratio);
+
+    // The index buffer holds all the levels one after the other, one range each
+    data.ranges.assign(1, {0, static_cast<GLuint>(data.indices.size()), 0});
+    data.lods.assign(1, {0, 1, 0.f});
+    for (auto& level : levels) {
+        // Each level gets its own post transform cache order
+        optimizeVertexCache(level.indices, data.vertices.size());
+        data.lods.push_back({static_cast<GLuint>(data.ranges.size()), 1, level.error});
+        data.ranges.push_back({static_cast<GLuint>(data.indices.size()), static_cast<GLuint>(level.indices.size()), 0});
+        data.indices.insert(data.indices.end(), level.indices.begin(), level.indices.end());
+    }
+    return data.lods.size();
+}
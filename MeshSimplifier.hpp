@@ -0,0 +1,28 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MESHSIMPLIFIER_HPP
+#define OPENGLPLAYGROUND_MESHSIMPLIFIER_HPP
+
+#include "Mesh.hpp"
+
+// Index buffer of a simplified level and its error
+struct SimplifiedLevel {
+    std::vector<GLuint> indices;
+    // Object space error estimate of the level
+    float error;
+};
+
+// Simplify the triangle list with quadric error metric half edge collapses. A vertex is always collapsed onto one of
+// its neighbours, so the levels reference the input vertices and keep their attributes. A level is produced every time
+// the triangle count drops below the previous one times ratio, until num_levels levels are built or no collapse is
+// possible anymore. Errors are non decreasing along the chain
+std::vector<SimplifiedLevel> simplifyMesh(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices,
+                                          std::size_t num_levels, float ratio);
+
+// Append num_levels simplified levels to the mesh, the index buffer holds all the levels one after the other and each
+// level gets its own draw range. Returns the number of levels of the mesh
+std::size_t generateLods(MeshData& data, std::size_t num_levels, float ratio);
+
+#endif //OPENGLPLAYGROUND_MESHSIMPLIFIER_HPP
@@ -0,0 +1,193 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "Meshlets.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+// Meshlets per task when culling on the thread pool
+constexpr std::size_t MESHLET_TASK_SIZE = 4096;
+
+// Marks the vertices not used by any meshlet yet
+constexpr std::uint32_t NO_MESHLET = std::numeric_limits<std::uint32_t>::max();
+
+// Meshlet over the indices [first_index, end_index) with the given vertex positions and the unit normals of its
+// non degenerate triangles. A meshlet of degenerate triangles only is never back face culled
+Meshlet makeMeshlet(std::size_t first_index, std::size_t end_index, GLint base_vertex,
+                    const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals) {
+    Meshlet meshlet{};
+    meshlet.first_index = static_cast<GLuint>(first_index);
+    meshlet.num_indices = static_cast<GLuint>(end_index - first_index);
+    meshlet.base_vertex = base_vertex;
+
+    AABB box;
+    for (const auto& position : positions) {
+        box.extend(position);
+    }
+    meshlet.sphere = BoundingSphere::fromPoints(box, positions.data(), positions.size());
+
+    // Cone around the average normal, wide enough for the normal farthest from it
+    glm::vec3 sum(0.f);
+    for (const auto& normal : normals) {
+        sum += normal;
+    }
+    const float length = glm::length(sum);
+    meshlet.cone_axis = glm::vec3(0.f);
+    meshlet.cone_sin = 2.f;
+    if (length > 1e-6f) {
+        meshlet.cone_axis = sum / length;
+        float min_cos = 1.f;
+        for (const auto& normal : normals) {
+            min_cos = std::min(min_cos, glm::dot(normal, meshlet.cone_axis));
+        }
+        // Normals on both sides of the plane orthogonal to the axis can never all face away
+        if (min_cos > 0.f) {
+            meshlet.cone_sin = std::sqrt(std::max(0.f, 1.f - min_cos * min_cos));
+        }
+    }
+    return meshlet;
+}
+
+// Check if a meshlet is in the frustum and has a triangle that may face the camera
+inline bool isMeshletVisible(const Meshlet& meshlet, const Frustum& frustum, const glm::vec3& camera) {
+    if (!frustum.intersects(meshlet.sphere)) {
+        return false;
+    }
+    if (meshlet.cone_sin > 1.f) {
+        return true;
+    }
+    // The directions from the camera to the sphere are within phi + psi of the axis, with phi the angle to the center
+    // and sin(psi) = radius / distance. Every triangle faces away when phi + psi plus the half angle of the cone stays
+    // below 90 degrees, i.e. cos(phi + psi) > sin(half angle) while phi is below 90 degrees
+    const glm::vec3 d = meshlet.sphere.center - camera;
+    const float distance2 = glm::dot(d, d);
+    const float radius = meshlet.sphere.radius;
+    if (distance2 <= radius * radius) {
+        return true;
+    }
+    const float distance = std::sqrt(distance2);
+    const float cos_phi = glm::dot(d, meshlet.cone_axis) / distance;
+    if (cos_phi <= 0.f) {
+        return true;
+    }
+    const float sin_phi = std::sqrt(std::max(0.f, 1.f - cos_phi * cos_phi));
+    const float sin_psi = radius / distance;
+    const float cos_psi = std::sqrt(std::max(0.f, 1.f - sin_psi * sin_psi));
+    return cos_phi * cos_psi - sin_phi * sin_psi <= meshlet.cone_sin;
+}
+
+} // namespace
+
+MeshletSet MeshletSet::build(const MeshDataView& data, std::size_t max_vertices, std::size_t max_triangles) {
+    MeshletSet set;
+    max_vertices = std::max<std::size_t>(max_vertices, 3);
+    max_triangles = std::max<std::size_t>(max_triangles, 1);
+
+    // Same single range as Mesh::prepare when the mesh has none
+    const DrawRange whole{0, static_cast<GLuint>(data.num_indices), 0};
+    const DrawRange *ranges = data.num_ranges > 0 ? data.ranges : &whole;
+    const std::size_t num_ranges = data.num_ranges > 0 ? data.num_ranges : 1;
+
+    // Last meshlet using each vertex, tells in constant time which vertices of a triangle the current meshlet lacks
+    std::vector<std::uint32_t> last_meshlet(data.num_vertices, NO_MESHLET);
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    // Triangles of the current meshlet, degenerate ones included
+    std::size_t num_triangles = 0;
+    positions.reserve(max_vertices);
+    normals.reserve(max_triangles);
+
+    set.m_range_first_meshlet.reserve(num_ranges + 1);
+    set.m_range_first_meshlet.push_back(0);
+    for (std::size_t r = 0; r < num_ranges; ++r) {
+        const DrawRange& range = ranges[r];
+        const std::size_t end = range.first_index + range.num_indices / 3 * 3;
+        std::size_t first = range.first_index;
+        positions.clear();
+        normals.clear();
+        num_triangles = 0;
+
+        for (std::size_t i = first; i < end; i += 3) {
+            const std::size_t v[3] = {data.indices[i] + static_cast<std::size_t>(range.base_vertex),
+                                      data.indices[i + 1] + static_cast<std::size_t>(range.base_vertex),
+                                      data.indices[i + 2] + static_cast<std::size_t>(range.base_vertex)};
+            auto current = static_cast<std::uint32_t>(set.m_meshlets.size());
+            std::size_t new_vertices = 0;
+            for (std::size_t k = 0; k < 3; ++k) {
+                const bool repeated = (k > 0 && v[k] == v[0]) || (k > 1 && v[k] == v[1]);
+                new_vertices += last_meshlet[v[k]] != current && !repeated;
+            }
+
+            // Close the meshlet when the triangle does not fit
+            if (num_triangles > 0 &&
+                (positions.size() + new_vertices > max_vertices || num_triangles == max_triangles)) {
+                set.m_meshlets.push_back(makeMeshlet(first, i, range.base_vertex, positions, normals));
+                first = i;
+                positions.clear();
+                normals.clear();
+                num_triangles = 0;
+                ++current;
+            }
+
+            for (const std::size_t vertex : v) {
+                if (last_meshlet[vertex] != current) {
+                    last_meshlet[vertex] = current;
+                    positions.push_back(data.vertices[vertex].position);
+                }
+            }
+            ++num_triangles;
+            // Degenerate triangles are never drawn, they do not widen the cone
+            const glm::vec3 normal = glm::cross(data.vertices[v[1]].position - data.vertices[v[0]].position,
+                                                data.vertices[v[2]].position - data.vertices[v[0]].position);
+            const float length = glm::length(normal);
+            if (length > 0.f) {
+                normals.push_back(normal / length);
+            }
+        }
+        if (num_triangles > 0) {
+            set.m_meshlets.push_back(makeMeshlet(first, end, range.base_vertex, positions, normals));
+        }
+        set.m_range_first_meshlet.push_back(static_cast<GLuint>(set.m_meshlets.size()));
+    }
+    return set;
+}
+
+std::size_t MeshletSet::cull(GLuint first_range, GLuint num_ranges, const Frustum& frustum, const glm::vec3& camera,
+                             std::vector<DrawRange>& ranges) const {
+    const std::size_t first = m_range_first_meshlet[first_range];
+    const std::size_t last = m_range_first_meshlet[first_range + num_ranges];
+    m_visible.resize(m_meshlets.size());
+
+    // Tests are independent, large sets are split across the thread pool
+    const std::size_t num_tasks = (last - first + MESHLET_TASK_SIZE - 1) / MESHLET_TASK_SIZE;
+    ThreadPool::getGlobal().parallelFor(num_tasks, [&](std::size_t task) {
+        const std::size_t end = std::min(last, first + (task + 1) * MESHLET_TASK_SIZE);
+        for (std::size_t i = first + task * MESHLET_TASK_SIZE; i < end; ++i) {
+            m_visible[i] = isMeshletVisible(m_meshlets[i], frustum, camera);
+        }
+    });
+
+    // Kept meshlets that follow each other in the index buffer are drawn as one range
+    std::size_t num_kept = 0;
+    for (std::size_t i = first; i < last; ++i) {
+        if (!m_visible[i]) {
+            continue;
+        }
+        const Meshlet& meshlet = m_meshlets[i];
+        if (!ranges.empty() && ranges.back().base_vertex == meshlet.base_vertex &&
+            ranges.back().first_index + ranges.back().num_indices == meshlet.first_index) {
+            ranges.back().num_indices += meshlet.num_indices;
+        } else {
+            ranges.push_back({meshlet.first_index, meshlet.num_indices, meshlet.base_vertex});
+        }
+        ++num_kept;
+    }
+    return num_kept;
+}
@@ -0,0 +1,77 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MESHLETS_HPP
+#define OPENGLPLAYGROUND_MESHLETS_HPP
+
+#include "Mesh.hpp"
+#include "Frustum.hpp"
+
+// Default limits of a meshlet
+constexpr std::size_t MESHLET_MAX_VERTICES = 64;
+constexpr std::size_t MESHLET_MAX_TRIANGLES = 124;
+
+// Cluster of consecutive triangles of a draw range, culled as a whole
+struct Meshlet {
+    // First index and number of indices, relative to the index data of the mesh like the draw ranges
+    GLuint first_index;
+    GLuint num_indices;
+    // Base vertex of the range the meshlet belongs to
+    GLint base_vertex;
+    // Bounding sphere in the space of the mesh
+    BoundingSphere sphere;
+    // Axis of the cone containing the normals of the triangles
+    glm::vec3 cone_axis;
+    // Sine of the half angle of the cone. Above 1 when the normals do not fit in a half space, the meshlet is then
+    // never back facing
+    float cone_sin;
+};
+
+// Meshlets of a mesh grouped by draw range. They are built by scanning the triangles in index buffer order, so the
+// index buffer is left untouched and a meshlet is a sub-range of a draw range; a buffer optimised for the vertex
+// cache gives compact clusters
+class MeshletSet {
+private:
+    // Meshlets, in the order of the ranges
+    std::vector<Meshlet> m_meshlets;
+    // First meshlet of each draw range, one more entry for the end of the last range
+    std::vector<GLuint> m_range_first_meshlet;
+    // Result of the last cull, one flag per meshlet
+    mutable std::vector<unsigned char> m_visible;
+
+public:
+    // Split the draw ranges of a mesh in meshlets of at most max_vertices distinct vertices and max_triangles triangles
+    static MeshletSet build(const MeshDataView& data, std::size_t max_vertices = MESHLET_MAX_VERTICES,
+                            std::size_t max_triangles = MESHLET_MAX_TRIANGLES);
+
+    // Check if there is no meshlet
+    inline bool empty() const noexcept {
+        return m_meshlets.empty();
+    }
+
+    // Get number of meshlets
+    inline std::size_t size() const noexcept {
+        return m_meshlets.size();
+    }
+
+    // Get a meshlet
+    inline const Meshlet& getMeshlet(std::size_t i) const {
+        return m_meshlets[i];
+    }
+
+    // Get host memory held by the meshlets, in bytes
+    inline std::size_t getHostBytes() const noexcept {
+        return m_meshlets.capacity() * sizeof(Meshlet) + m_range_first_meshlet.capacity() * sizeof(GLuint) +
+               m_visible.capacity();
+    }
+
+    // Cull the meshlets of the draw ranges [first_range, first_range + num_ranges) outside the frustum or facing away
+    // from the camera, both given in the space of the mesh. The index ranges of the others are appended to ranges,
+    // consecutive meshlets merged into one range. Returns the number of meshlets kept. Large sets are split across
+    // the thread pool, a set must not be culled from two threads at once
+    std::size_t cull(GLuint first_range, GLuint num_ranges, const Frustum& frustum, const glm::vec3& camera,
+                     std::vector<DrawRange>& ranges) const;
+};
+
+#endif //OPENGLPLAYGROUND_MESHLETS_HPP
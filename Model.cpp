@@ -3,85 +3,746 @@
 //
 
 #include "Model.hpp"
+#include "ThreadPool.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "PlyReader.hpp"
 
 // Assimp includes
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
 // STL includes
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <sstream>
+#include <cstring>
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
-    // Process all meshes at current node, if any
+namespace {
+
+// Post processing applied by assimp on import, part of the cache key
+constexpr unsigned int import_flags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace;
+// Flags of the cached data of PLY sources, the native reader normals differ slightly from the assimp ones. Kept when
+// the native reader fails and assimp imports the file, it would fail again for the same source so the next run must
+// find that data under the key it probes
+constexpr unsigned int ply_import_flags = 1u << 31;
+// Level of the meshes without culled meshlet ranges, never selected
+constexpr std::size_t no_meshlet_lod = std::numeric_limits<std::size_t>::max();
+
+// Hash of the options that change the processed data, part of the cache key
+std::uint64_t hashImportOptions(const ModelImportOptions& options) {
+    std::uint64_t hash = 14695981039346656037ull;
+    const auto combine = [&hash](std::uint64_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+    };
+    combine(options.weld_vertices);
+    if (options.weld_vertices) {
+        std::uint32_t epsilon_bits;
+        std::memcpy(&epsilon_bits, &options.weld_epsilon, sizeof(epsilon_bits));
+        combine(epsilon_bits);
+    }
+    combine(options.optimize_meshes);
+    combine(options.lod_levels);
+    if (options.lod_levels > 0) {
+        std::uint32_t ratio_bits;
+        std::memcpy(&ratio_bits, &options.lod_ratio, sizeof(ratio_bits));
+        combine(ratio_bits);
+    }
+    combine(options.split_index_ranges);
+    return hash;
+}
+
+} // namespace
+
+void Model::processNode(aiNode *node, const aiScene *scene, std::int32_t parent, std::vector<const aiMesh *>& meshes,
+                        SceneGraph& graph, std::vector<std::uint32_t>& mesh_nodes) {
+    // Assimp matrices are row major
+    const aiMatrix4x4& t = node->mTransformation;
+    const glm::mat4 local(t.a1, t.b1, t.c1, t.d1, t.a2, t.b2, t.c2, t.d2, t.a3, t.b3, t.c3, t.d3, t.a4, t.b4, t.c4, t.d4);
+    const std::uint32_t index = graph.addNode(node->mName.C_Str(), parent, local);
+
+    // Collect all meshes at current node, if any
     for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
-        // Get pointer to mesh
-        auto mesh = scene->mMeshes[node->mMeshes[i]];
-        // Process mesh
-        m_meshes.push_back(processMesh(mesh, scene));
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+        mesh_nodes.push_back(index);
     }
     // After processing the meshes, keep looking for other nodes
     for (unsigned int i = 0; i < node->mNumChildren; ++i) {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, static_cast<std::int32_t>(index), meshes, graph, mesh_nodes);
     }
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *) {
-    // Vector to fill with data
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
+MeshData Model::processMesh(const aiMesh *mesh) {
+    // Mesh data to fill
+    MeshData data;
+    data.vertices.resize(mesh->mNumVertices);
 
     // Loop over all the vertices and store them
     for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
-        Vertex vertex;
+        Vertex& vertex = data.vertices[i];
         // Store position
         vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
         // Store normal
         vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
-        // Add vertex
-        vertices.push_back(vertex);
     }
 
-    // Loop over all faces and store the indices
+    // Loop over all faces and store the indices, faces are triangles after aiProcess_Triangulate but points and lines
+    // can still be present so the count is only a reservation
+    data.indices.reserve(static_cast<std::size_t>(mesh->mNumFaces) * 3);
     for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
         // Get reference to face
         const aiFace& face = mesh->mFaces[i];
         // Add indices
-        for (unsigned int j = 0; j < face.mNumIndices; ++j) {
-            indices.push_back(face.mIndices[j]);
+        data.indices.insert(data.indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
+    }
+
+    return data;
+}
+
+void Model::postProcessMesh(MeshData& data, const ModelImportOptions& options, std::ostream& log) {
+    if (options.weld_vertices) {
+        const auto statistics = weldVertices(data, options.weld_epsilon);
+        const std::size_t removed = statistics.vertices_before - statistics.vertices_after;
+        log << "\tWelded " << statistics.vertices_before << " -> " << statistics.vertices_after << " vertices, saved "
+            << removed * sizeof(Vertex) + statistics.degenerate_triangles * 3 * sizeof(GLuint) << " bytes ("
+            << statistics.degenerate_triangles << " degenerate triangles removed)\n";
+    }
+    if (options.optimize_meshes) {
+        const auto statistics = optimizeMesh(data);
+        log << "\tACMR " << statistics.before.acmr << " -> " << statistics.after.acmr
+            << ", ATVR " << statistics.before.atvr << " -> " << statistics.after.atvr << "\n";
+    }
+    if (options.lod_levels > 0) {
+        const std::size_t num_lods = generateLods(data, options.lod_levels, options.lod_ratio);
+        log << "\tGenerated " << num_lods - 1 << " levels of detail:";
+        for (const auto& lod : data.lods) {
+            log << " " << data.ranges[lod.first_range].num_indices / 3 << " (" << lod.error << ")";
+        }
+        log << "\n";
+    }
+    if (options.split_index_ranges) {
+        const std::size_t num_vertices = data.vertices.size();
+        const std::size_t num_ranges = splitIndexRanges(data);
+        if (num_ranges > 1) {
+            log << "\tSplit in " << num_ranges << " ranges with 16 bit indices, " << data.vertices.size() - num_vertices
+                << " vertices duplicated\n";
+        }
+    }
+}
+
+void ModelData::updateHostMemory() {
+    std::size_t bytes = views.capacity() * sizeof(MeshDataView) + cache.getMappedSize() + scene.getHostBytes();
+    for (const auto& mesh : meshes) {
+        bytes += mesh.getHostBytes();
+    }
+    host_memory.set(bytes);
+}
+
+void ModelData::destroy() {
+    views.clear();
+    meshes.clear();
+    meshes.shrink_to_fit();
+    occluders.clear();
+    meshlets.clear();
+    cache.destroy();
+    host_memory.release();
+}
+
+void Model::setupBounds(ModelData& data) {
+    // Box and sphere of each mesh, the sphere is centered on the box
+    data.meshes_bounds.assign(data.views.size(), AABB());
+    data.meshes_spheres.assign(data.views.size(), BoundingSphere());
+    ThreadPool::getGlobal().parallelFor(data.views.size(), [&data](std::size_t m) {
+        const MeshDataView& view = data.views[m];
+        for (std::size_t v = 0; v < view.num_vertices; ++v) {
+            data.meshes_bounds[m].extend(view.vertices[v].position);
+        }
+        if (view.num_vertices > 0) {
+            data.meshes_spheres[m] = BoundingSphere::fromPoints(data.meshes_bounds[m], &view.vertices[0].position,
+                                                                view.num_vertices, sizeof(Vertex));
+        }
+    });
+    // Model bounds in the import pose, positions are quantized in the space of their node so it uses the local boxes
+    data.bounds = AABB();
+    AABB local_bounds;
+    for (std::size_t m = 0; m < data.meshes_bounds.size(); ++m) {
+        if (data.meshes_bounds[m].isValid()) {
+            data.bounds.extend(data.meshes_bounds[m].transform(data.scene.getWorldTransform(data.mesh_nodes[m])));
+            local_bounds.extend(data.meshes_bounds[m]);
+        }
+    }
+    // Identity quantization for float vertices, the dequantization matrix must not change the model matrix
+    data.quantization = PositionQuantization();
+    if (data.layout->format != VertexFormat::Float) {
+        data.quantization = PositionQuantization(local_bounds);
+    }
+}
+
+void Model::setupCulling(ModelData& data, const ModelImportOptions& options) {
+    // Occluders are copied while the host data is still there
+    data.occluders.assign(data.views.size(), OccluderMesh());
+    if (options.occluder_triangles > 0) {
+        ThreadPool::getGlobal().parallelFor(data.views.size(), [&](std::size_t m) {
+            data.occluders[m] = OccluderMesh::fromView(data.views[m], options.occluder_triangles);
+        });
+    }
+
+    // Meshlets only depend on the host data too
+    data.meshlets.assign(data.views.size(), MeshletSet());
+    if (options.build_meshlets) {
+        ThreadPool::getGlobal().parallelFor(data.views.size(), [&](std::size_t m) {
+            data.meshlets[m] = MeshletSet::build(data.views[m]);
+        });
+    }
+}
+
+bool Model::importModel(const std::string& file_name, const ModelImportOptions& options, ModelData& data) {
+    data.layout = &VertexLayout::get(options.vertex_format);
+
+    // Build cache key, if the source can not be accessed the cache is skipped and assimp reports the error
+    const bool native_ply = isPlyFile(file_name);
+    MeshCacheKey cache_key{file_name, 0, native_ply ? ply_import_flags : import_flags, hashImportOptions(options)};
+    const bool use_cache = getFileModificationTime(file_name, cache_key.source_mtime);
+    if (use_cache && data.cache.open(cache_key)) {
+        // Views point directly into the mapping
+        data.views = data.cache.getMeshes();
+        data.scene = data.cache.getSceneGraph();
+        data.mesh_nodes = data.cache.getMeshNodes();
+        std::cout << "Loaded " << data.views.size() << " mesh/es from cache " << MeshCache::getCacheFileName(cache_key)
+                  << "\n";
+        setupBounds(data);
+        setupCulling(data, options);
+        data.updateHostMemory();
+        return true;
+    }
+
+    data.meshes.clear();
+    data.scene.clear();
+    data.mesh_nodes.clear();
+
+    // PLY scans are read directly into the vertex layout, a single mesh under a single node
+    bool loaded = false;
+    if (native_ply) {
+        data.meshes.resize(1);
+        loaded = readPly(file_name, data.meshes[0]);
+        if (loaded) {
+            data.scene.addNode(file_name, -1, glm::mat4(1.f));
+            data.mesh_nodes.push_back(0);
+        } else {
+            std::cerr << "Falling back to assimp for " << file_name << "\n";
+            data.meshes.clear();
+        }
+    }
+
+    if (!loaded) {
+        // Read file with assimp
+        Assimp::Importer importer;
+        const aiScene *scene = importer.ReadFile(file_name.c_str(), import_flags);
+
+        // Check if loading was successful
+        if (scene == nullptr || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || scene->mRootNode == nullptr) {
+            std::cerr << "Error when loading mesh with assimp\n";
+            return false;
         }
+
+        // Collect meshes and the node hierarchy with a recursive node traversal
+        std::vector<const aiMesh *> meshes;
+        processNode(scene->mRootNode, scene, -1, meshes, data.scene, data.mesh_nodes);
+
+        // Copy meshes in parallel, one task per mesh
+        data.meshes.resize(meshes.size());
+        ThreadPool::getGlobal().parallelFor(meshes.size(), [&](std::size_t i) {
+            data.meshes[i] = processMesh(meshes[i]);
+        });
     }
+    // Imported meshes, updated again once the processing passes added their levels of detail
+    data.updateHostMemory();
+
+    // Process meshes in parallel, one task per mesh, the log of each task is printed afterwards in order
+    std::vector<std::string> meshes_log(data.meshes.size());
+    ThreadPool::getGlobal().parallelFor(data.meshes.size(), [&](std::size_t i) {
+        std::ostringstream log;
+        log << "Loaded mesh with " << data.meshes[i].vertices.size() << " vertices and "
+            << data.meshes[i].indices.size() / 3 << " triangles\n";
+        postProcessMesh(data.meshes[i], options, log);
+        meshes_log[i] = log.str();
+    });
 
     // Print mesh statistics
-    std::cout << "Loaded mesh with " << vertices.size() << " vertices and " << indices.size() / 3 << " triangles\n";
+    for (const auto& log : meshes_log) {
+        std::cout << log;
+    }
+
+    // Store processed data for the next run
+    if (use_cache) {
+        MeshCache::write(cache_key, data.meshes, data.scene, data.mesh_nodes);
+    }
+
+    data.views.clear();
+    for (const auto& mesh : data.meshes) {
+        data.views.push_back(mesh.getView());
+    }
+    setupBounds(data);
+    setupCulling(data, options);
+    data.updateHostMemory();
+    return true;
+}
+
+void Model::setupModel(ModelData& data, const std::vector<MeshUploadData>& uploads, const ModelImportOptions& options,
+                       MeshBuffer *buffer) {
+    m_bounds = data.bounds;
+    m_meshes_bounds = data.meshes_bounds;
+    m_meshes_spheres = data.meshes_spheres;
+    m_scene = data.scene;
+    m_mesh_nodes = data.mesh_nodes;
+
+    // Meshes are sorted by node, the meshes of a node and of a subtree are contiguous
+    m_node_first_mesh.assign(m_scene.size() + 1, 0);
+    for (const std::uint32_t node : m_mesh_nodes) {
+        ++m_node_first_mesh[node + 1];
+    }
+    for (std::size_t n = 1; n < m_node_first_mesh.size(); ++n) {
+        m_node_first_mesh[n] += m_node_first_mesh[n - 1];
+    }
+    // One object per node with meshes
+    m_mesh_objects.resize(m_mesh_nodes.size());
+    m_object_first_mesh.clear();
+    for (std::size_t m = 0; m < m_mesh_nodes.size(); ++m) {
+        if (m == 0 || m_mesh_nodes[m] != m_mesh_nodes[m - 1]) {
+            m_object_first_mesh.push_back(m);
+        }
+        m_mesh_objects[m] = static_cast<std::uint32_t>(m_object_first_mesh.size() - 1);
+    }
+
+    // Bounds in model space, updated when the nodes move
+    m_model_spheres.assign(data.views.size(), BoundingSphere());
+    m_mesh_scales.assign(data.views.size(), 1.f);
+    m_culling.clear();
+    for (std::size_t m = 0; m < m_meshes_bounds.size(); ++m) {
+        m_culling.add(AABB());
+    }
+    updateMeshBounds(0, m_meshes_bounds.size());
+    m_quantization = data.quantization;
+    m_layout = data.layout;
+    m_meshes.reserve(data.views.size());
 
-    return {vertices, indices};
+    // Occluders and meshlets were built with the import, e.g. on the loader thread
+    m_occluders = std::move(data.occluders);
+    m_meshlets = std::move(data.meshlets);
+
+    // Pick the buffer the meshes are sub-allocated in, if any
+    m_buffer = buffer;
+    if (m_buffer == nullptr && options.shared_buffers) {
+        m_own_buffer.reset(new MeshBuffer(*m_layout));
+        m_buffer = m_own_buffer.get();
+    }
+    if (m_buffer != nullptr) {
+        // Reserve the space of all the meshes at once, no growth happens while they are created
+        std::size_t num_vertices = 0;
+        std::size_t index_size = 0;
+        for (const auto& upload : uploads) {
+            num_vertices += upload.vertex_size / m_layout->stride;
+            index_size += (upload.index_size + 3) & ~std::size_t(3);
+        }
+        m_buffer->reserve(num_vertices, index_size);
+    }
 }
 
-Model::Model(const std::string& file_name) {
-    // Read file with assimp
-    Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(file_name.c_str(),
-                                             aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                                             aiProcess_CalcTangentSpace);
+Mesh Model::createMesh(const MeshUploadData& upload, MeshUpload mode) {
+    if (m_buffer != nullptr) {
+        return Mesh(upload, *m_buffer, mode);
+    }
+    return Mesh(upload, mode);
+}
+
+ModelVisibility::ModelVisibility()
+        : m_commands_dirty(true), m_commands_num_meshes(0), m_commands_generation(0) {}
+
+void ModelVisibility::destroy() {
+    if (m_indirect) {
+        m_indirect->destroy();
+        m_indirect.reset();
+    }
+}
 
-    // Check if loading was successful
-    if (scene == nullptr || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) || scene->mRootNode == nullptr) {
-        std::cerr << "Error when loading mesh with assimp\n";
+void ModelVisibility::resize(std::size_t num_meshes) {
+    if (m_visible.size() == num_meshes) {
+        return;
+    }
+    m_visible.resize(num_meshes, 1);
+    m_selected_lods.resize(num_meshes, 0);
+    m_meshlet_ranges.resize(num_meshes);
+    m_meshlet_lods.resize(num_meshes, no_meshlet_lod);
+    m_commands_dirty = true;
+}
+
+ModelMemoryUsage ModelVisibility::getMemoryUsage() const {
+    ModelMemoryUsage usage{0, 0};
+    if (m_indirect) {
+        usage.gpu_bytes += m_indirect->getSize();
+    }
+    for (const auto& ranges : m_meshlet_ranges) {
+        usage.host_bytes += ranges.capacity() * sizeof(DrawRange);
+    }
+    usage.host_bytes += m_visible.capacity() + m_culled.capacity() + m_selected_lods.capacity() * sizeof(std::size_t) +
+                        m_meshlet_ranges.capacity() * sizeof(std::vector<DrawRange>) +
+                        m_meshlet_lods.capacity() * sizeof(std::size_t) +
+                        m_meshlet_scratch.capacity() * sizeof(DrawRange) +
+                        m_commands.capacity() * sizeof(DrawElementsIndirectCommand) +
+                        m_batches.capacity() * sizeof(IndirectBatch);
+    return usage;
+}
+
+Model::Model()
+        : m_layout(&VertexLayout::get(VertexFormat::Float)), m_buffer(nullptr) {}
+
+Model::Model(const std::string& file_name, const ModelImportOptions& options, MeshBuffer *buffer)
+        : m_layout(&VertexLayout::get(options.vertex_format)), m_buffer(nullptr) {
+    ModelData data;
+    if (!importModel(file_name, options, data)) {
         exit(EXIT_FAILURE);
     }
 
-    // Start recursive node processing
-    processNode(scene->mRootNode, scene);
+    // Encode all the meshes in parallel, the sizes are needed to reserve the shared buffer
+    std::vector<MeshUploadData> uploads(data.views.size());
+    ThreadPool::getGlobal().parallelFor(uploads.size(), [&](std::size_t m) {
+        uploads[m] = Mesh::prepare(data.views[m], data.layout->format, data.quantization);
+    });
+    HostAllocation upload_memory;
+    upload_memory.set(getHostBytes(uploads));
+    setupModel(data, uploads, options, buffer);
+
+    // Create GPU meshes, this is the only step that needs the context
+    for (const auto& upload : uploads) {
+        m_meshes.push_back(createMesh(upload, MeshUpload::Immediate));
+    }
+    // Data has been copied to the GPU, release host memory and the cache mapping
+    uploads.clear();
+    upload_memory.release();
+    data.destroy();
 }
 
 void Model::destroy() {
     for (auto& mesh : m_meshes) {
         mesh.destroy();
     }
+    // A buffer given by the caller is destroyed by the caller
+    if (m_own_buffer) {
+        m_own_buffer->destroy();
+        m_own_buffer.reset();
+    }
+    m_buffer = nullptr;
 }
 
-void Model::draw() const {
+ModelMemoryUsage Model::getMemoryUsage() const {
+    ModelMemoryUsage usage{0, 0};
     for (const auto& mesh : m_meshes) {
-        mesh.draw();
+        usage.gpu_bytes += mesh.getGpuBytes();
+        usage.host_bytes += mesh.getHostBytes();
+    }
+    for (const auto& meshlets : m_meshlets) {
+        usage.host_bytes += meshlets.getHostBytes();
+    }
+    for (const auto& occluder : m_occluders) {
+        usage.host_bytes += occluder.positions.capacity() * sizeof(glm::vec3) +
+                            occluder.indices.capacity() * sizeof(std::uint32_t);
+    }
+    usage.host_bytes += m_meshes.capacity() * sizeof(Mesh) + m_scene.getHostBytes() + m_culling.getHostBytes() +
+                        m_mesh_nodes.capacity() * sizeof(std::uint32_t) +
+                        m_node_first_mesh.capacity() * sizeof(std::size_t) +
+                        m_mesh_objects.capacity() * sizeof(std::uint32_t) +
+                        m_object_first_mesh.capacity() * sizeof(std::size_t) +
+                        m_meshes_bounds.capacity() * sizeof(AABB) +
+                        (m_meshes_spheres.capacity() + m_model_spheres.capacity()) * sizeof(BoundingSphere) +
+                        m_mesh_scales.capacity() * sizeof(float) + m_occluders.capacity() * sizeof(OccluderMesh) +
+                        m_meshlets.capacity() * sizeof(MeshletSet) +
+                        m_multi_draw.counts.capacity() * sizeof(GLsizei) +
+                        m_multi_draw.offsets.capacity() * sizeof(const void *) +
+                        m_multi_draw.base_vertices.capacity() * sizeof(GLint);
+    return usage;
+}
+
+void Model::updateMeshBounds(std::size_t first, std::size_t last) {
+    for (std::size_t m = first; m < last; ++m) {
+        if (!m_meshes_bounds[m].isValid()) {
+            continue;
+        }
+        const glm::mat4& world = m_scene.getWorldTransform(m_mesh_nodes[m]);
+        const AABB box = m_meshes_bounds[m].transform(world);
+        m_culling.set(m, box);
+        // Bounds of the model only grow, shrinking them would need all the meshes
+        m_bounds.extend(box);
+        const float scale = std::max(glm::length(glm::vec3(world[0])),
+                                     std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+        m_model_spheres[m] = BoundingSphere(glm::vec3(world * glm::vec4(m_meshes_spheres[m].center, 1.f)),
+                                            m_meshes_spheres[m].radius * scale);
+        m_mesh_scales[m] = scale;
+    }
+}
+
+void Model::updateTransforms() {
+    if (!m_scene.isDirty()) {
+        return;
+    }
+    // Only the meshes of the recomputed subtrees are touched
+    for (const NodeRange& range : m_scene.update()) {
+        updateMeshBounds(m_node_first_mesh[range.first], m_node_first_mesh[range.last]);
+    }
+}
+
+glm::mat4 Model::getMeshTransform(const glm::mat4& model, std::size_t mesh) const {
+    return model * m_scene.getWorldTransform(m_mesh_nodes[mesh]) * m_quantization.getDequantizationMatrix();
+}
+
+std::size_t Model::appendTransforms(const glm::mat4& model, ObjectTransforms& objects) const {
+    const std::size_t first_object = objects.size();
+    for (const std::size_t mesh : m_object_first_mesh) {
+        objects.add(getMeshTransform(model, mesh));
+    }
+    return first_object;
+}
+
+bool Model::isIndirectSupported() {
+    return GLEW_ARB_multi_draw_indirect != 0;
+}
+
+void Model::buildCommands(ModelVisibility& visibility) const {
+    visibility.m_commands.clear();
+    visibility.m_batches.clear();
+    // One batch per node and index type, the object constants are bound between the nodes and
+    // glMultiDrawElementsIndirect takes a single type
+    for (std::size_t first = 0; first < m_meshes.size();) {
+        const std::uint32_t node = m_mesh_nodes[first];
+        const std::size_t last = std::min(m_meshes.size(), m_node_first_mesh[node + 1]);
+        for (const GLenum index_type : {GL_UNSIGNED_SHORT, GL_UNSIGNED_INT}) {
+            const std::size_t first_command = visibility.m_commands.size();
+            for (std::size_t m = first; m < last; ++m) {
+                if (!visibility.m_visible[m] || m_meshes[m].getIndexType() != index_type) {
+                    continue;
+                }
+                if (visibility.hasMeshletRanges(m)) {
+                    m_meshes[m].appendCommands(visibility.m_meshlet_ranges[m], visibility.m_commands);
+                } else {
+                    m_meshes[m].appendCommands(visibility.m_selected_lods[m], visibility.m_commands);
+                }
+            }
+            if (visibility.m_commands.size() > first_command) {
+                visibility.m_batches.push_back({index_type, first_command,
+                                                static_cast<GLsizei>(visibility.m_commands.size() - first_command),
+                                                first});
+            }
+        }
+        first = last;
+    }
+
+    // Whole buffer is respecified, the previous commands may still be read by the GPU
+    if (!visibility.m_indirect) {
+        visibility.m_indirect.reset(new Buffer(GL_DRAW_INDIRECT_BUFFER, GL_DYNAMIC_DRAW));
+    }
+    visibility.m_indirect->bind();
+    visibility.m_indirect->submitData(visibility.m_commands);
+    visibility.m_indirect->unbind();
+
+    visibility.m_commands_dirty = false;
+    visibility.m_commands_num_meshes = m_meshes.size();
+    visibility.m_commands_generation = m_buffer->getGeneration();
+}
+
+void Model::drawIndirect(ModelVisibility& visibility, const ObjectTransforms& objects,
+                         std::size_t first_object) const {
+    // Commands only change with the culling of the placement, when meshes are added or when the shared buffer is
+    // compacted
+    if (visibility.m_commands_dirty || visibility.m_commands_num_meshes != m_meshes.size() ||
+        visibility.m_commands_generation != m_buffer->getGeneration()) {
+        buildCommands(visibility);
+    }
+
+    m_buffer->bind();
+    visibility.m_indirect->bind();
+    std::int64_t current_object = -1;
+    for (const auto& batch : visibility.m_batches) {
+        if (m_mesh_objects[batch.first_mesh] != current_object) {
+            current_object = m_mesh_objects[batch.first_mesh];
+            objects.bind(first_object + m_mesh_objects[batch.first_mesh]);
+        }
+        glMultiDrawElementsIndirect(GL_TRIANGLES, batch.index_type,
+                                    reinterpret_cast<const void *>(batch.first_command *
+                                                                   sizeof(DrawElementsIndirectCommand)),
+                                    batch.num_commands, 0);
+    }
+    // VAO stays bound, the next placement drawn skips the bind
+    GL_CHECK();
+}
+
+void Model::draw(ModelVisibility& visibility, const ObjectTransforms& objects, std::size_t first_object) const {
+    if (m_meshes.empty()) {
+        return;
+    }
+    visibility.resize(m_meshes_bounds.size());
+    // Whole model in a few calls when the commands can be read from a buffer
+    if (m_buffer != nullptr && isIndirectSupported()) {
+        drawIndirect(visibility, objects, first_object);
+        return;
+    }
+    // Meshes sharing a buffer are drawn with a single VAO bind
+    if (m_buffer != nullptr) {
+        m_buffer->bind();
+    }
+    std::int64_t current_object = -1;
+    for (std::size_t m = 0; m < m_meshes.size(); ++m) {
+        if (!visibility.m_visible[m]) {
+            continue;
+        }
+        // Meshes are sorted by node, the constants only change between nodes
+        if (m_mesh_objects[m] != current_object) {
+            current_object = m_mesh_objects[m];
+            objects.bind(first_object + m_mesh_objects[m]);
+        }
+        if (visibility.hasMeshletRanges(m)) {
+            if (m_buffer != nullptr) {
+                m_meshes[m].drawRanges(visibility.m_meshlet_ranges[m], m_multi_draw);
+            } else {
+                m_meshes[m].draw(visibility.m_meshlet_ranges[m], m_multi_draw);
+            }
+        } else if (m_buffer != nullptr) {
+            m_meshes[m].drawRanges(visibility.m_selected_lods[m]);
+        } else {
+            m_meshes[m].draw(visibility.m_selected_lods[m]);
+        }
+    }
+    GL_CHECK();
+}
+
+void Model::drawInstanced(ModelVisibility& visibility, const InstanceBuffer& instances,
+                          const Program& program) const {
+    if (m_meshes.empty() || instances.getCount() == 0) {
+        return;
+    }
+    visibility.resize(m_meshes_bounds.size());
+    // Meshes sharing a buffer share the VAO, the instance attributes are set once
+    if (m_buffer != nullptr) {
+        m_buffer->bind();
+        instances.setup();
+    }
+    std::int64_t current_node = -1;
+    for (std::size_t m = 0; m < m_meshes.size(); ++m) {
+        // Node transform is applied before the instance transform
+        if (m_mesh_nodes[m] != current_node) {
+            current_node = m_mesh_nodes[m];
+            const glm::mat4 transform = getMeshTransform(glm::mat4(1.f), m);
+            glm::vec4 normal[3];
+            ObjectTransforms::computeNormalMatrix(transform, normal);
+            program.setMat4("model", transform);
+            program.setMat3("normal_model", glm::mat3(glm::vec3(normal[0]), glm::vec3(normal[1]),
+                                                      glm::vec3(normal[2])));
+        }
+        if (m_buffer != nullptr) {
+            m_meshes[m].drawRangesInstanced(instances.getCount(), visibility.m_selected_lods[m]);
+        } else {
+            m_meshes[m].drawInstanced(instances, visibility.m_selected_lods[m]);
+        }
+    }
+    GL_CHECK();
+}
+
+std::size_t Model::cull(ModelVisibility& visibility, const glm::mat4& model, const glm::mat4& view_proj,
+                        const OcclusionBuffer *occlusion) const {
+    visibility.resize(m_meshes_bounds.size());
+    // Planes of proj * view * model are in model space, the mesh bounds are kept in model space by updateTransforms
+    const glm::mat4 mvp = view_proj * model;
+    const Frustum frustum(mvp);
+    std::vector<unsigned char>& culled = visibility.m_culled;
+    m_culling.cull(frustum, culled);
+    std::size_t num_visible = 0;
+    for (std::size_t m = 0; m < visibility.m_visible.size(); ++m) {
+        // Only the meshes in the frustum are tested against the occluders, with their box in node space
+        if (occlusion != nullptr && culled[m] &&
+            occlusion->isOccluded(m_meshes_bounds[m], mvp * m_scene.getWorldTransform(m_mesh_nodes[m]))) {
+            culled[m] = 0;
+        }
+        if (visibility.m_visible[m] != culled[m]) {
+            visibility.m_visible[m] = culled[m];
+            visibility.m_commands_dirty = true;
+        }
+        num_visible += visibility.m_visible[m];
+    }
+    return num_visible;
+}
+
+void Model::renderOccluders(OcclusionBuffer& occlusion, const glm::mat4& model, const glm::mat4& view_proj) const {
+    const glm::mat4 mvp = view_proj * model;
+    for (std::size_t m = 0; m < m_occluders.size(); ++m) {
+        if (!m_occluders[m].empty()) {
+            occlusion.renderOccluder(m_occluders[m], mvp * m_scene.getWorldTransform(m_mesh_nodes[m]));
+        }
+    }
+}
+
+std::size_t Model::cullMeshlets(ModelVisibility& visibility, const glm::mat4& model, const glm::mat4& view,
+                                const glm::mat4& proj) const {
+    visibility.resize(m_meshes_bounds.size());
+    const glm::vec3 camera = glm::vec3(glm::inverse(view)[3]);
+    const glm::mat4 view_proj = proj * view;
+    std::vector<DrawRange>& scratch = visibility.m_meshlet_scratch;
+    std::size_t num_kept = 0;
+    for (std::size_t m = 0; m < m_meshes.size(); ++m) {
+        // Hidden meshes are not drawn, their ranges are culled again once they show up
+        if (m_meshlets[m].empty() || !visibility.m_visible[m]) {
+            continue;
+        }
+        // Meshlet bounds are in node space, the frustum and the camera are brought there
+        const glm::mat4 node_model = model * m_scene.getWorldTransform(m_mesh_nodes[m]);
+        const Frustum frustum(view_proj * node_model);
+        const glm::vec3 node_camera = glm::vec3(glm::inverse(node_model) * glm::vec4(camera, 1.f));
+        const Mesh& mesh = m_meshes[m];
+        const MeshLod& lod = mesh.getLod(std::min(visibility.m_selected_lods[m], mesh.getNumLods() - 1));
+
+        scratch.clear();
+        num_kept += m_meshlets[m].cull(lod.first_range, lod.num_ranges, frustum, node_camera, scratch);
+        std::vector<DrawRange>& ranges = visibility.m_meshlet_ranges[m];
+        if (!visibility.hasMeshletRanges(m) ||
+            !std::equal(scratch.begin(), scratch.end(), ranges.begin(), ranges.end(),
+                        [](const DrawRange& a, const DrawRange& b) {
+                            return a.first_index == b.first_index && a.num_indices == b.num_indices &&
+                                   a.base_vertex == b.base_vertex;
+                        })) {
+            ranges.swap(scratch);
+            visibility.m_meshlet_lods[m] = visibility.m_selected_lods[m];
+            visibility.m_commands_dirty = true;
+        }
+    }
+    return num_kept;
+}
+
+void Model::selectLods(ModelVisibility& visibility, const glm::mat4& model, const glm::mat4& view,
+                       const glm::mat4& proj, float viewport_height, float max_pixel_error) const {
+    visibility.resize(m_meshes_bounds.size());
+    // Largest scale of the model matrix, errors and radii are scaled by it
+    const float scale = std::max(glm::length(glm::vec3(model[0])),
+                                 std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    const glm::mat4 model_view = view * model;
+
+    for (std::size_t m = 0; m < m_meshes.size(); ++m) {
+        const Mesh& mesh = m_meshes[m];
+        const BoundingSphere& sphere = m_model_spheres[m];
+        // Distance to the closest point of the bounding sphere, the error is projected there
+        const glm::vec3 center = glm::vec3(model_view * glm::vec4(sphere.center, 1.f));
+        const float radius = sphere.radius * scale;
+        const float distance = std::max(glm::length(center) - radius, 1e-4f);
+        const float pixels_per_unit = proj[1][1] * 0.5f * viewport_height / distance;
+
+        std::size_t lod = 0;
+        for (std::size_t l = mesh.getNumLods(); l-- > 1;) {
+            if (mesh.getLod(l).error * m_mesh_scales[m] * scale * pixels_per_unit <= max_pixel_error) {
+                lod = l;
+                break;
+            }
+        }
+        if (visibility.m_selected_lods[m] != lod) {
+            visibility.m_selected_lods[m] = lod;
+            visibility.m_commands_dirty = true;
+        }
     }
 }
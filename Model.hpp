@@ -6,29 +6,324 @@
 #define OPENGLPLAYGROUND_MODEL_HPP
 
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "Frustum.hpp"
+#include "ObjectTransforms.hpp"
+#include "OcclusionCulling.hpp"
+#include "Meshlets.hpp"
+#include "MemoryStats.hpp"
 #include <assimp/scene.h>
+#include <memory>
+
+// Options of the model import pipeline
+struct ModelImportOptions {
+    // Merge duplicated vertices, runs before any other pass
+    bool weld_vertices = false;
+    // Grid spacing used to compare positions and normals when welding, 0 only merges identical vertices
+    float weld_epsilon = 0.f;
+    // Reorder triangles and vertices for post transform cache, overdraw and vertex fetch
+    bool optimize_meshes = false;
+    // Number of simplified levels of detail generated for each mesh
+    std::size_t lod_levels = 0;
+    // Triangle count ratio between two consecutive levels
+    float lod_ratio = 0.5f;
+    // Split meshes with more than 65536 vertices in ranges that can use 16 bit indices, runs after the optimisation
+    bool split_index_ranges = false;
+    // Format of the vertices on the GPU, quantized formats are encoded at upload time
+    VertexFormat vertex_format = VertexFormat::Float;
+    // Sub-allocate all the meshes in one vertex buffer and one index buffer with a single VAO. Only changes the GPU
+    // side, not part of the cache key
+    bool shared_buffers = false;
+    // Keep the full resolution level of the meshes with at most this many triangles as CPU occluders, larger meshes
+    // get boxes fitted inside them instead, 0 keeps none. Simplified levels are never used, they are not inside the
+    // surface. Not part of the cache key
+    std::size_t occluder_triangles = 0;
+    // Split the meshes in meshlets of at most 64 vertices and 124 triangles, culled one by one by Model::cullMeshlets.
+    // Not part of the cache key
+    bool build_meshlets = false;
+};
+
+// Host side data of a whole model, output of the CPU part of the import
+struct ModelData {
+    // Views on the data of each mesh, they point into meshes or into the cache mapping
+    std::vector<MeshDataView> views;
+    // Processed meshes, empty when the data comes from the cache
+    std::vector<MeshData> meshes;
+    // Mapped cache file
+    MeshCache cache;
+    // Node hierarchy of the model
+    SceneGraph scene;
+    // Node of each mesh, meshes are sorted by node
+    std::vector<std::uint32_t> mesh_nodes;
+    // Bounds of all the meshes in model space
+    AABB bounds;
+    // Bounds of each mesh in the space of its node
+    std::vector<AABB> meshes_bounds;
+    // Bounding sphere of each mesh
+    std::vector<BoundingSphere> meshes_spheres;
+    // Quantization of the positions, shared by all the meshes
+    PositionQuantization quantization;
+    // Occluder of each mesh, see ModelImportOptions::occluder_triangles
+    std::vector<OccluderMesh> occluders;
+    // Meshlets of each mesh, see ModelImportOptions::build_meshlets
+    std::vector<MeshletSet> meshlets;
+    // Vertex layout of the meshes on the GPU
+    const VertexLayout *layout;
+    // Host bytes reported to the memory statistics
+    HostAllocation host_memory;
+
+    // Report the current size of the meshes and of the cache mapping to the memory statistics
+    void updateHostMemory();
+
+    // Release host memory and mappings
+    void destroy();
+};
+
+// Memory held by a model or by the visibility of one of its placements
+struct ModelMemoryUsage {
+    // Bytes of the meshes in the GPU buffers, only their part of shared buffers, or of the indirect commands
+    std::size_t gpu_bytes;
+    // Bytes of the host data kept for culling, occlusion and drawing
+    std::size_t host_bytes;
+};
+
+// Consecutive indirect commands sharing an index type, submitted with one multi draw
+struct IndirectBatch {
+    // Type of the indices of the meshes
+    GLenum index_type;
+    // First command in the indirect buffer
+    std::size_t first_command;
+    // Number of commands
+    GLsizei num_commands;
+    // First mesh of the node the commands belong to, selects the object constants
+    std::size_t first_mesh;
+};
+
+// Visibility of a model at one placement: culled meshes, selected levels of detail, kept meshlets and the indirect
+// commands built from them. Each place the model is drawn at keeps its own, so drawing the model several times per
+// frame does not rebuild the commands of one placement with the visibility of another
+class ModelVisibility {
+private:
+    friend class Model;
+
+    // Result of the last culling, one flag per mesh
+    std::vector<unsigned char> m_visible;
+    std::vector<unsigned char> m_culled;
+    // Level of detail drawn for each mesh
+    std::vector<std::size_t> m_selected_lods;
+    // Index ranges of the meshlets kept by the last meshlet cull of each mesh
+    std::vector<std::vector<DrawRange>> m_meshlet_ranges;
+    // Level of detail the meshlet ranges were culled for, the largest size_t when there are none
+    std::vector<std::size_t> m_meshlet_lods;
+    // Ranges of the mesh being culled, compared to the previous ones
+    std::vector<DrawRange> m_meshlet_scratch;
+    // Indirect commands of the selected levels of detail, grouped by node and index type
+    std::vector<DrawElementsIndirectCommand> m_commands;
+    std::vector<IndirectBatch> m_batches;
+    // Buffer holding the commands, created on the first indirect draw
+    std::unique_ptr<Buffer> m_indirect;
+    // Set when the visible meshes or the drawn ranges changed since the commands were built
+    bool m_commands_dirty;
+    // Number of resident meshes when the commands were built, meshes are appended while a model streams in
+    std::size_t m_commands_num_meshes;
+    // Generation of the shared buffer when the commands were built, compactions move the meshes
+    std::size_t m_commands_generation;
+
+    // Size the state for the meshes of a model, the new meshes are visible at their finest level
+    void resize(std::size_t num_meshes);
+
+    // Check if a mesh is drawn with the ranges of its kept meshlets, they must be culled at the selected level
+    inline bool hasMeshletRanges(std::size_t mesh) const {
+        return m_meshlet_lods[mesh] == m_selected_lods[mesh];
+    }
+
+public:
+    // Create empty state, it is sized by the first use with a model
+    ModelVisibility();
+
+    // Destroy the indirect buffer
+    void destroy();
+
+    // Get memory held by the state on the host and in the indirect buffer
+    ModelMemoryUsage getMemoryUsage() const;
+};
 
 // Wraps a whole set of meshes into a model
 class Model {
 private:
+    friend class ModelLoader;
+
     // Meshes
     std::vector<Mesh> m_meshes;
+    // Node hierarchy, the meshes are drawn with the world transform of their node
+    SceneGraph m_scene;
+    // Node of each mesh, meshes are sorted by node
+    std::vector<std::uint32_t> m_mesh_nodes;
+    // First mesh of each node, one more entry for the end of the last node
+    std::vector<std::size_t> m_node_first_mesh;
+    // Object of each mesh relative to the first object of the model, one object per node with meshes
+    std::vector<std::uint32_t> m_mesh_objects;
+    // First mesh of each object
+    std::vector<std::size_t> m_object_first_mesh;
+    // Bounds of all the meshes in model space, grows when nodes move
+    AABB m_bounds;
+    // Bounds of each mesh in the space of its node
+    std::vector<AABB> m_meshes_bounds;
+    // Bounding sphere of each mesh in the space of its node
+    std::vector<BoundingSphere> m_meshes_spheres;
+    // Bounding sphere of each mesh in model space
+    std::vector<BoundingSphere> m_model_spheres;
+    // Largest scale of the node of each mesh, the errors of the levels of detail are in node space
+    std::vector<float> m_mesh_scales;
+    // Bounds of the meshes in model space prepared for culling
+    CullingVolumes m_culling;
+    // Occluder of each mesh, empty for the meshes that are too detailed
+    std::vector<OccluderMesh> m_occluders;
+    // Meshlets of each mesh, empty when they are not built
+    std::vector<MeshletSet> m_meshlets;
+    // Quantization of the positions, shared by all the meshes
+    PositionQuantization m_quantization;
+    // Vertex layout of the meshes
+    const VertexLayout *m_layout;
+    // Buffer the meshes are sub-allocated in, null when each mesh owns its buffers
+    MeshBuffer *m_buffer;
+    // Buffer created by the model for shared_buffers, null when the buffer is given by the caller
+    std::unique_ptr<MeshBuffer> m_own_buffer;
+    // Arguments of the multi draws of the meshlet ranges when the commands can not be read from a buffer
+    mutable MultiDrawArrays m_multi_draw;
+
+    // Process assimp node, adds the nodes of the subtree to the graph and collects their meshes
+    static void processNode(aiNode *node, const aiScene *scene, std::int32_t parent, std::vector<const aiMesh *>& meshes,
+                            SceneGraph& graph, std::vector<std::uint32_t>& mesh_nodes);
+
+    // Process assimp mesh, only touches host memory so it can run on any thread
+    static MeshData processMesh(const aiMesh *mesh);
 
-    // Process assimp node
-    void processNode(aiNode *node, const aiScene *scene);
+    // Run the optional processing passes on the imported data, only touches host memory
+    static void postProcessMesh(MeshData& data, const ModelImportOptions& options, std::ostream& log);
 
-    // Process assimp mesh
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+    // Compute bounds and quantization of the data
+    static void setupBounds(ModelData& data);
+
+    // Extract the occluders and build the meshlets of the data, only touches host memory
+    static void setupCulling(ModelData& data, const ModelImportOptions& options);
+
+    // Take everything but the meshes from the imported data and pick the buffer of the meshes. Occluders and meshlets
+    // are moved out of the data. The upload data is used to reserve the space of a shared buffer
+    void setupModel(ModelData& data, const std::vector<MeshUploadData>& uploads, const ModelImportOptions& options,
+                    MeshBuffer *buffer);
+
+    // Create a mesh, sub-allocated in the shared buffer if there is one
+    Mesh createMesh(const MeshUploadData& upload, MeshUpload mode);
+
+    // Build the indirect commands of a placement and copy them to its indirect buffer
+    void buildCommands(ModelVisibility& visibility) const;
+
+    // Transform the culling volumes and spheres of the meshes in [first, last) to model space
+    void updateMeshBounds(std::size_t first, std::size_t last);
+
+    // Model matrix of a mesh: model, then its node, then the dequantization
+    glm::mat4 getMeshTransform(const glm::mat4& model, std::size_t mesh) const;
+
+    // Draw the visible meshes of a placement with one multi draw per node and index type
+    void drawIndirect(ModelVisibility& visibility, const ObjectTransforms& objects, std::size_t first_object) const;
 
 public:
-    // Construct model from file
-    explicit Model(const std::string& file_name);
+    // Create empty model, meshes are added by the ModelLoader as they become resident
+    Model();
+
+    // Construct model from file. If buffer is given the meshes are sub-allocated in it, e.g. to share one buffer between
+    // all the models of a scene, the vertex format must match its layout
+    explicit Model(const std::string& file_name, const ModelImportOptions& options = ModelImportOptions(),
+                   MeshBuffer *buffer = nullptr);
+
+    // CPU part of the import: read the cache or import with assimp, run the processing passes and build the culling
+    // data. Does not need the context, so it can run on any thread. Returns false on failure
+    static bool importModel(const std::string& file_name, const ModelImportOptions& options, ModelData& data);
 
     // Destroy model
     void destroy();
 
-    // Draw model
-    void draw() const;
+    // Add one object per node with meshes, with the matrix model * node * dequantization. Returns the index of the
+    // first object, to give to draw once the objects are updated
+    std::size_t appendTransforms(const glm::mat4& model, ObjectTransforms& objects) const;
+
+    // Draw the meshes of a placement left visible by its culling, the Object block is bound to the constants of each
+    // node in turn. With a shared buffer the meshes are drawn with glMultiDrawElementsIndirect if it is supported, one
+    // draw call per range otherwise
+    void draw(ModelVisibility& visibility, const ObjectTransforms& objects, std::size_t first_object) const;
+
+    // Draw instances of the model, one instanced draw per range. The shaders must be compiled with the INSTANCED
+    // define, the "model" uniform is set to node * dequantization and applied before the transform of each instance.
+    // All the meshes are drawn at the levels of detail selected in visibility, shared by all the instances
+    void drawInstanced(ModelVisibility& visibility, const InstanceBuffer& instances, const Program& program) const;
+
+    // Recompute the world transforms of the nodes changed through getSceneGraph, only the meshes below them get new
+    // culling bounds
+    void updateTransforms();
+
+    // Get node hierarchy, local transforms can be changed to animate the nodes
+    inline SceneGraph& getSceneGraph() noexcept {
+        return m_scene;
+    }
+
+    inline const SceneGraph& getSceneGraph() const noexcept {
+        return m_scene;
+    }
+
+    // Check if indirect multi draws can be used, needs ARB_multi_draw_indirect on the 4.1 context
+    static bool isIndirectSupported();
+
+    // Get number of meshes
+    inline std::size_t getNumMeshes() const noexcept {
+        return m_meshes.size();
+    }
+
+    // Get buffer the meshes are sub-allocated in, null when each mesh owns its buffers. Compacting it moves the meshes,
+    // the draws pick the new offsets up by themselves
+    inline MeshBuffer *getBuffer() const noexcept {
+        return m_buffer;
+    }
+
+    // Get memory held by the model on the host and in GL buffers
+    ModelMemoryUsage getMemoryUsage() const;
+
+    // Cull the meshes of a placement against the frustum of view_proj, and against the occlusion buffer if given.
+    // Hidden meshes are skipped by the draws of visibility until its next cull. model is the object to world matrix
+    // without dequantization. Returns the number of visible meshes
+    std::size_t cull(ModelVisibility& visibility, const glm::mat4& model, const glm::mat4& view_proj,
+                     const OcclusionBuffer *occlusion = nullptr) const;
+
+    // Rasterize the occluders of the meshes in the occlusion buffer, see ModelImportOptions::occluder_triangles
+    void renderOccluders(OcclusionBuffer& occlusion, const glm::mat4& model, const glm::mat4& view_proj) const;
+
+    // Cull the meshlets of the visible meshes at their selected level of detail, see ModelImportOptions::build_meshlets.
+    // Meshlets outside the frustum or facing away from the camera are skipped by the draws of visibility until its
+    // next meshlet cull or level change, so it runs after cull and selectLods. Returns the number of meshlets kept
+    std::size_t cullMeshlets(ModelVisibility& visibility, const glm::mat4& model, const glm::mat4& view,
+                             const glm::mat4& proj) const;
+
+    // Select the level of detail of each mesh of a placement from the projected error of its levels, the coarsest
+    // level whose error covers at most max_pixel_error pixels is drawn. model is the object to world matrix without
+    // dequantization
+    void selectLods(ModelVisibility& visibility, const glm::mat4& model, const glm::mat4& view, const glm::mat4& proj,
+                    float viewport_height, float max_pixel_error = 1.f) const;
+
+    // Get bounds of the model in object space, conservative once nodes moved
+    inline const AABB& getBounds() const noexcept {
+        return m_bounds;
+    }
+
+    // Get vertex layout of the meshes, the shaders must be compiled with its defines
+    inline const VertexLayout& getVertexLayout() const noexcept {
+        return *m_layout;
+    }
+
+    // Matrix to multiply to the right of the node matrix, maps the quantized positions to node space. Identity for
+    // float vertices
+    inline glm::mat4 getDequantizationMatrix() const {
+        return m_quantization.getDequantizationMatrix();
+    }
 };
 
 #endif //OPENGLPLAYGROUND_MODEL_HPP
@@ -0,0 +1,176 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "ModelLoader.hpp"
+
+#include <exception>
+#include <iostream>
+
+AsyncModel::AsyncModel()
+        : m_state(ModelState::Decoding) {}
+
+ModelLoader::ModelLoader(std::size_t frame_budget)
+        : m_frame_budget(frame_budget), m_staging(GL_COPY_READ_BUFFER, GL_STREAM_DRAW), m_pending(0),
+          m_cancelled(false), m_worker(1) {}
+
+std::shared_ptr<AsyncModel> ModelLoader::load(const std::string& file_name, const ModelImportOptions& options,
+                                              MeshBuffer *buffer) {
+    auto job = std::make_shared<Job>();
+    job->model = std::make_shared<AsyncModel>();
+    job->file_name = file_name;
+    job->options = options;
+    job->buffer = buffer;
+    ++m_pending;
+    m_worker.submit([this, job]() { decode(job); });
+    return job->model;
+}
+
+void ModelLoader::decode(const std::shared_ptr<Job>& job) {
+    if (m_cancelled.load()) {
+        return;
+    }
+    // Nothing waits on the worker task, an exception must end up as a failed import or the job is never finished
+    try {
+        job->success = Model::importModel(job->file_name, job->options, job->data);
+        if (job->success) {
+            // Encode the meshes, the index conversion and vertex quantization are the expensive part of the upload
+            job->uploads.resize(job->data.views.size());
+            ThreadPool::getGlobal().parallelFor(job->uploads.size(), [&job](std::size_t m) {
+                job->uploads[m] = Mesh::prepare(job->data.views[m], job->data.layout->format,
+                                                job->data.quantization);
+            });
+            job->upload_memory.set(getHostBytes(job->uploads));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error when loading " << job->file_name << ": " << e.what() << "\n";
+        job->success = false;
+    } catch (...) {
+        std::cerr << "Error when loading " << job->file_name << "\n";
+        job->success = false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_decoded.push_back(job);
+}
+
+void ModelLoader::beginUpload(Job& job) {
+    Model& model = job.model->m_model;
+    model.setupModel(job.data, job.uploads, job.options, job.buffer);
+    // Storage of all the meshes is allocated now, the data follows over the next updates
+    job.meshes.reserve(job.uploads.size());
+    for (const auto& upload : job.uploads) {
+        job.meshes.push_back(model.createMesh(upload, MeshUpload::Deferred));
+    }
+    job.model->m_state = ModelState::Uploading;
+}
+
+std::size_t ModelLoader::upload(Job& job, std::size_t staging_offset, std::size_t budget) {
+    std::size_t copied = 0;
+    while (copied < budget && job.current_mesh < job.uploads.size()) {
+        const MeshUploadData& data = job.uploads[job.current_mesh];
+        const Mesh& mesh = job.meshes[job.current_mesh];
+
+        // Pick the part of the mesh the offset falls in
+        const bool vertices = job.current_offset < data.vertex_size;
+        const std::size_t part_offset = vertices ? job.current_offset : job.current_offset - data.vertex_size;
+        const std::size_t part_size = vertices ? data.vertex_size : data.index_size;
+        const unsigned char *source = vertices ? data.getVertexBytes() : data.getIndexBytes();
+        const Buffer& destination = vertices ? mesh.getVertexBuffer() : mesh.getIndexBuffer();
+        const std::size_t write_offset = (vertices ? mesh.getVertexOffset() : mesh.getIndexOffset()) + part_offset;
+        const std::size_t size = std::min(part_size - part_offset, budget - copied);
+
+        if (size > 0) {
+            // Write to the staging buffer, then copy on the GPU to the final buffer
+            const auto read_offset = static_cast<GLintptr>(staging_offset + copied);
+            // Storage was orphaned this update and each part is written once, no draw or copy reads it yet
+            m_staging.updateBytes(source + part_offset, size, static_cast<std::size_t>(read_offset),
+                                  BufferUpdate::MapUnsynchronized);
+            GLState::getGlobal().bindBuffer(GL_COPY_WRITE_BUFFER, destination.getID());
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, read_offset,
+                                static_cast<GLintptr>(write_offset), static_cast<GLsizeiptr>(size));
+            copied += size;
+            job.current_offset += size;
+        }
+
+        // Mesh is resident, it can be drawn from the next draw on
+        if (job.current_offset == data.vertex_size + data.index_size) {
+            job.model->m_model.m_meshes.push_back(mesh);
+            ++job.current_mesh;
+            job.current_offset = 0;
+        }
+    }
+    GLState::getGlobal().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return copied;
+}
+
+void ModelLoader::update() {
+    // Take the decoded jobs
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!m_decoded.empty()) {
+            m_uploading.push_back(m_decoded.front());
+            m_decoded.pop_front();
+        }
+    }
+    if (m_uploading.empty()) {
+        return;
+    }
+
+    // Orphan the staging buffer, the copies of the previous update may still read the old storage
+    m_staging.allocateSpace(static_cast<GLsizeiptr>(m_frame_budget));
+    m_staging.bind();
+
+    std::size_t copied = 0;
+    while (!m_uploading.empty() && copied < m_frame_budget) {
+        Job& job = *m_uploading.front();
+        if (job.success && job.model->getState() == ModelState::Decoding) {
+            beginUpload(job);
+        }
+        if (job.success) {
+            copied += upload(job, copied, m_frame_budget - copied);
+        }
+
+        // Job is done when all its meshes are resident
+        if (!job.success || job.current_mesh == job.uploads.size()) {
+            job.model->m_state = job.success ? ModelState::Resident : ModelState::Failed;
+            releaseJob(job);
+            m_uploading.pop_front();
+            --m_pending;
+        }
+    }
+
+    m_staging.unbind();
+    GL_CHECK();
+}
+
+void ModelLoader::releaseJob(Job& job) {
+    job.uploads.clear();
+    job.upload_memory.release();
+    job.meshes.clear();
+    job.data.destroy();
+}
+
+void ModelLoader::destroy() {
+    // Wait for the running import, the worker runs the jobs in order and the ones not started yet return at once
+    m_cancelled.store(true);
+    m_worker.submit([]() {}).wait();
+
+    // Meshes already moved to the models belong to them, only the others are released here
+    for (auto& job : m_uploading) {
+        for (std::size_t m = job->current_mesh; m < job->meshes.size(); ++m) {
+            job->meshes[m].destroy();
+        }
+        releaseJob(*job);
+    }
+    m_uploading.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& job : m_decoded) {
+            releaseJob(*job);
+        }
+        m_decoded.clear();
+    }
+    m_pending.store(0);
+    m_staging.destroy();
+}
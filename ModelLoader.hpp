@@ -0,0 +1,143 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_MODELLOADER_HPP
+#define OPENGLPLAYGROUND_MODELLOADER_HPP
+
+#include "Model.hpp"
+#include "ThreadPool.hpp"
+
+#include <deque>
+
+// Loading state of an asynchronous model
+enum class ModelState {
+    // Import and encoding are running on the loader thread
+    Decoding,
+    // Meshes are being copied to the GPU, the resident ones can already be drawn
+    Uploading,
+    // All the meshes are on the GPU
+    Resident,
+    // Import failed, the model stays empty
+    Failed
+};
+
+// Handle on a model loaded in the background
+class AsyncModel {
+private:
+    friend class ModelLoader;
+
+    // Current state, written by the loader
+    std::atomic<ModelState> m_state;
+    // Model, meshes are appended as they become resident. Only touched on the context thread
+    Model m_model;
+
+public:
+    AsyncModel();
+
+    // Get current state
+    inline ModelState getState() const noexcept {
+        return m_state.load();
+    }
+
+    // Check if all the meshes are resident
+    inline bool isResident() const noexcept {
+        return getState() == ModelState::Resident;
+    }
+
+    // Get model, it is empty until the upload starts and can be drawn at any time
+    inline Model& getModel() noexcept {
+        return m_model;
+    }
+};
+
+// Loads models without blocking the render loop: import and encoding run on a worker thread, the upload is spread
+// over frames through a staging buffer with a byte budget per frame
+class ModelLoader {
+private:
+    // Model being loaded
+    struct Job {
+        // Handle given to the user
+        std::shared_ptr<AsyncModel> model;
+        // File and options of the import
+        std::string file_name;
+        ModelImportOptions options;
+        // Buffer shared with other models, may be null
+        MeshBuffer *buffer = nullptr;
+        // Imported data, views on it are referenced by the upload data
+        ModelData data;
+        // Encoded meshes
+        std::vector<MeshUploadData> uploads;
+        // Host bytes of the encoded meshes reported to the memory statistics
+        HostAllocation upload_memory;
+        // Meshes with allocated storage, moved to the model when resident
+        std::vector<Mesh> meshes;
+        // Set when the import succeeded
+        bool success = false;
+        // Mesh being uploaded
+        std::size_t current_mesh = 0;
+        // Bytes of the current mesh already copied, vertices first then indices
+        std::size_t current_offset = 0;
+    };
+
+    // Bytes copied to the GPU at most per update
+    std::size_t m_frame_budget;
+    // Staging buffer, orphaned each update
+    Buffer m_staging;
+    // Jobs decoded by the worker, waiting for the upload
+    std::deque<std::shared_ptr<Job>> m_decoded;
+    // Synchronisation of the decoded queue
+    std::mutex m_mutex;
+    // Jobs being uploaded, only touched on the context thread
+    std::deque<std::shared_ptr<Job>> m_uploading;
+    // Number of jobs not finished yet
+    std::atomic<std::size_t> m_pending;
+    // Set by destroy, the decodes not started yet are skipped
+    std::atomic<bool> m_cancelled;
+    // Worker running the imports. Declared last so it is joined before the rest is destroyed
+    ThreadPool m_worker;
+
+    // Decode a job: import, culling data and mesh encoding, runs on the worker
+    void decode(const std::shared_ptr<Job>& job);
+
+    // Allocate the meshes of a decoded job
+    void beginUpload(Job& job);
+
+    // Copy at most budget bytes of the job through the staging buffer, returns the number of bytes copied
+    std::size_t upload(Job& job, std::size_t staging_offset, std::size_t budget);
+
+    // Release the host memory and the cache mapping of a job
+    static void releaseJob(Job& job);
+
+public:
+    // Create loader, frame_budget is the number of bytes copied to the GPU at most per update
+    explicit ModelLoader(std::size_t frame_budget = 4 * 1024 * 1024);
+
+    ModelLoader(const ModelLoader&) = delete;
+
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    // Start loading a model, returns immediately. buffer is handled as in the Model constructor
+    std::shared_ptr<AsyncModel> load(const std::string& file_name,
+                                     const ModelImportOptions& options = ModelImportOptions(),
+                                     MeshBuffer *buffer = nullptr);
+
+    // Continue the uploads, must be called once per frame on the context thread
+    void update();
+
+    // Check if some models are still loading
+    inline bool isBusy() const noexcept {
+        return m_pending.load() > 0;
+    }
+
+    // Get byte budget per update
+    inline std::size_t getFrameBudget() const noexcept {
+        return m_frame_budget;
+    }
+
+    // Destroy loader, waits for the running import and releases the meshes not resident yet with the host memory of
+    // every job. Imports not started yet are skipped
+    void destroy();
+};
+
+#endif //OPENGLPLAYGROUND_MODELLOADER_HPP
@@ -0,0 +1,177 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "ObjectTransforms.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Objects per task when computing on the thread pool
+constexpr std::size_t TRANSFORMS_TASK_SIZE = 4096;
+// Objects fitting in a region of the ring initially, it grows with the number of objects
+constexpr std::size_t TRANSFORMS_INITIAL_OBJECTS = 256;
+
+#if defined(__SSE2__)
+
+// Product of two column major matrices, each column of the result is a combination of the columns of a
+inline void multiply(const float *a, const float *b, float *result) {
+    const __m128 a0 = _mm_loadu_ps(a);
+    const __m128 a1 = _mm_loadu_ps(a + 4);
+    const __m128 a2 = _mm_loadu_ps(a + 8);
+    const __m128 a3 = _mm_loadu_ps(a + 12);
+    for (std::size_t c = 0; c < 4; ++c) {
+        const float *column = b + 4 * c;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(column[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(column[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(column[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(column[3])));
+        _mm_storeu_ps(result + 4 * c, r);
+    }
+}
+
+// Cross product of the xyz parts, w is 0
+inline __m128 cross(__m128 a, __m128 b) {
+    const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// Inverse transpose of the upper 3x3 of m. Its columns are the cross products of the columns of m divided by the
+// determinant, no general inverse is needed
+inline void normalMatrix(const float *m, glm::vec4 *result) {
+    const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    const __m128 c0 = _mm_and_ps(_mm_loadu_ps(m), xyz);
+    const __m128 c1 = _mm_and_ps(_mm_loadu_ps(m + 4), xyz);
+    const __m128 c2 = _mm_and_ps(_mm_loadu_ps(m + 8), xyz);
+    const __m128 r0 = cross(c1, c2);
+    const __m128 r1 = cross(c2, c0);
+    const __m128 r2 = cross(c0, c1);
+    // Determinant is the dot product of c0 and r0
+    float d[4];
+    _mm_storeu_ps(d, _mm_mul_ps(c0, r0));
+    const float det = d[0] + d[1] + d[2];
+    // Singular matrices keep the cofactors, the shaders normalise the normals anyway
+    const __m128 inv_det = _mm_set1_ps(std::fabs(det) > 1e-30f ? 1.f / det : 1.f);
+    _mm_storeu_ps(&result[0][0], _mm_mul_ps(r0, inv_det));
+    _mm_storeu_ps(&result[1][0], _mm_mul_ps(r1, inv_det));
+    _mm_storeu_ps(&result[2][0], _mm_mul_ps(r2, inv_det));
+}
+
+#else
+
+// Product of two column major matrices
+inline void multiply(const float *a, const float *b, float *result) {
+    for (std::size_t c = 0; c < 4; ++c) {
+        for (std::size_t r = 0; r < 4; ++r) {
+            result[4 * c + r] = a[r] * b[4 * c] + a[4 + r] * b[4 * c + 1] + a[8 + r] * b[4 * c + 2] +
+                                a[12 + r] * b[4 * c + 3];
+        }
+    }
+}
+
+// Inverse transpose of the upper 3x3 of m, columns are the cross products of the columns of m
+inline void normalMatrix(const float *m, glm::vec4 *result) {
+    const glm::vec3 c0(m[0], m[1], m[2]);
+    const glm::vec3 c1(m[4], m[5], m[6]);
+    const glm::vec3 c2(m[8], m[9], m[10]);
+    const glm::vec3 r0 = glm::cross(c1, c2);
+    const float det = glm::dot(c0, r0);
+    const float inv_det = std::fabs(det) > 1e-30f ? 1.f / det : 1.f;
+    result[0] = glm::vec4(r0 * inv_det, 0.f);
+    result[1] = glm::vec4(glm::cross(c2, c0) * inv_det, 0.f);
+    result[2] = glm::vec4(glm::cross(c0, c1) * inv_det, 0.f);
+}
+
+#endif
+
+} // namespace
+
+ObjectTransforms::ObjectTransforms()
+        : m_ring(GL_UNIFORM_BUFFER, TRANSFORMS_INITIAL_OBJECTS * sizeof(ObjectConstants)), m_stride(0),
+          m_constants(nullptr), m_offset(0) {
+    // Ranges bound to a block must start on the alignment
+    const std::size_t alignment = m_ring.getAlignment();
+    m_stride = (sizeof(ObjectConstants) + alignment - 1) / alignment * alignment;
+    m_ring.reserve(TRANSFORMS_INITIAL_OBJECTS * m_stride);
+}
+
+void ObjectTransforms::destroy() {
+    m_ring.destroy();
+    m_models.clear();
+    m_constants = nullptr;
+}
+
+void ObjectTransforms::setupProgram(const Program& program) {
+    const GLuint index = glGetUniformBlockIndex(program.getID(), "Object");
+    if (index == GL_INVALID_INDEX) {
+        std::cerr << "Error getting Object uniform block index\n";
+        exit(EXIT_FAILURE);
+    }
+    glUniformBlockBinding(program.getID(), index, OBJECT_BLOCK_BINDING);
+    GL_CHECK();
+}
+
+void ObjectTransforms::computeNormalMatrix(const glm::mat4& m, glm::vec4 *result) {
+    normalMatrix(&m[0][0], result);
+}
+
+void ObjectTransforms::clear() {
+    m_models.clear();
+}
+
+std::size_t ObjectTransforms::add(const glm::mat4& model) {
+    m_models.push_back(model);
+    return m_models.size() - 1;
+}
+
+void ObjectTransforms::update(const glm::mat4& view, const glm::mat4& proj) {
+    // Region of the previous frame is fenced even when there is nothing to draw
+    m_ring.beginFrame();
+    if (m_models.empty()) {
+        return;
+    }
+    const std::size_t size = m_models.size() * m_stride;
+    if (size > m_ring.getFrameSize()) {
+        m_ring.reserve(std::max(size, 2 * m_ring.getFrameSize()));
+    }
+    const RingAllocation allocation = m_ring.allocate(size);
+    unsigned char *constants = allocation.data;
+    m_constants = constants;
+    m_offset = allocation.offset;
+
+    glm::mat4 view_proj;
+    multiply(&proj[0][0], &view[0][0], &view_proj[0][0]);
+    // One pass over the models, large sets are split across the thread pool. Results go straight to the region, in
+    // order, which suits write combined mapped memory
+    const std::size_t num_tasks = (m_models.size() + TRANSFORMS_TASK_SIZE - 1) / TRANSFORMS_TASK_SIZE;
+    ThreadPool::getGlobal().parallelFor(num_tasks, [&](std::size_t task) {
+        const std::size_t end = std::min(m_models.size(), (task + 1) * TRANSFORMS_TASK_SIZE);
+        for (std::size_t i = task * TRANSFORMS_TASK_SIZE; i < end; ++i) {
+            const float *model = &m_models[i][0][0];
+            ObjectConstants result;
+            multiply(&view[0][0], model, &result.model_view[0][0]);
+            multiply(&view_proj[0][0], model, &result.mvp[0][0]);
+            normalMatrix(&result.model_view[0][0], result.normal_view);
+            normalMatrix(model, result.normal_model);
+            std::memcpy(constants + i * m_stride, &result, sizeof(ObjectConstants));
+        }
+    });
+
+    // Only uploads when the buffer is not persistently mapped
+    m_ring.flush();
+}
+
+void ObjectTransforms::bind(std::size_t index) const {
+    GLState::getGlobal().bindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BLOCK_BINDING, m_ring.getBuffer().getID(),
+                                         static_cast<GLintptr>(m_offset + index * m_stride), sizeof(ObjectConstants));
+}
@@ -0,0 +1,88 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_OBJECTTRANSFORMS_HPP
+#define OPENGLPLAYGROUND_OBJECTTRANSFORMS_HPP
+
+#include "RingBuffer.hpp"
+#include "Shader.hpp"
+
+#include <glm/glm.hpp>
+
+// Binding point of the Object uniform block, Matrices keeps the default 0
+constexpr GLuint OBJECT_BLOCK_BINDING = 1;
+
+// Matrices of one object as laid out in the Object uniform block with std140
+struct ObjectConstants {
+    // Object to camera
+    glm::mat4 model_view;
+    // Object to clip
+    glm::mat4 mvp;
+    // Inverse transpose of the upper 3x3 of model_view and of model, std140 stores the mat3 columns as vec4
+    glm::vec4 normal_view[3];
+    glm::vec4 normal_model[3];
+};
+
+// Per frame matrices of all the drawn objects. Objects are added with their model matrix, update computes the derived
+// matrices of all of them in one SIMD pass, written straight into a ring buffer region. Each object is bound as a
+// range of the buffer, so the shaders do not invert matrices per vertex
+class ObjectTransforms {
+private:
+    // Model matrix of each object
+    std::vector<glm::mat4> m_models;
+    // Uniform ring buffer the constants are written to, one region per frame
+    RingBuffer m_ring;
+    // Distance between two objects in the buffer, rounded up to the uniform buffer offset alignment
+    std::size_t m_stride;
+    // Constants written by the last update and their offset in the buffer
+    const unsigned char *m_constants;
+    std::size_t m_offset;
+
+public:
+    // Create empty set, needs the context for the offset alignment
+    ObjectTransforms();
+
+    // Destroy buffer
+    void destroy();
+
+    // Assign the Object block of a linked program to OBJECT_BLOCK_BINDING, before prefetching the block
+    static void setupProgram(const Program& program);
+
+    // Compute the inverse transpose of the upper 3x3 of a matrix, columns stored as vec4 like in ObjectConstants
+    static void computeNormalMatrix(const glm::mat4& m, glm::vec4 *result);
+
+    // Remove all the objects
+    void clear();
+
+    // Add object, returns its index
+    std::size_t add(const glm::mat4& model);
+
+    // Replace model matrix of an object
+    inline void set(std::size_t index, const glm::mat4& model) {
+        m_models[index] = model;
+    }
+
+    // Get number of objects
+    inline std::size_t size() const noexcept {
+        return m_models.size();
+    }
+
+    // Get model matrix of an object
+    inline const glm::mat4& getModel(std::size_t index) const {
+        return m_models[index];
+    }
+
+    // Get constants computed by the last update, may read from mapped memory which is slow
+    inline const ObjectConstants& getConstants(std::size_t index) const {
+        return *reinterpret_cast<const ObjectConstants *>(m_constants + index * m_stride);
+    }
+
+    // Compute the constants of all the objects into the next region of the ring, once per frame
+    void update(const glm::mat4& view, const glm::mat4& proj);
+
+    // Bind the constants of an object to the Object block
+    void bind(std::size_t index) const;
+};
+
+#endif //OPENGLPLAYGROUND_OBJECTTRANSFORMS_HPP
@@ -0,0 +1,705 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "OcclusionCulling.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Levels below the first tested level a box test may refine to, bounds the cost of the tests of visible boxes
+constexpr std::size_t OCCLUSION_REFINED_LEVELS = 2;
+// Largest distance in depth of the fourth vertex of a quad to the plane of the others, for two triangles to be drawn
+// as one quad. The depth of the quad is raised by that distance
+constexpr float OCCLUSION_QUAD_FLATNESS = 1e-4f;
+// Cells of the voxel grid along the longest side of a mesh when fitting boxes inside it
+constexpr std::size_t OCCLUDER_GRID_RESOLUTION = 48;
+// Boxes fitted inside a mesh too large to be an occluder
+constexpr std::size_t OCCLUDER_MAX_BOXES = 8;
+
+// Triangles of a box from its corners, corner i has the maximum along x, y and z for the bits 0, 1 and 2 of i
+constexpr std::uint32_t BOX_INDICES[36] = {0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4,
+                                           2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5};
+
+// Linear function a * x + b * y + c of the pixel position
+struct PixelFunction {
+    float a;
+    float b;
+    float c;
+};
+
+// Edge function of the segment from p to q, positive on the left side. It is always computed from the same endpoint
+// so the two triangles sharing an edge get exactly opposite values, no pixel center falls between them
+inline PixelFunction edgeFunction(const glm::vec4& p, const glm::vec4& q) {
+    if (q.x < p.x || (q.x == p.x && q.y < p.y)) {
+        const PixelFunction f = edgeFunction(q, p);
+        return {-f.a, -f.b, -f.c};
+    }
+    const float a = -(q.y - p.y);
+    const float b = q.x - p.x;
+    return {a, b, -(a * p.x + b * p.y)};
+}
+
+// Largest change of a pixel function between the center of a pixel and one of its corners
+inline float cornerOffset(const PixelFunction& f) {
+    return 0.5f * (std::fabs(f.a) + std::fabs(f.b));
+}
+
+// Check if a vertex was flagged as in front of the near plane
+inline bool isClipped(const glm::vec4& v) {
+    return v.w != 0.f;
+}
+
+// Find the quad formed by two consecutive triangles sharing an edge, in the winding of the first one
+bool findQuad(const std::uint32_t *indices, std::uint32_t *quad) {
+    for (std::size_t k = 0; k < 3; ++k) {
+        // Edge from the vertex k + 1 to k + 2 of the first triangle, shared when the second one has it reversed
+        const std::uint32_t p = indices[(k + 1) % 3];
+        const std::uint32_t q = indices[(k + 2) % 3];
+        for (std::size_t l = 0; l < 3; ++l) {
+            if (indices[3 + l] == q && indices[3 + (l + 1) % 3] == p) {
+                quad[0] = indices[k];
+                quad[1] = p;
+                quad[2] = indices[3 + (l + 2) % 3];
+                quad[3] = q;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Check if a quad in screen space turns the same way at its four corners and if its fourth vertex is close to the
+// depth plane of the others
+bool isFlatConvexQuad(const glm::vec4 *const *quad) {
+    float turns[4];
+    for (std::size_t v = 0; v < 4; ++v) {
+        const glm::vec4& p = *quad[v];
+        const glm::vec4& q = *quad[(v + 1) % 4];
+        const glm::vec4& r = *quad[(v + 2) % 4];
+        turns[v] = (q.x - p.x) * (r.y - q.y) - (q.y - p.y) * (r.x - q.x);
+    }
+    const bool convex = (turns[0] > 0.f && turns[1] > 0.f && turns[2] > 0.f && turns[3] > 0.f) ||
+                        (turns[0] < 0.f && turns[1] < 0.f && turns[2] < 0.f && turns[3] < 0.f);
+    if (!convex) {
+        return false;
+    }
+    // Depth of the fourth vertex on the plane of the first three, from its barycentric coordinates
+    const glm::vec4& a = *quad[0];
+    const glm::vec4& b = *quad[1];
+    const glm::vec4& c = *quad[2];
+    const glm::vec4& d = *quad[3];
+    const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    const float u = ((d.x - a.x) * (c.y - a.y) - (d.y - a.y) * (c.x - a.x)) / area;
+    const float v = ((b.x - a.x) * (d.y - a.y) - (b.y - a.y) * (d.x - a.x)) / area;
+    return std::fabs(a.z + u * (b.z - a.z) + v * (c.z - a.z) - d.z) <= OCCLUSION_QUAD_FLATNESS;
+}
+
+// Indices of the triangles of the full resolution level of a mesh, with the base vertices added
+std::vector<std::uint32_t> getLevelIndices(const MeshDataView& view) {
+    // Ranges of the full resolution level, the whole index buffer when there are none. The simplified levels fill
+    // concavities and move the silhouette, they are not inside the surface and would hide visible objects
+    const DrawRange whole{0, static_cast<GLuint>(view.num_indices), 0};
+    const DrawRange *ranges = view.num_ranges > 0 ? view.ranges : &whole;
+    std::size_t first_range = 0;
+    std::size_t num_ranges = view.num_ranges > 0 ? view.num_ranges : 1;
+    if (view.num_lods > 0) {
+        first_range = view.lods[0].first_range;
+        num_ranges = view.lods[0].num_ranges;
+    }
+
+    std::vector<std::uint32_t> indices;
+    for (std::size_t r = first_range; r < first_range + num_ranges; ++r) {
+        const DrawRange& range = ranges[r];
+        for (GLuint i = range.first_index; i < range.first_index + range.num_indices; ++i) {
+            indices.push_back(view.indices[i] + range.base_vertex);
+        }
+    }
+    return indices;
+}
+
+// Voxel grid over the bounds of a mesh, cells are cubes
+struct VoxelGrid {
+    // Corner of the first cell
+    glm::vec3 origin;
+    // Side of a cell
+    float cell_size;
+    // Number of cells along each axis
+    std::size_t size[3];
+
+    // Index of a cell
+    inline std::size_t index(const std::size_t *cell) const noexcept {
+        return (cell[2] * size[1] + cell[1]) * size[0] + cell[0];
+    }
+
+    // Cell of a coordinate along an axis, clamped to the grid
+    inline std::size_t clampCell(std::size_t axis, float coordinate) const noexcept {
+        const float cell = std::floor((coordinate - origin[axis]) / cell_size);
+        return static_cast<std::size_t>(std::min(std::max(cell, 0.f), static_cast<float>(size[axis] - 1)));
+    }
+};
+
+// Find the cells of the grid that are inside the mesh and that no triangle reaches. Such a cell is on one side of the
+// surface as a whole, so it is entirely inside when its center is. The center is tested by counting the crossings of
+// rays along the three axes, all three must agree
+std::vector<bool> findInsideCells(const VoxelGrid& grid, const Vertex *vertices,
+                                  const std::vector<std::uint32_t>& indices) {
+    const std::size_t num_cells = grid.size[0] * grid.size[1] * grid.size[2];
+    std::vector<bool> touched(num_cells, false);
+    std::vector<std::uint8_t> votes(num_cells, 0);
+
+    // Cells overlapping the bounding box of a triangle, grown by a small margin against rounding
+    const float margin = 1e-3f * grid.cell_size;
+    for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::vec3& p0 = vertices[indices[i]].position;
+        const glm::vec3& p1 = vertices[indices[i + 1]].position;
+        const glm::vec3& p2 = vertices[indices[i + 2]].position;
+        std::size_t lo[3];
+        std::size_t hi[3];
+        for (std::size_t a = 0; a < 3; ++a) {
+            lo[a] = grid.clampCell(a, std::min(p0[a], std::min(p1[a], p2[a])) - margin);
+            hi[a] = grid.clampCell(a, std::max(p0[a], std::max(p1[a], p2[a])) + margin);
+        }
+        std::size_t cell[3];
+        for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2]) {
+            for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1]) {
+                for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0]) {
+                    touched[grid.index(cell)] = true;
+                }
+            }
+        }
+    }
+
+    // Rays along axis a go through the centers of the cells, one per column of the two other axes
+    std::vector<std::vector<float>> crossings;
+    for (std::size_t a = 0; a < 3; ++a) {
+        const std::size_t b = (a + 1) % 3;
+        const std::size_t c = (a + 2) % 3;
+        crossings.assign(grid.size[b] * grid.size[c], std::vector<float>());
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const glm::vec3& p0 = vertices[indices[i]].position;
+            const glm::vec3 e1 = vertices[indices[i + 1]].position - p0;
+            const glm::vec3 e2 = vertices[indices[i + 2]].position - p0;
+            // Triangles parallel to the rays are never crossed
+            const float area = e1[b] * e2[c] - e1[c] * e2[b];
+            if (!(std::fabs(area) > 0.f)) {
+                continue;
+            }
+            const float min_b = p0[b] + std::min(0.f, std::min(e1[b], e2[b]));
+            const float max_b = p0[b] + std::max(0.f, std::max(e1[b], e2[b]));
+            const float min_c = p0[c] + std::min(0.f, std::min(e1[c], e2[c]));
+            const float max_c = p0[c] + std::max(0.f, std::max(e1[c], e2[c]));
+            const std::size_t j0 = grid.clampCell(b, min_b - 0.5f * grid.cell_size);
+            const std::size_t j1 = grid.clampCell(b, max_b + 0.5f * grid.cell_size);
+            const std::size_t k0 = grid.clampCell(c, min_c - 0.5f * grid.cell_size);
+            const std::size_t k1 = grid.clampCell(c, max_c + 0.5f * grid.cell_size);
+            for (std::size_t k = k0; k <= k1; ++k) {
+                const float qc = grid.origin[c] + (static_cast<float>(k) + 0.5f) * grid.cell_size - p0[c];
+                for (std::size_t j = j0; j <= j1; ++j) {
+                    const float qb = grid.origin[b] + (static_cast<float>(j) + 0.5f) * grid.cell_size - p0[b];
+                    // Barycentric coordinates of the ray in the plane of the two other axes
+                    const float u = (qb * e2[c] - qc * e2[b]) / area;
+                    const float v = (e1[b] * qc - e1[c] * qb) / area;
+                    if (u >= 0.f && v >= 0.f && u + v <= 1.f) {
+                        crossings[k * grid.size[b] + j].push_back(p0[a] + u * e1[a] + v * e2[a]);
+                    }
+                }
+            }
+        }
+
+        // A center is inside when an odd number of crossings lie before it
+        std::size_t cell[3];
+        for (cell[c] = 0; cell[c] < grid.size[c]; ++cell[c]) {
+            for (cell[b] = 0; cell[b] < grid.size[b]; ++cell[b]) {
+                std::vector<float>& column = crossings[cell[c] * grid.size[b] + cell[b]];
+                std::sort(column.begin(), column.end());
+                std::size_t before = 0;
+                for (cell[a] = 0; cell[a] < grid.size[a]; ++cell[a]) {
+                    const float center = grid.origin[a] + (static_cast<float>(cell[a]) + 0.5f) * grid.cell_size;
+                    while (before < column.size() && column[before] < center) {
+                        ++before;
+                    }
+                    if (before % 2 == 1) {
+                        ++votes[grid.index(cell)];
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<bool> inside(num_cells, false);
+    for (std::size_t i = 0; i < num_cells; ++i) {
+        inside[i] = !touched[i] && votes[i] == 3;
+    }
+    return inside;
+}
+
+// Check if all the cells of a box of the grid are inside, bounds are inclusive
+bool isBoxInside(const VoxelGrid& grid, const std::vector<bool>& inside, const std::size_t *lo, const std::size_t *hi) {
+    std::size_t cell[3];
+    for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2]) {
+        for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1]) {
+            for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0]) {
+                if (!inside[grid.index(cell)]) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Chessboard distance of each inside cell to the closest cell outside or to the border of the grid, 0 outside. Two
+// passes over the 26 neighbours, the first one looks at the neighbours already visited, the second at the others
+std::vector<std::uint32_t> computeInsideDistances(const VoxelGrid& grid, const std::vector<bool>& inside) {
+    const std::size_t num_cells = inside.size();
+    std::vector<std::uint32_t> distances(num_cells);
+    for (std::size_t i = 0; i < num_cells; ++i) {
+        distances[i] = inside[i] ? std::numeric_limits<std::uint32_t>::max() : 0;
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        const long step = pass == 0 ? 1 : -1;
+        for (std::size_t n = 0; n < num_cells; ++n) {
+            const std::size_t i = pass == 0 ? n : num_cells - 1 - n;
+            if (distances[i] == 0) {
+                continue;
+            }
+            const long x = static_cast<long>(i % grid.size[0]);
+            const long y = static_cast<long>(i / grid.size[0] % grid.size[1]);
+            const long z = static_cast<long>(i / (grid.size[0] * grid.size[1]));
+            std::uint32_t distance = distances[i];
+            for (long dz = -1; dz <= 1; ++dz) {
+                for (long dy = -1; dy <= 1; ++dy) {
+                    for (long dx = -1; dx <= 1; ++dx) {
+                        // Only the neighbours before the cell in the order of the pass
+                        const long order = (dz * 3 + dy) * 3 + dx;
+                        if (order * step >= 0) {
+                            continue;
+                        }
+                        const long nx = x + dx;
+                        const long ny = y + dy;
+                        const long nz = z + dz;
+                        std::uint32_t neighbour = 0;
+                        if (nx >= 0 && ny >= 0 && nz >= 0 && nx < static_cast<long>(grid.size[0]) &&
+                            ny < static_cast<long>(grid.size[1]) && nz < static_cast<long>(grid.size[2])) {
+                            neighbour = distances[(nz * grid.size[1] + ny) * grid.size[0] + nx];
+                        }
+                        distance = std::min(distance, neighbour + 1);
+                    }
+                }
+            }
+            distances[i] = distance;
+        }
+    }
+    return distances;
+}
+
+} // namespace
+
+OccluderMesh OccluderMesh::fromView(const MeshDataView& view, std::size_t max_triangles) {
+    OccluderMesh occluder;
+    const std::vector<std::uint32_t> indices = getLevelIndices(view);
+    if (indices.empty()) {
+        return occluder;
+    }
+    if (indices.size() / 3 > max_triangles) {
+        return fromInnerBoxes(view, std::min(OCCLUDER_MAX_BOXES, max_triangles / 12));
+    }
+
+    // Keep only the vertices used by the level
+    std::vector<std::uint32_t> remap(view.num_vertices, std::numeric_limits<std::uint32_t>::max());
+    occluder.indices.reserve(indices.size());
+    for (const std::uint32_t vertex : indices) {
+        if (remap[vertex] == std::numeric_limits<std::uint32_t>::max()) {
+            remap[vertex] = static_cast<std::uint32_t>(occluder.positions.size());
+            occluder.positions.push_back(view.vertices[vertex].position);
+        }
+        occluder.indices.push_back(remap[vertex]);
+    }
+    return occluder;
+}
+
+OccluderMesh OccluderMesh::fromInnerBoxes(const MeshDataView& view, std::size_t max_boxes) {
+    OccluderMesh occluder;
+    const std::vector<std::uint32_t> indices = getLevelIndices(view);
+    if (indices.empty() || max_boxes == 0) {
+        return occluder;
+    }
+
+    // Grid over the bounds of the level with cubic cells
+    glm::vec3 min_position(std::numeric_limits<float>::max());
+    glm::vec3 max_position(std::numeric_limits<float>::lowest());
+    for (const std::uint32_t vertex : indices) {
+        min_position = glm::min(min_position, view.vertices[vertex].position);
+        max_position = glm::max(max_position, view.vertices[vertex].position);
+    }
+    const glm::vec3 extent = max_position - min_position;
+    const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+    if (!(longest > 0.f)) {
+        return occluder;
+    }
+    VoxelGrid grid{min_position, longest / static_cast<float>(OCCLUDER_GRID_RESOLUTION), {1, 1, 1}};
+    for (std::size_t a = 0; a < 3; ++a) {
+        const auto cells = static_cast<std::size_t>(std::ceil(extent[a] / grid.cell_size));
+        grid.size[a] = std::min(OCCLUDER_GRID_RESOLUTION, std::max<std::size_t>(1, cells));
+    }
+    const std::vector<bool> inside = findInsideCells(grid, view.vertices, indices);
+    const std::vector<std::uint32_t> distances = computeInsideDistances(grid, inside);
+
+    // Greedy boxes: each one starts from the cell farthest from the surface not yet in a box, then grows one layer
+    // at a time along the six directions while the layer is inside. Boxes may overlap
+    std::vector<bool> covered(inside.size(), false);
+    for (std::size_t box = 0; box < max_boxes; ++box) {
+        std::size_t seed = inside.size();
+        for (std::size_t i = 0; i < inside.size(); ++i) {
+            if (distances[i] > 0 && !covered[i] && (seed == inside.size() || distances[i] > distances[seed])) {
+                seed = i;
+            }
+        }
+        if (seed == inside.size()) {
+            break;
+        }
+        std::size_t lo[3] = {seed % grid.size[0], seed / grid.size[0] % grid.size[1],
+                             seed / (grid.size[0] * grid.size[1])};
+        std::size_t hi[3] = {lo[0], lo[1], lo[2]};
+        bool grown = true;
+        while (grown) {
+            grown = false;
+            for (std::size_t a = 0; a < 3; ++a) {
+                // Layer below the box then above it
+                if (lo[a] > 0) {
+                    std::size_t layer_lo[3] = {lo[0], lo[1], lo[2]};
+                    std::size_t layer_hi[3] = {hi[0], hi[1], hi[2]};
+                    layer_lo[a] = layer_hi[a] = lo[a] - 1;
+                    if (isBoxInside(grid, inside, layer_lo, layer_hi)) {
+                        --lo[a];
+                        grown = true;
+                    }
+                }
+                if (hi[a] + 1 < grid.size[a]) {
+                    std::size_t layer_lo[3] = {lo[0], lo[1], lo[2]};
+                    std::size_t layer_hi[3] = {hi[0], hi[1], hi[2]};
+                    layer_lo[a] = layer_hi[a] = hi[a] + 1;
+                    if (isBoxInside(grid, inside, layer_lo, layer_hi)) {
+                        ++hi[a];
+                        grown = true;
+                    }
+                }
+            }
+        }
+
+        std::size_t cell[3];
+        for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2]) {
+            for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1]) {
+                for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0]) {
+                    covered[grid.index(cell)] = true;
+                }
+            }
+        }
+        const auto first_corner = static_cast<std::uint32_t>(occluder.positions.size());
+        for (std::size_t corner = 0; corner < 8; ++corner) {
+            glm::vec3 position;
+            for (std::size_t a = 0; a < 3; ++a) {
+                const std::size_t bound = (corner >> a) & 1 ? hi[a] + 1 : lo[a];
+                position[a] = grid.origin[a] + static_cast<float>(bound) * grid.cell_size;
+            }
+            occluder.positions.push_back(position);
+        }
+        for (const std::uint32_t index : BOX_INDICES) {
+            occluder.indices.push_back(first_corner + index);
+        }
+    }
+    return occluder;
+}
+
+OcclusionBuffer::OcclusionBuffer(std::size_t width, std::size_t height)
+        : m_width((std::max<std::size_t>(width, 4) + 3) / 4 * 4), m_height(std::max<std::size_t>(height, 1)),
+          m_num_valid_levels(1), m_statistics() {
+    // Halve the size down to a single texel
+    std::size_t w = m_width;
+    std::size_t h = m_height;
+    while (true) {
+        m_levels.emplace_back(w * h, 1.f);
+        m_level_widths.push_back(w);
+        m_level_heights.push_back(h);
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+}
+
+void OcclusionBuffer::clear() {
+    std::fill(m_levels[0].begin(), m_levels[0].end(), 1.f);
+    m_num_valid_levels = 1;
+    m_statistics = OcclusionStatistics();
+}
+
+void OcclusionBuffer::renderOccluder(const OccluderMesh& occluder, const glm::mat4& mvp) {
+    renderOccluder(occluder.positions.data(), occluder.indices.data(), occluder.indices.size(), mvp);
+}
+
+void OcclusionBuffer::renderOccluder(const glm::vec3 *positions, const std::uint32_t *indices,
+                                     std::size_t num_indices, const glm::mat4& mvp) {
+    // Vertices are projected once, the highest index gives their number
+    std::size_t num_vertices = 0;
+    for (std::size_t i = 0; i < num_indices; ++i) {
+        num_vertices = std::max<std::size_t>(num_vertices, indices[i] + 1);
+    }
+    m_screen.resize(num_vertices);
+    const float width = static_cast<float>(m_width);
+    const float height = static_cast<float>(m_height);
+    for (std::size_t v = 0; v < num_vertices; ++v) {
+        const glm::vec4 clip = mvp * glm::vec4(positions[v], 1.f);
+        if (clip.w <= 0.f || clip.z < -clip.w) {
+            m_screen[v] = glm::vec4(0.f, 0.f, 0.f, 1.f);
+            continue;
+        }
+        const float inv_w = 1.f / clip.w;
+        m_screen[v] = glm::vec4((clip.x * inv_w * 0.5f + 0.5f) * width, (clip.y * inv_w * 0.5f + 0.5f) * height,
+                                clip.z * inv_w * 0.5f + 0.5f, 0.f);
+    }
+
+    for (std::size_t i = 0; i + 2 < num_indices; i += 3) {
+        const glm::vec4 *triangle[3] = {&m_screen[indices[i]], &m_screen[indices[i + 1]], &m_screen[indices[i + 2]]};
+        // Clipping would only shrink the occluder, so skipping the triangle stays conservative
+        if (isClipped(*triangle[0]) || isClipped(*triangle[1]) || isClipped(*triangle[2])) {
+            continue;
+        }
+        // A triangle and the next one forming a flat convex quad are drawn together, the pixels along their shared
+        // edge are covered by neither of them alone
+        std::uint32_t quad[4];
+        if (i + 5 < num_indices && findQuad(indices + i, quad)) {
+            const glm::vec4 *polygon[4] = {&m_screen[quad[0]], &m_screen[quad[1]], &m_screen[quad[2]],
+                                           &m_screen[quad[3]]};
+            if (!isClipped(*polygon[3]) && isFlatConvexQuad(polygon)) {
+                rasterizePolygon(polygon, 4);
+                i += 3;
+                continue;
+            }
+        }
+        rasterizePolygon(triangle, 3);
+    }
+    m_num_valid_levels = 1;
+}
+
+void OcclusionBuffer::rasterizePolygon(const glm::vec4 *const *vertices, std::size_t count) {
+    // Both windings are drawn, reversing the vertices makes the area positive
+    float area = 0.f;
+    for (std::size_t v = 0; v < count; ++v) {
+        const glm::vec4& p = *vertices[v];
+        const glm::vec4& q = *vertices[(v + 1) % count];
+        area += p.x * q.y - p.y * q.x;
+    }
+    if (!(std::fabs(area) > 1e-12f)) {
+        return;
+    }
+    const glm::vec4 *polygon[4];
+    for (std::size_t v = 0; v < count; ++v) {
+        polygon[v] = area > 0.f ? vertices[v] : vertices[count - 1 - v];
+    }
+    const glm::vec4& a = *polygon[0];
+    const glm::vec4& b = *polygon[1];
+    const glm::vec4& c = *polygon[2];
+
+    // Pixels whose center is in the bounding box of the polygon, a superset of the pixels it fully covers
+    float min_x = a.x;
+    float max_x = a.x;
+    float min_y = a.y;
+    float max_y = a.y;
+    for (std::size_t v = 1; v < count; ++v) {
+        min_x = std::min(min_x, polygon[v]->x);
+        max_x = std::max(max_x, polygon[v]->x);
+        min_y = std::min(min_y, polygon[v]->y);
+        max_y = std::max(max_y, polygon[v]->y);
+    }
+    const long x0 = std::max(0L, static_cast<long>(std::ceil(min_x - 0.5f)));
+    const long x1 = std::min(static_cast<long>(m_width) - 1, static_cast<long>(std::floor(max_x - 0.5f)));
+    const long y0 = std::max(0L, static_cast<long>(std::ceil(min_y - 0.5f)));
+    const long y1 = std::min(static_cast<long>(m_height) - 1, static_cast<long>(std::floor(max_y - 0.5f)));
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    ++m_statistics.rasterized_triangles;
+
+    // Depth over the first three vertices is linear in screen space, each edge function of their triangle is the
+    // barycentric coordinate of the opposite vertex times the area. A fourth vertex off the plane raises the depth
+    const PixelFunction t0 = edgeFunction(b, c);
+    const PixelFunction t1 = edgeFunction(c, a);
+    const PixelFunction t2 = edgeFunction(a, b);
+    const float inv_area = 1.f / (t0.a * a.x + t0.b * a.y + t0.c);
+    PixelFunction z{(t0.a * a.z + t1.a * b.z + t2.a * c.z) * inv_area,
+                    (t0.b * a.z + t1.b * b.z + t2.b * c.z) * inv_area,
+                    (t0.c * a.z + t1.c * b.z + t2.c * c.z) * inv_area};
+    if (count == 4) {
+        const glm::vec4& d = *polygon[3];
+        z.c += std::fabs(d.z - (z.a * d.x + z.b * d.y + z.c));
+    }
+
+    // Edges of the polygon, a triangle gets a fourth edge that is always positive
+    PixelFunction e0 = edgeFunction(a, b);
+    PixelFunction e1 = edgeFunction(b, c);
+    PixelFunction e2 = edgeFunction(c, count == 4 ? *polygon[3] : a);
+    PixelFunction e3 = count == 4 ? edgeFunction(*polygon[3], a) : PixelFunction{0.f, 0.f, 1.f};
+
+    // Conservative coverage: the edges are moved inwards by half a pixel along both axes, so a pixel passes at its
+    // center only when its four corners are inside the polygon. It then gets the farthest depth of the polygon over
+    // the pixel, objects seen past the edges or between two occluder polygons are never hidden
+    e0.c -= cornerOffset(e0);
+    e1.c -= cornerOffset(e1);
+    e2.c -= cornerOffset(e2);
+    e3.c -= cornerOffset(e3);
+    z.c += cornerOffset(z);
+
+    std::vector<float>& depth = m_levels[0];
+    // Rows are walked by blocks of 4 pixels, the width is a multiple of 4 so blocks never leave the row
+    const long first_block = x0 & ~3L;
+#if defined(__SSE2__)
+    const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 e0_a = _mm_set1_ps(e0.a);
+    const __m128 e1_a = _mm_set1_ps(e1.a);
+    const __m128 e2_a = _mm_set1_ps(e2.a);
+    const __m128 e3_a = _mm_set1_ps(e3.a);
+    const __m128 z_a = _mm_set1_ps(z.a);
+    for (long y = y0; y <= y1; ++y) {
+        const float py = static_cast<float>(y) + 0.5f;
+        const __m128 e0_row = _mm_set1_ps(e0.b * py + e0.c);
+        const __m128 e1_row = _mm_set1_ps(e1.b * py + e1.c);
+        const __m128 e2_row = _mm_set1_ps(e2.b * py + e2.c);
+        const __m128 e3_row = _mm_set1_ps(e3.b * py + e3.c);
+        const __m128 z_row = _mm_set1_ps(z.b * py + z.c);
+        float *row = depth.data() + y * m_width;
+        for (long x = first_block; x <= x1; x += 4) {
+            const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), offsets);
+            const __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e0_a, px), e0_row), zero),
+                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e1_a, px), e1_row), zero)),
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e2_a, px), e2_row), zero),
+                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(e3_a, px), e3_row), zero)));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            const __m128 old_depth = _mm_loadu_ps(row + x);
+            const __m128 new_depth = _mm_min_ps(old_depth, _mm_add_ps(_mm_mul_ps(z_a, px), z_row));
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, new_depth), _mm_andnot_ps(inside, old_depth)));
+        }
+    }
+#else
+    for (long y = y0; y <= y1; ++y) {
+        const float py = static_cast<float>(y) + 0.5f;
+        float *row = depth.data() + y * m_width;
+        for (long x = first_block; x <= x1; ++x) {
+            const float px = static_cast<float>(x) + 0.5f;
+            if (e0.a * px + e0.b * py + e0.c >= 0.f && e1.a * px + e1.b * py + e1.c >= 0.f &&
+                e2.a * px + e2.b * py + e2.c >= 0.f && e3.a * px + e3.b * py + e3.c >= 0.f) {
+                row[x] = std::min(row[x], z.a * px + z.b * py + z.c);
+            }
+        }
+    }
+#endif
+}
+
+void OcclusionBuffer::buildHierarchy() {
+    for (std::size_t l = 1; l < m_levels.size(); ++l) {
+        const std::vector<float>& fine = m_levels[l - 1];
+        std::vector<float>& coarse = m_levels[l];
+        const std::size_t fine_width = m_level_widths[l - 1];
+        const std::size_t fine_height = m_level_heights[l - 1];
+        for (std::size_t y = 0; y < m_level_heights[l]; ++y) {
+            // Odd sizes repeat the last row and column
+            const std::size_t y0 = 2 * y;
+            const std::size_t y1 = std::min(y0 + 1, fine_height - 1);
+            for (std::size_t x = 0; x < m_level_widths[l]; ++x) {
+                const std::size_t x0 = 2 * x;
+                const std::size_t x1 = std::min(x0 + 1, fine_width - 1);
+                coarse[y * m_level_widths[l] + x] =
+                        std::max(std::max(fine[y0 * fine_width + x0], fine[y0 * fine_width + x1]),
+                                 std::max(fine[y1 * fine_width + x0], fine[y1 * fine_width + x1]));
+            }
+        }
+    }
+    m_num_valid_levels = m_levels.size();
+}
+
+bool OcclusionBuffer::isRectOccluded(std::size_t level, std::size_t min_level, std::size_t x0, std::size_t y0,
+                                     std::size_t x1, std::size_t y1, float min_depth) const {
+    // Hidden if it is behind the farthest occluder depth of every texel
+    const std::vector<float>& depth = m_levels[level];
+    const std::size_t width = m_level_widths[level];
+    for (std::size_t y = y0 >> level; y <= (y1 >> level); ++y) {
+        for (std::size_t x = x0 >> level; x <= (x1 >> level); ++x) {
+            if (min_depth > depth[y * width + x]) {
+                continue;
+            }
+            // Part of the texel may still be covered, the pixels of the rectangle in it are tested one level down
+            if (level == min_level ||
+                !isRectOccluded(level - 1, min_level, std::max(x0, x << level), std::max(y0, y << level),
+                                std::min(x1, ((x + 1) << level) - 1), std::min(y1, ((y + 1) << level) - 1),
+                                min_depth)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool OcclusionBuffer::isOccluded(const AABB& box, const glm::mat4& mvp) const {
+    ++m_statistics.tested_boxes;
+    if (!box.isValid()) {
+        return false;
+    }
+
+    // Screen rectangle and closest depth of the corners
+    float min_x = std::numeric_limits<float>::max();
+    float min_y = std::numeric_limits<float>::max();
+    float max_x = -std::numeric_limits<float>::max();
+    float max_y = -std::numeric_limits<float>::max();
+    float min_depth = std::numeric_limits<float>::max();
+    for (std::size_t i = 0; i < 8; ++i) {
+        const glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y,
+                               (i & 4) ? box.max.z : box.min.z);
+        const glm::vec4 clip = mvp * glm::vec4(corner, 1.f);
+        if (clip.w <= 0.f || clip.z < -clip.w) {
+            return false;
+        }
+        const float inv_w = 1.f / clip.w;
+        const float x = (clip.x * inv_w * 0.5f + 0.5f) * static_cast<float>(m_width);
+        const float y = (clip.y * inv_w * 0.5f + 0.5f) * static_cast<float>(m_height);
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        min_depth = std::min(min_depth, clip.z * inv_w * 0.5f + 0.5f);
+    }
+    if (max_x < 0.f || max_y < 0.f || min_x >= static_cast<float>(m_width) || min_y >= static_cast<float>(m_height)) {
+        return false;
+    }
+
+    // Pixels touched by the rectangle
+    const std::size_t x0 = static_cast<std::size_t>(std::max(0.f, min_x));
+    const std::size_t y0 = static_cast<std::size_t>(std::max(0.f, min_y));
+    const std::size_t x1 = std::min(m_width - 1, static_cast<std::size_t>(max_x));
+    const std::size_t y1 = std::min(m_height - 1, static_cast<std::size_t>(max_y));
+
+    // Coarsest level where the rectangle spans at most 4x4 texels, texels failing there are refined a few levels down
+    std::size_t level = 0;
+    while (level + 1 < m_num_valid_levels &&
+           ((x1 >> level) - (x0 >> level) >= 4 || (y1 >> level) - (y0 >> level) >= 4)) {
+        ++level;
+    }
+    const std::size_t min_level = level > OCCLUSION_REFINED_LEVELS ? level - OCCLUSION_REFINED_LEVELS : 0;
+    if (!isRectOccluded(level, min_level, x0, y0, x1, y1, min_depth)) {
+        return false;
+    }
+    ++m_statistics.occluded_boxes;
+    return true;
+}
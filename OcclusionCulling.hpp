@@ -0,0 +1,126 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_OCCLUSIONCULLING_HPP
+#define OPENGLPLAYGROUND_OCCLUSIONCULLING_HPP
+
+#include "Mesh.hpp"
+#include "Bounds.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Mesh rasterized on the CPU to hide the objects behind it, it must lie inside the surface it stands for. Pixels
+// straddling an edge are left uncovered, even between two triangles of the mesh unless they form a flat convex quad,
+// so large triangles and quads hide the most
+struct OccluderMesh {
+    // Positions of the used vertices
+    std::vector<glm::vec3> positions;
+    // Triangle list
+    std::vector<std::uint32_t> indices;
+
+    // Build occluder from the full resolution level of a mesh. Levels with more than max_triangles triangles are
+    // replaced by boxes fitted inside them, 12 triangles each
+    static OccluderMesh fromView(const MeshDataView& view, std::size_t max_triangles);
+
+    // Build occluder from at most max_boxes boxes fitted inside the full resolution level of a closed mesh. The mesh
+    // is voxelized, only the cells no triangle comes near and found inside along the three axes are filled, so holes
+    // in the surface only lose boxes. Empty if no cell is inside
+    static OccluderMesh fromInnerBoxes(const MeshDataView& view, std::size_t max_boxes);
+
+    // Check if the occluder has any triangle
+    inline bool empty() const noexcept {
+        return indices.empty();
+    }
+};
+
+// Counters of the occlusion buffer since the last clear
+struct OcclusionStatistics {
+    // Triangles rasterized, not counting the ones rejected for crossing the near plane. Two triangles drawn as a quad
+    // count once
+    std::size_t rasterized_triangles;
+    // Boxes tested
+    std::size_t tested_boxes;
+    // Boxes found hidden
+    std::size_t occluded_boxes;
+};
+
+// Low resolution depth buffer filled with occluders on the CPU. Triangles are rasterized with SIMD edge functions,
+// four pixels at a time, only into the pixels they fully cover and with their farthest depth there. Then a hierarchy
+// keeping the farthest depth of each block lets boxes be tested against a few texels whatever their size on screen.
+// Everything runs on the host, no GL call is made
+class OcclusionBuffer {
+private:
+    // Size of the finest level, the width is a multiple of 4
+    std::size_t m_width;
+    std::size_t m_height;
+    // Depth in [0, 1] of each level, finest first. Level 0 is the rasterized depth, the others the farthest depth of
+    // the 2x2 texels below
+    std::vector<std::vector<float>> m_levels;
+    // Size of each level
+    std::vector<std::size_t> m_level_widths;
+    std::vector<std::size_t> m_level_heights;
+    // Number of levels up to date, only level 0 after rendering occluders
+    std::size_t m_num_valid_levels;
+    // Occluder vertices in screen space: x, y in pixels, depth and a flag set when in front of the near plane
+    std::vector<glm::vec4> m_screen;
+    // Counters, tests are const
+    mutable OcclusionStatistics m_statistics;
+
+    // Rasterize convex polygon of 3 or 4 vertices in screen space into the pixels it fully covers, keeps the closest
+    // depth. The depth is the plane of the first three vertices, raised to stay behind the fourth one
+    void rasterizePolygon(const glm::vec4 *const *vertices, std::size_t count);
+
+    // Check if the pixels [x0, x1] x [y0, y1] are all farther than min_depth, from the texels of level. Texels that do
+    // not hide the rectangle are refined down to min_level
+    bool isRectOccluded(std::size_t level, std::size_t min_level, std::size_t x0, std::size_t y0, std::size_t x1,
+                        std::size_t y1, float min_depth) const;
+
+public:
+    // Create buffer, the width is rounded up to a multiple of 4
+    explicit OcclusionBuffer(std::size_t width = 256, std::size_t height = 128);
+
+    // Reset depth to the far plane and the statistics
+    void clear();
+
+    // Rasterize occluder, mvp maps its positions to clip space. Triangles crossing the near plane are skipped
+    void renderOccluder(const OccluderMesh& occluder, const glm::mat4& mvp);
+
+    // Rasterize triangles given as positions and indices, e.g. to use other meshes as occluders
+    void renderOccluder(const glm::vec3 *positions, const std::uint32_t *indices, std::size_t num_indices,
+                        const glm::mat4& mvp);
+
+    // Build the coarser levels, to call after the occluders and before the tests
+    void buildHierarchy();
+
+    // Check if a box is entirely behind the occluders, mvp maps it to clip space. Boxes crossing the near plane or
+    // outside the screen are never reported as occluded
+    bool isOccluded(const AABB& box, const glm::mat4& mvp) const;
+
+    // Get size of the finest level
+    inline std::size_t getWidth() const noexcept {
+        return m_width;
+    }
+
+    inline std::size_t getHeight() const noexcept {
+        return m_height;
+    }
+
+    // Get number of levels
+    inline std::size_t getNumLevels() const noexcept {
+        return m_levels.size();
+    }
+
+    // Get depth of a texel of a level
+    inline float getDepth(std::size_t x, std::size_t y, std::size_t level = 0) const {
+        return m_levels[level][y * m_level_widths[level] + x];
+    }
+
+    // Get counters since the last clear
+    inline const OcclusionStatistics& getStatistics() const noexcept {
+        return m_statistics;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_OCCLUSIONCULLING_HPP
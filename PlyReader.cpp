@@ -0,0 +1,714 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "PlyReader.hpp"
+#include "FileIO.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Bytes decoded per task, binary vertices and ascii lines
+constexpr std::size_t PLY_CHUNK_SIZE = 1 << 20;
+
+enum class PlyFormat {
+    Ascii,
+    BinaryLittleEndian,
+    BinaryBigEndian
+};
+
+enum class PlyType {
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64,
+    Invalid
+};
+
+struct PlyProperty {
+    std::string name;
+    // Type of the value, of the items for lists
+    PlyType type;
+    // Type of the item count, Invalid if the property is not a list
+    PlyType count_type;
+
+    inline bool isList() const noexcept {
+        return count_type != PlyType::Invalid;
+    }
+};
+
+struct PlyElement {
+    std::string name;
+    std::size_t count = 0;
+    std::vector<PlyProperty> properties;
+
+    // Find property by name, returns -1 if there is none
+    inline int findProperty(const std::string& property_name) const {
+        for (std::size_t p = 0; p < properties.size(); ++p) {
+            if (properties[p].name == property_name) {
+                return static_cast<int>(p);
+            }
+        }
+        return -1;
+    }
+};
+
+struct PlyHeader {
+    PlyFormat format;
+    std::vector<PlyElement> elements;
+    // Offset of the first element after the header
+    std::size_t body_offset;
+};
+
+PlyType parseType(const std::string& name) {
+    if (name == "char" || name == "int8") {
+        return PlyType::Int8;
+    } else if (name == "uchar" || name == "uint8") {
+        return PlyType::UInt8;
+    } else if (name == "short" || name == "int16") {
+        return PlyType::Int16;
+    } else if (name == "ushort" || name == "uint16") {
+        return PlyType::UInt16;
+    } else if (name == "int" || name == "int32") {
+        return PlyType::Int32;
+    } else if (name == "uint" || name == "uint32") {
+        return PlyType::UInt32;
+    } else if (name == "float" || name == "float32") {
+        return PlyType::Float32;
+    } else if (name == "double" || name == "float64") {
+        return PlyType::Float64;
+    }
+    return PlyType::Invalid;
+}
+
+std::size_t getTypeSize(PlyType type) {
+    switch (type) {
+        case PlyType::Int8:
+        case PlyType::UInt8:
+            return 1;
+        case PlyType::Int16:
+        case PlyType::UInt16:
+            return 2;
+        case PlyType::Int32:
+        case PlyType::UInt32:
+        case PlyType::Float32:
+            return 4;
+        case PlyType::Float64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+// Size of a binary element, 0 if it contains lists
+std::size_t getElementStride(const PlyElement& element) {
+    std::size_t stride = 0;
+    for (const auto& property : element.properties) {
+        if (property.isList()) {
+            return 0;
+        }
+        stride += getTypeSize(property.type);
+    }
+    return stride;
+}
+
+bool parseHeader(const unsigned char *data, std::size_t size, PlyHeader& header) {
+    static const char end_marker[] = "end_header";
+    const char *text = reinterpret_cast<const char *>(data);
+    const char *end = std::search(text, text + size, end_marker, end_marker + sizeof(end_marker) - 1);
+    if (size < 4 || std::strncmp(text, "ply", 3) != 0 || end == text + size) {
+        std::cerr << "Invalid PLY header\n";
+        return false;
+    }
+    // Body starts after the end of the end_header line
+    const char *body = static_cast<const char *>(std::memchr(end, '\n', static_cast<std::size_t>(text + size - end)));
+    header.body_offset = body == nullptr ? size : static_cast<std::size_t>(body + 1 - text);
+
+    std::istringstream lines{std::string(text, end)};
+    std::string line;
+    bool has_format = false;
+    while (std::getline(lines, line)) {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+        if (keyword == "format") {
+            std::string format;
+            tokens >> format;
+            if (format == "ascii") {
+                header.format = PlyFormat::Ascii;
+            } else if (format == "binary_little_endian") {
+                header.format = PlyFormat::BinaryLittleEndian;
+            } else if (format == "binary_big_endian") {
+                header.format = PlyFormat::BinaryBigEndian;
+            } else {
+                std::cerr << "Unknown PLY format " << format << "\n";
+                return false;
+            }
+            has_format = true;
+        } else if (keyword == "element") {
+            // Read as signed, a negative count would wrap around in an unsigned read
+            PlyElement element;
+            long long count = -1;
+            if (!(tokens >> element.name >> count) || count < 0) {
+                std::cerr << "Invalid PLY element " << line << "\n";
+                return false;
+            }
+            element.count = static_cast<std::size_t>(count);
+            header.elements.push_back(element);
+        } else if (keyword == "property") {
+            if (header.elements.empty()) {
+                std::cerr << "PLY property outside of an element\n";
+                return false;
+            }
+            PlyProperty property;
+            std::string type;
+            tokens >> type;
+            property.count_type = PlyType::Invalid;
+            if (type == "list") {
+                std::string count_type;
+                tokens >> count_type >> type;
+                property.count_type = parseType(count_type);
+                if (property.count_type == PlyType::Invalid) {
+                    std::cerr << "Unknown PLY type " << count_type << "\n";
+                    return false;
+                }
+            }
+            property.type = parseType(type);
+            if (property.type == PlyType::Invalid) {
+                std::cerr << "Unknown PLY type " << type << "\n";
+                return false;
+            }
+            tokens >> property.name;
+            header.elements.back().properties.push_back(property);
+        }
+        // Comments, obj_info and the ply magic are ignored
+    }
+    if (!has_format) {
+        std::cerr << "PLY header without format\n";
+    }
+    return has_format;
+}
+
+// Read binary value and convert it to double, swap reverses the bytes
+inline double readBinary(const unsigned char *p, PlyType type, bool swap) {
+    unsigned char bytes[8];
+    const std::size_t size = getTypeSize(type);
+    if (swap) {
+        std::reverse_copy(p, p + size, bytes);
+    } else {
+        std::memcpy(bytes, p, size);
+    }
+    switch (type) {
+        case PlyType::Int8: {
+            std::int8_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        case PlyType::UInt8:
+            return bytes[0];
+        case PlyType::Int16: {
+            std::int16_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        case PlyType::UInt16: {
+            std::uint16_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        case PlyType::Int32: {
+            std::int32_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        case PlyType::UInt32: {
+            std::uint32_t v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        case PlyType::Float32: {
+            float v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        case PlyType::Float64: {
+            double v;
+            std::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+        default:
+            return 0.0;
+    }
+}
+
+// Parse a decimal number, skipping the blanks before it. Returns false if there is none
+bool parseNumber(const char *& p, const char *end, double& value) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14,
+                                    1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        ++p;
+    }
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    // Digits past the precision of the mantissa only move the exponent
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    bool has_digits = false;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, has_digits = true) {
+        if (mantissa < 100000000000000000ull) {
+            mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+        } else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, has_digits = true) {
+            if (mantissa < 100000000000000000ull) {
+                mantissa = mantissa * 10 + static_cast<std::uint64_t>(*p - '0');
+                --exponent;
+            }
+        }
+    }
+    if (!has_digits) {
+        p = start;
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *exponent_start = p++;
+        bool exponent_negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exponent_negative = *p == '-';
+            ++p;
+        }
+        int e = 0;
+        bool has_exponent = false;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, has_exponent = true) {
+            e = std::min(e * 10 + (*p - '0'), 10000);
+        }
+        if (has_exponent) {
+            exponent += exponent_negative ? -e : e;
+        } else {
+            p = exponent_start;
+        }
+    }
+
+    value = static_cast<double>(mantissa);
+    if (exponent > 0) {
+        value *= exponent <= 22 ? powers[exponent] : std::pow(10.0, exponent);
+    } else if (exponent < 0) {
+        value /= exponent >= -22 ? powers[-exponent] : std::pow(10.0, -exponent);
+    }
+    if (negative) {
+        value = -value;
+    }
+    return true;
+}
+
+// Parse the count of an ascii list. Returns false if it is not a whole number or if the rest of the line is too short
+// for that many values, each value takes at least a digit and a blank
+bool parseListCount(const char *& p, const char *end, std::size_t& count) {
+    double value;
+    if (!parseNumber(p, end, value) || !(value >= 0.0) || value != std::floor(value) ||
+        value > static_cast<double>(end - p) / 2.0) {
+        return false;
+    }
+    count = static_cast<std::size_t>(value);
+    return true;
+}
+
+// Append the triangles of a polygon as a fan
+inline void appendPolygon(const GLuint *polygon, std::size_t count, std::vector<GLuint>& indices) {
+    for (std::size_t i = 2; i < count; ++i) {
+        indices.push_back(polygon[0]);
+        indices.push_back(polygon[i - 1]);
+        indices.push_back(polygon[i]);
+    }
+}
+
+// Properties of the vertex element read into the vertices, -1 when missing
+struct VertexProperties {
+    int position[3];
+    int normal[3];
+
+    explicit VertexProperties(const PlyElement& element) {
+        static const char *const position_names[] = {"x", "y", "z"};
+        static const char *const normal_names[] = {"nx", "ny", "nz"};
+        for (std::size_t c = 0; c < 3; ++c) {
+            position[c] = element.findProperty(position_names[c]);
+            normal[c] = element.findProperty(normal_names[c]);
+        }
+    }
+
+    inline bool hasPosition() const noexcept {
+        return position[0] >= 0 && position[1] >= 0 && position[2] >= 0;
+    }
+
+    inline bool hasNormal() const noexcept {
+        return normal[0] >= 0 && normal[1] >= 0 && normal[2] >= 0;
+    }
+
+    // Store the value of property p in the vertex
+    inline void store(int p, double value, Vertex& vertex) const {
+        for (std::size_t c = 0; c < 3; ++c) {
+            if (position[c] == p) {
+                vertex.position[c] = static_cast<float>(value);
+            } else if (normal[c] == p) {
+                vertex.normal[c] = static_cast<float>(value);
+            }
+        }
+    }
+};
+
+// Index of the vertex index list of the face element, -1 if there is none
+int findFaceIndices(const PlyElement& element) {
+    int p = element.findProperty("vertex_indices");
+    if (p < 0) {
+        p = element.findProperty("vertex_index");
+    }
+    if (p >= 0 && !element.properties[static_cast<std::size_t>(p)].isList()) {
+        return -1;
+    }
+    return p;
+}
+
+// Walk the binary elements one at a time. Elements with lists can only be read sequentially, vertex elements with a
+// fixed size are decoded in parallel chunks
+bool readBinaryBody(const unsigned char *data, std::size_t size, const PlyHeader& header, MeshData& mesh) {
+    const bool swap = header.format == PlyFormat::BinaryBigEndian;
+    const unsigned char *p = data + header.body_offset;
+    const unsigned char *end = data + size;
+    std::vector<GLuint> polygon;
+
+    for (const auto& element : header.elements) {
+        const std::size_t stride = getElementStride(element);
+        if (element.name == "vertex") {
+            const VertexProperties properties(element);
+            if (stride == 0 || !properties.hasPosition()) {
+                std::cerr << "Unsupported PLY vertex element\n";
+                return false;
+            }
+            if (static_cast<std::size_t>(end - p) / stride < element.count) {
+                std::cerr << "Truncated PLY file\n";
+                return false;
+            }
+            // Offsets of the properties in an element
+            std::vector<std::size_t> offsets(element.properties.size());
+            for (std::size_t i = 1; i < offsets.size(); ++i) {
+                offsets[i] = offsets[i - 1] + getTypeSize(element.properties[i - 1].type);
+            }
+            mesh.vertices.assign(element.count, Vertex{glm::vec3(0.f), glm::vec3(0.f)});
+            const std::size_t per_task = std::max<std::size_t>(1, PLY_CHUNK_SIZE / stride);
+            const std::size_t num_tasks = (element.count + per_task - 1) / per_task;
+            const unsigned char *first = p;
+            ThreadPool::getGlobal().parallelFor(num_tasks, [&](std::size_t task) {
+                const std::size_t last = std::min(element.count, (task + 1) * per_task);
+                for (std::size_t v = task * per_task; v < last; ++v) {
+                    const unsigned char *vertex = first + v * stride;
+                    for (std::size_t c = 0; c < 3; ++c) {
+                        const auto position = static_cast<std::size_t>(properties.position[c]);
+                        mesh.vertices[v].position[c] = static_cast<float>(
+                                readBinary(vertex + offsets[position], element.properties[position].type, swap));
+                        if (properties.hasNormal()) {
+                            const auto normal = static_cast<std::size_t>(properties.normal[c]);
+                            mesh.vertices[v].normal[c] = static_cast<float>(
+                                    readBinary(vertex + offsets[normal], element.properties[normal].type, swap));
+                        }
+                    }
+                }
+            });
+            p += element.count * stride;
+        } else if (element.name == "face") {
+            const int indices_property = findFaceIndices(element);
+            if (indices_property < 0) {
+                std::cerr << "PLY face element without vertex indices\n";
+                return false;
+            }
+            mesh.indices.reserve(element.count * 3);
+            for (std::size_t f = 0; f < element.count; ++f) {
+                for (std::size_t i = 0; i < element.properties.size(); ++i) {
+                    const PlyProperty& property = element.properties[i];
+                    const std::size_t count_size = property.isList() ? getTypeSize(property.count_type) : 0;
+                    if (static_cast<std::size_t>(end - p) < count_size) {
+                        std::cerr << "Truncated PLY file\n";
+                        return false;
+                    }
+                    const std::size_t count = property.isList() ? static_cast<std::size_t>(
+                            readBinary(p, property.count_type, swap)) : 1;
+                    p += count_size;
+                    const std::size_t item_size = getTypeSize(property.type);
+                    if (static_cast<std::size_t>(end - p) / item_size < count) {
+                        std::cerr << "Truncated PLY file\n";
+                        return false;
+                    }
+                    if (static_cast<int>(i) == indices_property) {
+                        polygon.resize(count);
+                        for (std::size_t k = 0; k < count; ++k) {
+                            polygon[k] = static_cast<GLuint>(readBinary(p + k * item_size, property.type, swap));
+                        }
+                        appendPolygon(polygon.data(), count, mesh.indices);
+                    }
+                    p += count * item_size;
+                }
+            }
+        } else if (stride != 0) {
+            // Other elements are skipped
+            if (static_cast<std::size_t>(end - p) / stride < element.count) {
+                std::cerr << "Truncated PLY file\n";
+                return false;
+            }
+            p += element.count * stride;
+        } else {
+            for (std::size_t e = 0; e < element.count; ++e) {
+                for (const auto& property : element.properties) {
+                    const std::size_t count_size = property.isList() ? getTypeSize(property.count_type) : 0;
+                    if (static_cast<std::size_t>(end - p) < count_size) {
+                        std::cerr << "Truncated PLY file\n";
+                        return false;
+                    }
+                    const std::size_t count = property.isList() ? static_cast<std::size_t>(
+                            readBinary(p, property.count_type, swap)) : 1;
+                    p += count_size;
+                    if (static_cast<std::size_t>(end - p) / getTypeSize(property.type) < count) {
+                        std::cerr << "Truncated PLY file\n";
+                        return false;
+                    }
+                    p += count * getTypeSize(property.type);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Ascii elements are one per line. Lines are counted per chunk in a first parallel pass, which gives the element of
+// every line, then the chunks are parsed in parallel
+bool readAsciiBody(const unsigned char *data, std::size_t size, const PlyHeader& header, MeshData& mesh) {
+    const char *body = reinterpret_cast<const char *>(data + header.body_offset);
+    const char *end = reinterpret_cast<const char *>(data + size);
+
+    // Chunks end after a line break
+    std::vector<const char *> chunks{body};
+    while (chunks.back() < end) {
+        const std::size_t remaining = static_cast<std::size_t>(end - chunks.back());
+        if (remaining <= PLY_CHUNK_SIZE) {
+            chunks.push_back(end);
+            break;
+        }
+        const char *next = chunks.back() + PLY_CHUNK_SIZE;
+        const void *line_end = std::memchr(next, '\n', static_cast<std::size_t>(end - next));
+        chunks.push_back(line_end == nullptr ? end : static_cast<const char *>(line_end) + 1);
+    }
+    const std::size_t num_chunks = chunks.size() - 1;
+
+    // First line of each chunk, the last line may not end with a line break
+    std::vector<std::size_t> first_lines(num_chunks + 1, 0);
+    ThreadPool::getGlobal().parallelFor(num_chunks, [&](std::size_t c) {
+        first_lines[c + 1] = static_cast<std::size_t>(std::count(chunks[c], chunks[c + 1], '\n'));
+        if (c + 1 == num_chunks && chunks[c + 1] > chunks[c] && chunks[c + 1][-1] != '\n') {
+            ++first_lines[c + 1];
+        }
+    });
+    for (std::size_t c = 0; c < num_chunks; ++c) {
+        first_lines[c + 1] += first_lines[c];
+    }
+
+    // Lines of each element
+    std::vector<std::size_t> element_lines(header.elements.size() + 1, 0);
+    int vertex_element = -1;
+    int face_element = -1;
+    bool truncated = false;
+    for (std::size_t e = 0; e < header.elements.size(); ++e) {
+        // Each element takes a line at least, compared before adding so huge counts can not wrap around
+        truncated |= header.elements[e].count > first_lines.back() - element_lines[e];
+        element_lines[e + 1] = truncated ? first_lines.back() : element_lines[e] + header.elements[e].count;
+        if (header.elements[e].name == "vertex") {
+            vertex_element = static_cast<int>(e);
+        } else if (header.elements[e].name == "face") {
+            face_element = static_cast<int>(e);
+        }
+    }
+    if (vertex_element < 0 || truncated) {
+        std::cerr << "Truncated PLY file\n";
+        return false;
+    }
+    const PlyElement& vertices = header.elements[static_cast<std::size_t>(vertex_element)];
+    const VertexProperties properties(vertices);
+    const int indices_property = face_element >= 0 ? findFaceIndices(
+            header.elements[static_cast<std::size_t>(face_element)]) : -1;
+    if (!properties.hasPosition() || (face_element >= 0 && indices_property < 0)) {
+        std::cerr << "Unsupported PLY vertex or face element\n";
+        return false;
+    }
+
+    // Vertices are written in place, the triangles of each chunk are concatenated in order afterwards
+    mesh.vertices.assign(vertices.count, Vertex{glm::vec3(0.f), glm::vec3(0.f)});
+    std::vector<std::vector<GLuint>> chunk_indices(num_chunks);
+    std::atomic<bool> valid{true};
+    ThreadPool::getGlobal().parallelFor(num_chunks, [&](std::size_t c) {
+        std::vector<GLuint> polygon;
+        std::size_t line = first_lines[c];
+        for (const char *p = chunks[c]; p < chunks[c + 1]; ++line) {
+            const char *line_end = static_cast<const char *>(std::memchr(p, '\n',
+                                                                        static_cast<std::size_t>(chunks[c + 1] - p)));
+            if (line_end == nullptr) {
+                line_end = chunks[c + 1];
+            }
+            const char *value = p;
+            p = line_end + 1;
+            if (line >= element_lines.back()) {
+                continue;
+            }
+            const auto element = static_cast<std::size_t>(std::upper_bound(element_lines.begin(), element_lines.end(),
+                                                                           line) - element_lines.begin() - 1);
+            double number;
+            if (static_cast<int>(element) == vertex_element) {
+                Vertex& vertex = mesh.vertices[line - element_lines[element]];
+                for (std::size_t i = 0; i < vertices.properties.size(); ++i) {
+                    std::size_t count = 1;
+                    if (vertices.properties[i].isList() && !parseListCount(value, line_end, count)) {
+                        valid = false;
+                        return;
+                    }
+                    for (std::size_t k = 0; k < count; ++k) {
+                        if (!parseNumber(value, line_end, number)) {
+                            valid = false;
+                            return;
+                        }
+                        if (!vertices.properties[i].isList()) {
+                            properties.store(static_cast<int>(i), number, vertex);
+                        }
+                    }
+                }
+            } else if (static_cast<int>(element) == face_element) {
+                const PlyElement& faces = header.elements[element];
+                for (std::size_t i = 0; i < faces.properties.size(); ++i) {
+                    std::size_t count = 1;
+                    if (faces.properties[i].isList() && !parseListCount(value, line_end, count)) {
+                        valid = false;
+                        return;
+                    }
+                    polygon.resize(count);
+                    for (std::size_t k = 0; k < count; ++k) {
+                        if (!parseNumber(value, line_end, number)) {
+                            valid = false;
+                            return;
+                        }
+                        polygon[k] = static_cast<GLuint>(number);
+                    }
+                    if (static_cast<int>(i) == indices_property) {
+                        appendPolygon(polygon.data(), count, chunk_indices[c]);
+                    }
+                }
+            }
+        }
+    });
+    if (!valid) {
+        std::cerr << "Invalid number in PLY file\n";
+        return false;
+    }
+
+    std::size_t num_indices = 0;
+    for (const auto& indices : chunk_indices) {
+        num_indices += indices.size();
+    }
+    mesh.indices.reserve(num_indices);
+    for (const auto& indices : chunk_indices) {
+        mesh.indices.insert(mesh.indices.end(), indices.begin(), indices.end());
+    }
+    return true;
+}
+
+// Area weighted average of the normals of the faces around each vertex
+void computeSmoothNormals(MeshData& mesh) {
+    for (auto& vertex : mesh.vertices) {
+        vertex.normal = glm::vec3(0.f);
+    }
+    for (std::size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        Vertex& v0 = mesh.vertices[mesh.indices[i]];
+        Vertex& v1 = mesh.vertices[mesh.indices[i + 1]];
+        Vertex& v2 = mesh.vertices[mesh.indices[i + 2]];
+        // Length of the cross product is twice the area
+        const glm::vec3 normal = glm::cross(v1.position - v0.position, v2.position - v0.position);
+        v0.normal += normal;
+        v1.normal += normal;
+        v2.normal += normal;
+    }
+    ThreadPool::getGlobal().parallelFor((mesh.vertices.size() + PLY_CHUNK_SIZE - 1) / PLY_CHUNK_SIZE,
+                                        [&mesh](std::size_t task) {
+        const std::size_t last = std::min(mesh.vertices.size(), (task + 1) * PLY_CHUNK_SIZE);
+        for (std::size_t v = task * PLY_CHUNK_SIZE; v < last; ++v) {
+            const float length = glm::length(mesh.vertices[v].normal);
+            mesh.vertices[v].normal = length > 0.f ? mesh.vertices[v].normal / length : glm::vec3(0.f, 0.f, 1.f);
+        }
+    });
+}
+
+} // namespace
+
+bool isPlyFile(const std::string& file_name) {
+    if (file_name.size() < 4) {
+        return false;
+    }
+    std::string extension = file_name.substr(file_name.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+    return extension == ".ply";
+}
+
+bool readPly(const std::string& file_name, MeshData& data) {
+    MappedFile file(file_name);
+    if (!file.isValid()) {
+        std::cerr << "Error opening PLY file: " << file_name << "\n";
+        return false;
+    }
+
+    PlyHeader header;
+    bool success = parseHeader(file.getData(), file.getSize(), header);
+    bool has_normals = false;
+    if (success) {
+        data = MeshData();
+        for (const auto& element : header.elements) {
+            if (element.name == "vertex") {
+                has_normals = VertexProperties(element).hasNormal();
+            }
+        }
+        success = header.format == PlyFormat::Ascii ?
+                  readAsciiBody(file.getData(), file.getSize(), header, data) :
+                  readBinaryBody(file.getData(), file.getSize(), header, data);
+    }
+    file.destroy();
+
+    // Faces must only reference existing vertices
+    if (success) {
+        const std::size_t num_vertices = data.vertices.size();
+        success = std::all_of(data.indices.begin(), data.indices.end(),
+                              [num_vertices](GLuint index) { return index < num_vertices; });
+        if (!success) {
+            std::cerr << "PLY face references a missing vertex\n";
+        }
+    }
+    if (!success) {
+        data = MeshData();
+        return false;
+    }
+    if (!has_normals) {
+        computeSmoothNormals(data);
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_PLYREADER_HPP
+#define OPENGLPLAYGROUND_PLYREADER_HPP
+
+#include "Mesh.hpp"
+
+// Check if a file name has the .ply extension, case insensitive
+bool isPlyFile(const std::string& file_name);
+
+// Read the vertices and faces of a PLY file into a mesh, for ascii and binary little and big endian files. The file is
+// memory mapped and decoded in parallel chunks where the layout allows it, polygons are triangulated as fans and
+// smooth normals are computed when the file has none. Returns false if the file can not be read or uses a layout
+// the reader does not support
+bool readPly(const std::string& file_name, MeshData& data);
+
+#endif //OPENGLPLAYGROUND_PLYREADER_HPP
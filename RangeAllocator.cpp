@@ -0,0 +1,324 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "RangeAllocator.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// Index of the highest set bit, value must not be 0
+inline std::size_t findHighestBit(std::uint64_t value) noexcept {
+#if defined(__GNUC__)
+    return 63 - static_cast<std::size_t>(__builtin_clzll(value));
+#else
+    std::size_t bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Index of the lowest set bit, value must not be 0
+inline std::size_t findLowestBit(std::uint64_t value) noexcept {
+#if defined(__GNUC__)
+    return static_cast<std::size_t>(__builtin_ctzll(value));
+#else
+    std::size_t bit = 0;
+    while ((value & 1) == 0) {
+        value >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+// Round offset up to a multiple of alignment
+inline std::size_t alignUp(std::size_t offset, std::size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+RangeAllocator::RangeAllocator(std::size_t capacity)
+        : m_fl_bitmap(0), m_first(INVALID_RANGE), m_last(INVALID_RANGE), m_capacity(0), m_used(0),
+          m_num_allocations(0), m_num_free_blocks(0) {
+    std::fill(&m_heads[0][0], &m_heads[0][0] + FL_COUNT * SL_COUNT, INVALID_RANGE);
+    std::fill(m_sl_bitmaps, m_sl_bitmaps + FL_COUNT, 0u);
+    grow(capacity);
+}
+
+void RangeAllocator::mapping(std::size_t size, std::size_t& fl, std::size_t& sl) noexcept {
+    if (size < SL_COUNT) {
+        fl = 0;
+        sl = size;
+        return;
+    }
+    const std::size_t bit = findHighestBit(size);
+    fl = bit - SL_BITS + 1;
+    sl = (size >> (bit - SL_BITS)) - SL_COUNT;
+}
+
+bool RangeAllocator::fits(std::uint32_t block, std::size_t size, std::size_t alignment) const noexcept {
+    const Block& b = m_blocks[block];
+    return alignUp(b.offset, alignment) - b.offset + size <= b.size;
+}
+
+std::uint32_t RangeAllocator::findFree(std::size_t size, std::size_t alignment) const noexcept {
+    // Round the size up to the next size class, every block of that class and above fits even with the worst padding
+    std::size_t search = size + alignment - 1;
+    if (search >= SL_COUNT) {
+        const std::size_t round = (std::size_t(1) << (findHighestBit(search) - SL_BITS)) - 1;
+        search = search + round >= search ? search + round : search;
+    }
+    std::size_t fl = 0;
+    std::size_t sl = 0;
+    mapping(search, fl, sl);
+
+    std::uint32_t sl_map = m_sl_bitmaps[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        const std::uint64_t fl_map = fl + 1 < 64 ? m_fl_bitmap & (~std::uint64_t(0) << (fl + 1)) : 0;
+        if (fl_map != 0) {
+            fl = findLowestBit(fl_map);
+            sl_map = m_sl_bitmaps[fl];
+        }
+    }
+    if (sl_map != 0) {
+        return m_heads[fl][findLowestBit(sl_map)];
+    }
+
+    // Blocks of the class of the exact size may fit too. Only the head and the end block are checked so this stays
+    // constant time, the end block is the one left when a reserved range is filled
+    mapping(size, fl, sl);
+    const std::uint32_t head = m_heads[fl][sl];
+    if (head != INVALID_RANGE && fits(head, size, alignment)) {
+        return head;
+    }
+    if (m_last != INVALID_RANGE && m_blocks[m_last].free && fits(m_last, size, alignment)) {
+        return m_last;
+    }
+    return INVALID_RANGE;
+}
+
+void RangeAllocator::insertFree(std::uint32_t block) {
+    Block& b = m_blocks[block];
+    std::size_t fl = 0;
+    std::size_t sl = 0;
+    mapping(b.size, fl, sl);
+    b.free = true;
+    b.prev_free = INVALID_RANGE;
+    b.next_free = m_heads[fl][sl];
+    if (b.next_free != INVALID_RANGE) {
+        m_blocks[b.next_free].prev_free = block;
+    }
+    m_heads[fl][sl] = block;
+    m_fl_bitmap |= std::uint64_t(1) << fl;
+    m_sl_bitmaps[fl] |= 1u << sl;
+    ++m_num_free_blocks;
+}
+
+void RangeAllocator::removeFree(std::uint32_t block) {
+    const Block& b = m_blocks[block];
+    std::size_t fl = 0;
+    std::size_t sl = 0;
+    mapping(b.size, fl, sl);
+    if (b.prev_free != INVALID_RANGE) {
+        m_blocks[b.prev_free].next_free = b.next_free;
+    } else {
+        m_heads[fl][sl] = b.next_free;
+    }
+    if (b.next_free != INVALID_RANGE) {
+        m_blocks[b.next_free].prev_free = b.prev_free;
+    }
+    if (m_heads[fl][sl] == INVALID_RANGE) {
+        m_sl_bitmaps[fl] &= ~(1u << sl);
+        if (m_sl_bitmaps[fl] == 0) {
+            m_fl_bitmap &= ~(std::uint64_t(1) << fl);
+        }
+    }
+    --m_num_free_blocks;
+}
+
+std::uint32_t RangeAllocator::createBlock(std::size_t offset, std::size_t size, std::uint32_t prev) {
+    std::uint32_t block;
+    if (!m_unused_blocks.empty()) {
+        block = m_unused_blocks.back();
+        m_unused_blocks.pop_back();
+    } else {
+        block = static_cast<std::uint32_t>(m_blocks.size());
+        m_blocks.emplace_back();
+    }
+    Block& b = m_blocks[block];
+    b.offset = offset;
+    b.size = size;
+    b.alignment = 1;
+    b.prev_free = INVALID_RANGE;
+    b.next_free = INVALID_RANGE;
+    b.free = true;
+    b.prev_physical = prev;
+    b.next_physical = prev != INVALID_RANGE ? m_blocks[prev].next_physical : m_first;
+    if (prev != INVALID_RANGE) {
+        m_blocks[prev].next_physical = block;
+    } else {
+        m_first = block;
+    }
+    if (b.next_physical != INVALID_RANGE) {
+        m_blocks[b.next_physical].prev_physical = block;
+    } else {
+        m_last = block;
+    }
+    return block;
+}
+
+std::uint32_t RangeAllocator::split(std::uint32_t block, std::size_t size) {
+    if (m_blocks[block].size <= size) {
+        return INVALID_RANGE;
+    }
+    const std::size_t offset = m_blocks[block].offset + size;
+    const std::size_t rest = m_blocks[block].size - size;
+    m_blocks[block].size = size;
+    return createBlock(offset, rest, block);
+}
+
+void RangeAllocator::merge(std::uint32_t block, std::uint32_t next) {
+    Block& b = m_blocks[block];
+    b.size += m_blocks[next].size;
+    b.next_physical = m_blocks[next].next_physical;
+    if (b.next_physical != INVALID_RANGE) {
+        m_blocks[b.next_physical].prev_physical = block;
+    } else {
+        m_last = block;
+    }
+    m_unused_blocks.push_back(next);
+}
+
+std::uint32_t RangeAllocator::allocate(std::size_t size, std::size_t alignment) {
+    // Empty allocations still get their own byte so that handles are unique
+    size = std::max<std::size_t>(size, 1);
+    alignment = std::max<std::size_t>(alignment, 1);
+    std::uint32_t block = findFree(size, alignment);
+    if (block == INVALID_RANGE) {
+        return INVALID_RANGE;
+    }
+    removeFree(block);
+
+    // Padding before the aligned offset stays free, the allocation is the rest of the block
+    const std::size_t padding = alignUp(m_blocks[block].offset, alignment) - m_blocks[block].offset;
+    if (padding > 0) {
+        const std::uint32_t aligned = split(block, padding);
+        insertFree(block);
+        block = aligned;
+    }
+    const std::uint32_t rest = split(block, size);
+    if (rest != INVALID_RANGE) {
+        insertFree(rest);
+    }
+
+    m_blocks[block].free = false;
+    m_blocks[block].alignment = alignment;
+    m_used += size;
+    ++m_num_allocations;
+    return block;
+}
+
+void RangeAllocator::free(std::uint32_t handle) {
+    m_used -= m_blocks[handle].size;
+    --m_num_allocations;
+    m_blocks[handle].free = true;
+
+    // Free neighbours are merged so no two free blocks are ever adjacent
+    std::uint32_t block = handle;
+    const std::uint32_t prev = m_blocks[block].prev_physical;
+    if (prev != INVALID_RANGE && m_blocks[prev].free) {
+        removeFree(prev);
+        merge(prev, block);
+        block = prev;
+    }
+    const std::uint32_t next = m_blocks[block].next_physical;
+    if (next != INVALID_RANGE && m_blocks[next].free) {
+        removeFree(next);
+        merge(block, next);
+    }
+    insertFree(block);
+}
+
+void RangeAllocator::grow(std::size_t capacity) {
+    if (capacity <= m_capacity) {
+        return;
+    }
+    const std::size_t extra = capacity - m_capacity;
+    if (m_last != INVALID_RANGE && m_blocks[m_last].free) {
+        removeFree(m_last);
+        m_blocks[m_last].size += extra;
+        insertFree(m_last);
+    } else {
+        insertFree(createBlock(m_capacity, extra, m_last));
+    }
+    m_capacity = capacity;
+}
+
+void RangeAllocator::compact(std::vector<RangeMove>& moves) {
+    // Collect the allocations in address order and drop the free blocks
+    std::vector<std::uint32_t> allocated;
+    allocated.reserve(m_num_allocations);
+    for (std::uint32_t block = m_first; block != INVALID_RANGE; block = m_blocks[block].next_physical) {
+        if (m_blocks[block].free) {
+            m_unused_blocks.push_back(block);
+        } else {
+            allocated.push_back(block);
+        }
+    }
+    std::fill(&m_heads[0][0], &m_heads[0][0] + FL_COUNT * SL_COUNT, INVALID_RANGE);
+    std::fill(m_sl_bitmaps, m_sl_bitmaps + FL_COUNT, 0u);
+    m_fl_bitmap = 0;
+    m_num_free_blocks = 0;
+    m_first = INVALID_RANGE;
+    m_last = INVALID_RANGE;
+
+    // Relink them one after the other, only the padding needed by the alignments stays between them
+    std::size_t end = 0;
+    for (const std::uint32_t block : allocated) {
+        const std::size_t offset = alignUp(end, m_blocks[block].alignment);
+        if (offset > end) {
+            insertFree(createBlock(end, offset - end, m_last));
+        }
+        // Creating the padding block may have reallocated the blocks
+        Block& b = m_blocks[block];
+        if (offset != b.offset) {
+            moves.push_back({block, b.offset, offset, b.size});
+        }
+        b.offset = offset;
+        b.prev_physical = m_last;
+        b.next_physical = INVALID_RANGE;
+        if (m_last != INVALID_RANGE) {
+            m_blocks[m_last].next_physical = block;
+        } else {
+            m_first = block;
+        }
+        m_last = block;
+        end = offset + b.size;
+    }
+    if (end < m_capacity) {
+        insertFree(createBlock(end, m_capacity - end, m_last));
+    }
+}
+
+RangeStatistics RangeAllocator::getStatistics() const {
+    RangeStatistics statistics{};
+    statistics.capacity = m_capacity;
+    statistics.used = m_used;
+    statistics.free = m_capacity - m_used;
+    statistics.num_allocations = m_num_allocations;
+    statistics.num_free_blocks = m_num_free_blocks;
+    // Largest block is in the highest non empty list, which is not sorted
+    if (m_fl_bitmap != 0) {
+        const std::size_t fl = findHighestBit(m_fl_bitmap);
+        const std::size_t sl = findHighestBit(m_sl_bitmaps[fl]);
+        for (std::uint32_t block = m_heads[fl][sl]; block != INVALID_RANGE; block = m_blocks[block].next_free) {
+            statistics.largest_free = std::max(statistics.largest_free, m_blocks[block].size);
+        }
+    }
+    return statistics;
+}
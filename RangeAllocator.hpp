@@ -0,0 +1,160 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_RANGEALLOCATOR_HPP
+#define OPENGLPLAYGROUND_RANGEALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Handle returned when an allocation does not fit
+constexpr std::uint32_t INVALID_RANGE = std::numeric_limits<std::uint32_t>::max();
+
+// Allocation moved by a compaction, the data has to be copied from the old offset to the new one
+struct RangeMove {
+    std::uint32_t handle;
+    std::size_t old_offset;
+    std::size_t new_offset;
+    std::size_t size;
+};
+
+// Occupancy of a RangeAllocator, in bytes
+struct RangeStatistics {
+    std::size_t capacity;
+    // Bytes in allocations, and bytes left between and after them
+    std::size_t used;
+    std::size_t free;
+    // Largest allocation that fits without growing, alignment aside
+    std::size_t largest_free;
+    std::size_t num_allocations;
+    std::size_t num_free_blocks;
+
+    // Get share of the free bytes outside of the largest free block, 0 when the free space is contiguous
+    inline float getFragmentation() const noexcept {
+        return free > 0 ? 1.f - static_cast<float>(largest_free) / static_cast<float>(free) : 0.f;
+    }
+};
+
+// Two level segregated fit allocator of ranges in [0, capacity), e.g. in a GPU buffer. Only host memory is touched,
+// the bookkeeping lives beside the buffer and not in it. Free blocks are kept in lists by size class, a first level
+// per power of two and a second level splitting it in 16, with a bitmap of the non empty lists. Allocation and release
+// are constant time: bit scans find a list whose blocks all fit, and released blocks merge with their free neighbours.
+// Allocations are referred to by handles that stay valid when a compaction moves them
+class RangeAllocator {
+private:
+    // Contiguous range, free or allocated
+    struct Block {
+        std::size_t offset;
+        std::size_t size;
+        // Alignment asked for the allocation, kept by compactions
+        std::size_t alignment;
+        // Neighbours in address order
+        std::uint32_t prev_physical;
+        std::uint32_t next_physical;
+        // Neighbours in the free list of the size class
+        std::uint32_t prev_free;
+        std::uint32_t next_free;
+        bool free;
+    };
+
+    // Second level lists per first level, as a power of two
+    static constexpr std::size_t SL_BITS = 4;
+    static constexpr std::size_t SL_COUNT = std::size_t(1) << SL_BITS;
+    // First level 0 holds the sizes below SL_COUNT, level f the sizes in [2^(f + SL_BITS - 1), 2^(f + SL_BITS))
+    static constexpr std::size_t FL_COUNT = std::numeric_limits<std::size_t>::digits - SL_BITS + 1;
+
+    // Blocks indexed by handle, released ones are reused
+    std::vector<Block> m_blocks;
+    std::vector<std::uint32_t> m_unused_blocks;
+    // First free block of each size class
+    std::uint32_t m_heads[FL_COUNT][SL_COUNT];
+    // Bit f set when first level f has a free block, bit s of the second level bitmap when list (f, s) has one
+    std::uint64_t m_fl_bitmap;
+    std::uint32_t m_sl_bitmaps[FL_COUNT];
+    // First and last block in address order
+    std::uint32_t m_first;
+    std::uint32_t m_last;
+    std::size_t m_capacity;
+    std::size_t m_used;
+    std::size_t m_num_allocations;
+    std::size_t m_num_free_blocks;
+
+    // Get size class of a size
+    static void mapping(std::size_t size, std::size_t& fl, std::size_t& sl) noexcept;
+
+    // Check if an allocation fits in a block once its offset is aligned
+    bool fits(std::uint32_t block, std::size_t size, std::size_t alignment) const noexcept;
+
+    // Find a free block where an allocation fits, INVALID_RANGE when there is none
+    std::uint32_t findFree(std::size_t size, std::size_t alignment) const noexcept;
+
+    // Add / remove a block to / from the list of its size class
+    void insertFree(std::uint32_t block);
+
+    void removeFree(std::uint32_t block);
+
+    // Get an unused block, linked after prev in address order
+    std::uint32_t createBlock(std::size_t offset, std::size_t size, std::uint32_t prev);
+
+    // Cut a block at size, the end becomes a new free block not yet in a list. Returns INVALID_RANGE when the block
+    // is not larger than size
+    std::uint32_t split(std::uint32_t block, std::size_t size);
+
+    // Merge a block into the block before it, which is kept
+    void merge(std::uint32_t block, std::uint32_t next);
+
+public:
+    // Create allocator over [0, capacity)
+    explicit RangeAllocator(std::size_t capacity = 0);
+
+    // Allocate size bytes at an offset multiple of alignment, which does not need to be a power of two. Returns the
+    // handle of the allocation, INVALID_RANGE when it does not fit
+    std::uint32_t allocate(std::size_t size, std::size_t alignment = 1);
+
+    // Release an allocation
+    void free(std::uint32_t handle);
+
+    // Extend the range to [0, capacity), never shrinks
+    void grow(std::size_t capacity);
+
+    // Pack the allocations at the start of the range in address order, keeping their handles and alignments. The free
+    // space becomes one block at the end. Moves are appended in increasing offsets, new offsets are never above the old
+    // ones
+    void compact(std::vector<RangeMove>& moves);
+
+    // Get occupancy, walks the largest size class so not meant for every allocation
+    RangeStatistics getStatistics() const;
+
+    // Get offset and size of an allocation
+    inline std::size_t getOffset(std::uint32_t handle) const noexcept {
+        return m_blocks[handle].offset;
+    }
+
+    inline std::size_t getSize(std::uint32_t handle) const noexcept {
+        return m_blocks[handle].size;
+    }
+
+    // Get end of the last allocation, the bytes after it are free
+    inline std::size_t getAllocatedEnd() const noexcept {
+        if (m_last == INVALID_RANGE) {
+            return 0;
+        }
+        const Block& last = m_blocks[m_last];
+        return last.free ? last.offset : m_capacity;
+    }
+
+    // Get size of the range
+    inline std::size_t getCapacity() const noexcept {
+        return m_capacity;
+    }
+
+    // Get bytes in allocations
+    inline std::size_t getUsed() const noexcept {
+        return m_used;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_RANGEALLOCATOR_HPP
@@ -0,0 +1,139 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "RingBuffer.hpp"
+#include "MemoryStats.hpp"
+
+#include <algorithm>
+
+namespace {
+
+// Timeout of each wait on a fence in nanoseconds, waits are repeated until the fence is signaled
+constexpr GLuint64 RING_WAIT_TIMEOUT = 1000000;
+
+// Round size up to a multiple of alignment
+inline std::size_t alignUp(std::size_t size, std::size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+RingBuffer::RingBuffer(GLenum target, std::size_t frame_size, std::size_t num_frames)
+        : m_buffer(target, GL_STREAM_DRAW), m_frame_size(0), m_num_frames(std::max<std::size_t>(num_frames, 1)),
+          m_alignment(16), m_frame(0), m_used(0), m_in_frame(false), m_mapped(nullptr),
+          m_fences(m_num_frames, nullptr), m_num_waits(0) {
+    // Ranges bound to a uniform block must start on the alignment
+    if (target == GL_UNIFORM_BUFFER) {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        m_alignment = std::max(m_alignment, static_cast<std::size_t>(std::max(alignment, 1)));
+    }
+    m_frame_size = alignUp(std::max<std::size_t>(frame_size, 1), m_alignment);
+    create();
+}
+
+void RingBuffer::create() {
+    const auto total = static_cast<GLsizeiptr>(m_frame_size * m_num_frames);
+    m_mapped = nullptr;
+    m_staging.clear();
+    if (isPersistentSupported()) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        m_buffer.allocateStorage(total, flags);
+        m_mapped = static_cast<unsigned char *>(m_buffer.mapRange(0, total, flags));
+        if (m_mapped == nullptr) {
+            std::cerr << "Error mapping ring buffer storage\n";
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        m_buffer.allocateSpace(total);
+        m_staging.resize(m_frame_size);
+    }
+}
+
+void RingBuffer::destroy() {
+    for (auto& fence : m_fences) {
+        if (fence != nullptr) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    // Deleting the buffer unmaps it
+    m_buffer.destroy();
+    m_mapped = nullptr;
+    m_in_frame = false;
+}
+
+bool RingBuffer::isPersistentSupported() {
+    return GLEW_ARB_buffer_storage != 0;
+}
+
+void RingBuffer::waitFence(std::size_t frame) {
+    GLsync& fence = m_fences[frame];
+    if (fence == nullptr) {
+        return;
+    }
+    // Poll first, the GPU is usually done with a region written frames ago
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        ++m_num_waits;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, RING_WAIT_TIMEOUT);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    if (status == GL_WAIT_FAILED) {
+        std::cerr << "Error waiting on ring buffer fence\n";
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void RingBuffer::beginFrame() {
+    if (m_in_frame) {
+        m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_frame = (m_frame + 1) % m_num_frames;
+    }
+    waitFence(m_frame);
+    m_used = 0;
+    m_in_frame = true;
+}
+
+void RingBuffer::reserve(std::size_t frame_size) {
+    if (frame_size <= m_frame_size) {
+        return;
+    }
+    // Immutable storage can not grow, a new buffer is created once the GPU released the old one
+    for (std::size_t frame = 0; frame < m_num_frames; ++frame) {
+        waitFence(frame);
+    }
+    const GLenum target = m_buffer.getTarget();
+    m_buffer.destroy();
+    m_buffer = Buffer(target, GL_STREAM_DRAW);
+    m_frame_size = alignUp(frame_size, m_alignment);
+    m_used = 0;
+    create();
+}
+
+RingAllocation RingBuffer::allocate(std::size_t size) {
+    const std::size_t offset = alignUp(m_used, m_alignment);
+    if (offset + size > m_frame_size) {
+        return {nullptr, 0};
+    }
+    m_used = offset + size;
+    // Writes to the mapping are the upload, flush counts them otherwise
+    if (m_mapped != nullptr) {
+        MemoryStats::getGlobal().addUpload(size);
+    }
+    unsigned char *region = m_mapped != nullptr ? m_mapped + m_frame * m_frame_size : m_staging.data();
+    return {region + offset, m_frame * m_frame_size + offset};
+}
+
+void RingBuffer::flush() {
+    // Coherent mappings are seen by the commands issued after the writes
+    if (m_mapped != nullptr || m_used == 0) {
+        return;
+    }
+    m_buffer.bind();
+    m_buffer.updateBytes(m_staging.data(), m_used, m_frame * m_frame_size);
+    m_buffer.unbind();
+}
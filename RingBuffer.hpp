@@ -0,0 +1,108 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_RINGBUFFER_HPP
+#define OPENGLPLAYGROUND_RINGBUFFER_HPP
+
+#include "Buffer.hpp"
+
+// Default number of regions of a ring, the GPU may read two frames while the CPU writes the third
+constexpr std::size_t RING_BUFFER_FRAMES = 3;
+
+// Bytes reserved in the current region of a ring
+struct RingAllocation {
+    // Where to write the data, null when the region is full
+    unsigned char *data;
+    // Offset of the data in the buffer, for glBindBufferRange or attribute pointers
+    std::size_t offset;
+};
+
+// Buffer for data rewritten every frame, split in regions used in turn. With ARB_buffer_storage the buffer has
+// immutable storage persistently and coherently mapped, so the data is written in place and the hot path makes no GL
+// call. A fence placed after the draws of a region is waited on before the region is written again, which only
+// blocks when the CPU runs more frames ahead than there are regions. Without the extension, e.g. on the 4.1 contexts
+// of macOS, the region is written in host memory and uploaded by flush
+class RingBuffer {
+private:
+    // Buffer holding all the regions
+    Buffer m_buffer;
+    // Size of a region, a multiple of the alignment
+    std::size_t m_frame_size;
+    // Number of regions
+    std::size_t m_num_frames;
+    // Alignment of the allocations in a region
+    std::size_t m_alignment;
+    // Region being written, and bytes used in it
+    std::size_t m_frame;
+    std::size_t m_used;
+    // Set between the first beginFrame and the next one
+    bool m_in_frame;
+    // Persistent mapping of the whole buffer, null without ARB_buffer_storage
+    unsigned char *m_mapped;
+    // Host copy of the region being written, only used without ARB_buffer_storage
+    std::vector<unsigned char> m_staging;
+    // Fence placed after the last use of each region, null when the region is free
+    std::vector<GLsync> m_fences;
+    // Number of times a region was still in use when it had to be written
+    std::size_t m_num_waits;
+
+    // Allocate and map the storage of all the regions
+    void create();
+
+    // Wait until the GPU is done with a region and release its fence
+    void waitFence(std::size_t frame);
+
+public:
+    // Create ring with regions of at least frame_size bytes. Ranges of uniform buffers are aligned on
+    // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, other targets on 16 bytes
+    RingBuffer(GLenum target, std::size_t frame_size, std::size_t num_frames = RING_BUFFER_FRAMES);
+
+    // Destroy buffer and fences
+    void destroy();
+
+    // Check if the regions can be persistently mapped
+    static bool isPersistentSupported();
+
+    // Start writing the next region. The previous region is fenced, its draws have been submitted by now, and the
+    // next one is waited on if the GPU still reads it
+    void beginFrame();
+
+    // Grow the regions to at least frame_size bytes, waits for the GPU to release all of them. To call before the
+    // allocations of the frame, it recreates the buffer
+    void reserve(std::size_t frame_size);
+
+    // Reserve aligned bytes in the current region, the data pointer is null when they do not fit
+    RingAllocation allocate(std::size_t size);
+
+    // Make the data written in the current region visible to the next draws. Nothing to do with a coherent mapping,
+    // a single glBufferSubData otherwise
+    void flush();
+
+    // Get buffer, its identifier changes when the regions grow
+    inline const Buffer& getBuffer() const noexcept {
+        return m_buffer;
+    }
+
+    // Get size of a region
+    inline std::size_t getFrameSize() const noexcept {
+        return m_frame_size;
+    }
+
+    // Get alignment of the allocations
+    inline std::size_t getAlignment() const noexcept {
+        return m_alignment;
+    }
+
+    // Check if the buffer is persistently mapped
+    inline bool isPersistent() const noexcept {
+        return m_mapped != nullptr;
+    }
+
+    // Get number of times beginFrame blocked on a fence
+    inline std::size_t getNumWaits() const noexcept {
+        return m_num_waits;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_RINGBUFFER_HPP
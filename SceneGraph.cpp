@@ -0,0 +1,91 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "SceneGraph.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+std::uint32_t SceneGraph::addNode(const std::string& name, std::int32_t parent, const glm::mat4& local) {
+    const auto node = static_cast<std::uint32_t>(m_parents.size());
+    // The subtree of the parent must end here, otherwise it would not be contiguous anymore
+    if (parent >= static_cast<std::int32_t>(node) ||
+        (parent >= 0 && static_cast<std::uint32_t>(parent) + m_subtree_sizes[parent] != node)) {
+        std::cerr << "Scene graph nodes must be added in depth first order\n";
+        exit(EXIT_FAILURE);
+    }
+
+    m_parents.push_back(parent);
+    m_subtree_sizes.push_back(1);
+    m_locals.push_back(local);
+    m_worlds.push_back(parent >= 0 ? m_worlds[parent] * local : local);
+    m_names.push_back(name);
+    m_dirty.push_back(0);
+
+    // Grow the subtrees of the ancestors
+    for (std::int32_t ancestor = parent; ancestor >= 0; ancestor = m_parents[ancestor]) {
+        ++m_subtree_sizes[ancestor];
+    }
+    return node;
+}
+
+void SceneGraph::clear() {
+    m_parents.clear();
+    m_subtree_sizes.clear();
+    m_locals.clear();
+    m_worlds.clear();
+    m_names.clear();
+    m_dirty.clear();
+    m_dirty_nodes.clear();
+    m_updated.clear();
+}
+
+void SceneGraph::setLocalTransform(std::uint32_t node, const glm::mat4& local) {
+    m_locals[node] = local;
+    if (!m_dirty[node]) {
+        m_dirty[node] = 1;
+        m_dirty_nodes.push_back(node);
+    }
+}
+
+const std::vector<NodeRange>& SceneGraph::update() {
+    m_updated.clear();
+    // Sorted nodes come in depth first order, a node inside a subtree already recomputed is skipped
+    std::sort(m_dirty_nodes.begin(), m_dirty_nodes.end());
+    std::uint32_t covered = 0;
+    for (const std::uint32_t node : m_dirty_nodes) {
+        m_dirty[node] = 0;
+        if (node < covered) {
+            continue;
+        }
+        // Parents come first in the range, the parent of the range root is outside and up to date
+        const std::uint32_t last = node + m_subtree_sizes[node];
+        for (std::uint32_t i = node; i < last; ++i) {
+            const std::int32_t parent = m_parents[i];
+            m_worlds[i] = parent >= 0 ? m_worlds[parent] * m_locals[i] : m_locals[i];
+        }
+        m_updated.push_back({node, last});
+        covered = last;
+    }
+    m_dirty_nodes.clear();
+    return m_updated;
+}
+
+std::int32_t SceneGraph::findNode(const std::string& name) const {
+    const auto it = std::find(m_names.begin(), m_names.end(), name);
+    return it == m_names.end() ? -1 : static_cast<std::int32_t>(it - m_names.begin());
+}
+
+std::size_t SceneGraph::getHostBytes() const noexcept {
+    std::size_t bytes = m_parents.capacity() * sizeof(std::int32_t) +
+                        m_subtree_sizes.capacity() * sizeof(std::uint32_t) +
+                        (m_locals.capacity() + m_worlds.capacity()) * sizeof(glm::mat4) +
+                        m_names.capacity() * sizeof(std::string) + m_dirty.capacity() +
+                        m_dirty_nodes.capacity() * sizeof(std::uint32_t) + m_updated.capacity() * sizeof(NodeRange);
+    // Characters of the names, an upper bound since short names are stored inside the strings
+    for (const auto& name : m_names) {
+        bytes += name.capacity();
+    }
+    return bytes;
+}
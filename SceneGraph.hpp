@@ -0,0 +1,97 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_SCENEGRAPH_HPP
+#define OPENGLPLAYGROUND_SCENEGRAPH_HPP
+
+#define GLM_FORCE_RADIANS
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Range of consecutive nodes [first, last)
+struct NodeRange {
+    std::uint32_t first;
+    std::uint32_t last;
+};
+
+// Hierarchy of transforms stored as parallel arrays in depth first order, a parent always comes before its children
+// and every subtree is a contiguous range. World matrices are only recomputed for the subtrees of the nodes whose local
+// transform changed since the last update
+class SceneGraph {
+private:
+    // Parent of each node, -1 for roots
+    std::vector<std::int32_t> m_parents;
+    // Number of nodes in the subtree of each node, itself included
+    std::vector<std::uint32_t> m_subtree_sizes;
+    // Transform relative to the parent
+    std::vector<glm::mat4> m_locals;
+    // Transform relative to the model
+    std::vector<glm::mat4> m_worlds;
+    // Names, used to find nodes to animate
+    std::vector<std::string> m_names;
+    // Set for the nodes in m_dirty_nodes
+    std::vector<unsigned char> m_dirty;
+    // Nodes whose local transform changed since the last update
+    std::vector<std::uint32_t> m_dirty_nodes;
+    // Ranges recomputed by the last update
+    std::vector<NodeRange> m_updated;
+
+public:
+    // Add node, nodes must be added in depth first order: the parent is the last added node or one of its ancestors.
+    // Returns the index of the node
+    std::uint32_t addNode(const std::string& name, std::int32_t parent, const glm::mat4& local);
+
+    // Remove all the nodes
+    void clear();
+
+    // Set the transform of a node relative to its parent, the world matrices are updated on the next update
+    void setLocalTransform(std::uint32_t node, const glm::mat4& local);
+
+    // Recompute the world matrices of the changed subtrees, returns the recomputed ranges
+    const std::vector<NodeRange>& update();
+
+    // Find node by name, returns -1 if there is none
+    std::int32_t findNode(const std::string& name) const;
+
+    // Get host memory held by the nodes, in bytes
+    std::size_t getHostBytes() const noexcept;
+
+    // Check if a local transform changed since the last update
+    inline bool isDirty() const noexcept {
+        return !m_dirty_nodes.empty();
+    }
+
+    // Get number of nodes
+    inline std::size_t size() const noexcept {
+        return m_parents.size();
+    }
+
+    // Get node data
+    inline std::int32_t getParent(std::uint32_t node) const {
+        return m_parents[node];
+    }
+
+    inline std::uint32_t getSubtreeSize(std::uint32_t node) const {
+        return m_subtree_sizes[node];
+    }
+
+    inline const std::string& getName(std::uint32_t node) const {
+        return m_names[node];
+    }
+
+    inline const glm::mat4& getLocalTransform(std::uint32_t node) const {
+        return m_locals[node];
+    }
+
+    // Transform of the node relative to the model, valid after update
+    inline const glm::mat4& getWorldTransform(std::uint32_t node) const {
+        return m_worlds[node];
+    }
+};
+
+#endif //OPENGLPLAYGROUND_SCENEGRAPH_HPP
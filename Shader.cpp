@@ -57,9 +57,29 @@ void Shader::printShaderLog() const {
 }
 
 Shader::Shader(const std::string& file_name, const ShaderType& type)
+        : Shader(file_name, type, {}) {}
+
+Shader::Shader(const std::string& file_name, const ShaderType& type, const std::vector<std::string>& defines)
         : m_shader_id(0), m_type(type) {
     // Code source
-    const std::string vertex_source = loadFile(file_name);
+    std::string vertex_source = loadFile(file_name);
+
+    // Insert defines, #version must stay the first statement of the shader
+    if (!defines.empty()) {
+        std::string defines_source;
+        for (const auto& define : defines) {
+            defines_source += "#define " + define + "\n";
+        }
+        std::size_t insert_position = 0;
+        if (vertex_source.compare(0, 8, "#version") == 0) {
+            const std::size_t line_end = vertex_source.find('\n');
+            insert_position = line_end == std::string::npos ? vertex_source.size() : line_end + 1;
+            if (line_end == std::string::npos) {
+                defines_source = "\n" + defines_source;
+            }
+        }
+        vertex_source.insert(insert_position, defines_source);
+    }
 
     // Get pointer to source
     const GLchar *source = vertex_source.c_str();
@@ -162,7 +182,7 @@ Program::Program(const std::initializer_list<Shader>& shaders)
 }
 
 void Program::destroy() {
-    glDeleteProgram(m_program_id);
+    GLState::getGlobal().deleteProgram(m_program_id);
 }
 
 void Program::validate() const noexcept {
@@ -5,6 +5,7 @@
 #ifndef OPENGLPLAYGROUND_SHADER_HPP
 #define OPENGLPLAYGROUND_SHADER_HPP
 
+#include "GLState.hpp"
 #include "GLUtils.hpp"
 #include "UniformBlock.hpp"
 // GLM include
@@ -45,6 +46,9 @@ public:
     // Constructor from a given string
     Shader(const std::string& file_name, const ShaderType& type);
 
+    // Constructor from a given file, the defines are inserted after the #version line
+    Shader(const std::string& file_name, const ShaderType& type, const std::vector<std::string>& defines);
+
     // Construct from a given list of strings, assumes the strings are null terminated
     Shader(const std::vector<std::string>& sources, const ShaderType& type);
 
@@ -98,9 +102,9 @@ public:
     // Destroy program
     void destroy();
 
-    // Use program
-    inline void use() const noexcept {
-        glUseProgram(m_program_id);
+    // Use program, no call when it is already in use
+    inline void use() const {
+        GLState::getGlobal().useProgram(m_program_id);
         GL_CHECK();
     }
 
@@ -0,0 +1,48 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "ThreadPool.hpp"
+
+ThreadPool::ThreadPool(std::size_t num_threads)
+        : m_stop(false) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    m_workers.reserve(num_threads);
+    for (std::size_t i = 0; i < num_threads; ++i) {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::getGlobal() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_stop && m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        task();
+    }
+}
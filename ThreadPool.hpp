@@ -0,0 +1,144 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_THREADPOOL_HPP
+#define OPENGLPLAYGROUND_THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads executing CPU tasks
+class ThreadPool {
+private:
+    // Worker threads
+    std::vector<std::thread> m_workers;
+    // Pending tasks
+    std::queue<std::function<void()>> m_tasks;
+    // Synchronisation of the task queue
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    // Set when the pool is shutting down
+    bool m_stop;
+
+    // Worker main loop
+    void workerLoop();
+
+public:
+    // Create pool with the given number of workers, 0 selects the number of hardware threads
+    explicit ThreadPool(std::size_t num_threads = 0);
+
+    // Joins all the workers, pending tasks are executed first
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Pool shared by the CPU side of asset processing
+    static ThreadPool& getGlobal();
+
+    // Get number of worker threads
+    inline std::size_t getNumThreads() const noexcept {
+        return m_workers.size();
+    }
+
+    // Submit a task, the returned future holds its result
+    template<typename F>
+    auto submit(F&& f) -> std::future<decltype(f())>;
+
+    // Run f(i) for every i in [0, count) and wait for completion. The calling thread takes part in the work, so it
+    // is safe to call from inside a task running on the pool. If f throws, the remaining items are skipped and the
+    // first exception is rethrown on the calling thread once all the claimed items are done
+    template<typename F>
+    void parallelFor(std::size_t count, const F& f);
+};
+
+template<typename F>
+auto ThreadPool::submit(F&& f) -> std::future<decltype(f())> {
+    using Result = decltype(f());
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+    std::future<Result> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace([task]() { (*task)(); });
+    }
+    m_condition.notify_one();
+    return result;
+}
+
+template<typename F>
+void ThreadPool::parallelFor(std::size_t count, const F& f) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || m_workers.empty()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    // Shared state, helpers that start after all the work is claimed only touch this
+    struct State {
+        std::atomic<std::size_t> next{0};
+        std::atomic<std::size_t> done{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr exception;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+
+    // Claim and run items until none is left. A throwing item still counts as done, otherwise the caller would wait
+    // forever, and the items claimed after a failure are only counted
+    const F *function = &f;
+    auto run = [state, function, count]() {
+        std::size_t i;
+        while ((i = state->next.fetch_add(1)) < count) {
+            if (!state->failed.load()) {
+                try {
+                    (*function)(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (!state->exception) {
+                        state->exception = std::current_exception();
+                    }
+                    state->failed.store(true);
+                }
+            }
+            if (state->done.fetch_add(1) + 1 == count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    // Enqueue helpers, at most one per worker
+    const std::size_t num_helpers = std::min(count - 1, m_workers.size());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (std::size_t h = 0; h < num_helpers; ++h) {
+            m_tasks.emplace(run);
+        }
+    }
+    m_condition.notify_all();
+
+    // Work on the calling thread too, then wait only for the items claimed by others
+    run();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state, count]() { return state->done.load() == count; });
+    if (state->exception) {
+        std::rethrow_exception(state->exception);
+    }
+}
+
+#endif //OPENGLPLAYGROUND_THREADPOOL_HPP
@@ -0,0 +1,99 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "UploadQueue.hpp"
+
+#include <algorithm>
+
+UploadQueue::UploadQueue()
+        : m_num_writes(0), m_last_flush{0, 0, 0} {}
+
+UploadQueue& UploadQueue::getGlobal() {
+    static UploadQueue queue;
+    return queue;
+}
+
+void UploadQueue::destroy() {
+    if (m_staging) {
+        m_staging->destroy();
+        m_staging.reset();
+    }
+    m_data.clear();
+    m_writes.clear();
+    m_num_writes = 0;
+}
+
+void UploadQueue::write(const Buffer& destination, std::size_t offset, const void *data, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    ++m_num_writes;
+    const auto bytes = static_cast<const unsigned char *>(data);
+    // A write continuing the previous one, e.g. consecutive meshes of a shared buffer, only extends it
+    if (!m_writes.empty() && m_writes.back().destination == destination.getID() &&
+        m_writes.back().offset + m_writes.back().size == offset) {
+        m_writes.back().size += size;
+    } else {
+        m_writes.push_back({destination.getID(), offset, m_data.size(), size});
+    }
+    m_data.insert(m_data.end(), bytes, bytes + size);
+}
+
+void UploadQueue::flush() {
+    if (m_writes.empty()) {
+        return;
+    }
+
+    // Sort by buffer and offset so that neighbours queued apart are merged too. Overlapping writes would then be
+    // applied out of order, in that case the queued order is kept
+    m_copies = m_writes;
+    std::stable_sort(m_copies.begin(), m_copies.end(), [](const Write& a, const Write& b) {
+        return a.destination != b.destination ? a.destination < b.destination : a.offset < b.offset;
+    });
+    for (std::size_t i = 1; i < m_copies.size(); ++i) {
+        if (m_copies[i].destination == m_copies[i - 1].destination &&
+            m_copies[i].offset < m_copies[i - 1].offset + m_copies[i - 1].size) {
+            m_copies = m_writes;
+            break;
+        }
+    }
+
+    // Gather the data in copy order, merged ranges are then contiguous in the staging buffer too. Copies are merged in
+    // place, the write is read before its slot may be reused
+    m_gathered.clear();
+    std::size_t num_copies = 0;
+    for (std::size_t i = 0; i < m_copies.size(); ++i) {
+        const Write write = m_copies[i];
+        if (num_copies > 0 && m_copies[num_copies - 1].destination == write.destination &&
+            m_copies[num_copies - 1].offset + m_copies[num_copies - 1].size == write.offset) {
+            m_copies[num_copies - 1].size += write.size;
+        } else {
+            m_copies[num_copies++] = {write.destination, write.offset, m_gathered.size(), write.size};
+        }
+        m_gathered.insert(m_gathered.end(), m_data.begin() + static_cast<std::ptrdiff_t>(write.source),
+                          m_data.begin() + static_cast<std::ptrdiff_t>(write.source + write.size));
+    }
+    m_copies.resize(num_copies);
+
+    // One upload to fresh staging storage, the copies of the previous flush may still read the old one
+    if (!m_staging) {
+        m_staging.reset(new Buffer(GL_COPY_READ_BUFFER, GL_STREAM_DRAW));
+    }
+    m_staging->bind();
+    m_staging->submitBytes(m_gathered.data(), m_gathered.size());
+    for (const Write& copy : m_copies) {
+        // State tracker skips the bind when the copy goes to the same buffer as the previous one
+        GLState::getGlobal().bindBuffer(GL_COPY_WRITE_BUFFER, copy.destination);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(copy.source),
+                            static_cast<GLintptr>(copy.offset), static_cast<GLsizeiptr>(copy.size));
+    }
+    GLState::getGlobal().bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    m_staging->unbind();
+    GL_CHECK();
+
+    m_last_flush = {m_num_writes, m_copies.size(), m_gathered.size()};
+    m_num_writes = 0;
+    m_data.clear();
+    m_writes.clear();
+}
@@ -0,0 +1,86 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_UPLOADQUEUE_HPP
+#define OPENGLPLAYGROUND_UPLOADQUEUE_HPP
+
+#include "Buffer.hpp"
+
+#include <memory>
+
+// Writes and copies of one flush of an UploadQueue
+struct UploadQueueStatistics {
+    // Writes queued, and glCopyBufferSubData calls they became
+    std::size_t num_writes;
+    std::size_t num_copies;
+    // Bytes uploaded
+    std::size_t num_bytes;
+
+    // Get number of writes merged into the copy of another one
+    inline std::size_t getNumMerged() const noexcept {
+        return num_writes - num_copies;
+    }
+};
+
+// Small writes to GL buffers collected in host memory and uploaded together. The data is copied when queued, so the
+// source can be released at once. On flush the writes are sorted by buffer and offset, the ones that follow each other
+// are merged, then everything is uploaded to a staging buffer with a single glBufferData and copied to the buffers
+// with one glCopyBufferSubData per merged range. Writes that overlap keep their queued order. Only used on the thread
+// of the context
+class UploadQueue {
+private:
+    // Queued write, source is the offset of the data in the host bytes
+    struct Write {
+        GLuint destination;
+        std::size_t offset;
+        std::size_t source;
+        std::size_t size;
+    };
+
+    // Data of the queued writes
+    std::vector<unsigned char> m_data;
+    // Queued writes
+    std::vector<Write> m_writes;
+    // Writes in upload order, and their data gathered in that order
+    std::vector<Write> m_copies;
+    std::vector<unsigned char> m_gathered;
+    // Buffer the data is uploaded to before the copies, created on the first flush
+    std::unique_ptr<Buffer> m_staging;
+    // Number of writes since the last flush
+    std::size_t m_num_writes;
+    // Statistics of the last flush that uploaded something
+    UploadQueueStatistics m_last_flush;
+
+public:
+    UploadQueue();
+
+    UploadQueue(const UploadQueue&) = delete;
+
+    UploadQueue& operator=(const UploadQueue&) = delete;
+
+    // Queue of the application, flushed once per frame before the draws
+    static UploadQueue& getGlobal();
+
+    // Destroy staging buffer, queued writes are dropped
+    void destroy();
+
+    // Queue a write of size bytes at offset in the destination buffer, which must exist until the next flush
+    void write(const Buffer& destination, std::size_t offset, const void *data, std::size_t size);
+
+    // Upload the queued writes. They are visible to the draws and copies issued after this call. Offsets are taken as
+    // they were queued, so buffers whose content moves, e.g. a compacted MeshBuffer, are flushed before
+    void flush();
+
+    // Check if writes are waiting for a flush
+    inline bool isEmpty() const noexcept {
+        return m_writes.empty();
+    }
+
+    // Get statistics of the last flush with writes
+    inline const UploadQueueStatistics& getLastFlush() const noexcept {
+        return m_last_flush;
+    }
+};
+
+#endif //OPENGLPLAYGROUND_UPLOADQUEUE_HPP
@@ -0,0 +1,132 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#include "VertexLayout.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+inline std::uint16_t encodeUnorm16(float v) {
+    return static_cast<std::uint16_t>(std::lround(glm::clamp(v, 0.f, 1.f) * 65535.f));
+}
+
+inline std::int16_t encodeSnorm16(float v) {
+    return static_cast<std::int16_t>(std::lround(glm::clamp(v, -1.f, 1.f) * 32767.f));
+}
+
+inline float signNotZero(float v) {
+    return v >= 0.f ? 1.f : -1.f;
+}
+
+// Project the normal on the octahedron and unfold the lower hemisphere
+inline glm::vec2 encodeOctahedral(const glm::vec3& n) {
+    const float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (l1 == 0.f) {
+        return glm::vec2(0.f, 0.f);
+    }
+    glm::vec2 p(n.x / l1, n.y / l1);
+    if (n.z < 0.f) {
+        p = glm::vec2((1.f - std::fabs(p.y)) * signNotZero(p.x), (1.f - std::fabs(p.x)) * signNotZero(p.y));
+    }
+    return p;
+}
+
+// Pack normal in GL_INT_2_10_10_10_REV, x in the lowest bits
+inline std::uint32_t encodeInt2101010(const glm::vec3& n) {
+    const auto component = [](float v) {
+        return static_cast<std::uint32_t>(std::lround(glm::clamp(v, -1.f, 1.f) * 511.f)) & 0x3FFu;
+    };
+    return component(n.x) | (component(n.y) << 10) | (component(n.z) << 20);
+}
+
+VertexLayout createLayout(VertexFormat format) {
+    switch (format) {
+        case VertexFormat::QuantizedOctahedral:
+            // Positions are padded to 8 bytes to keep the normal 4 bytes aligned
+            return {format, 12, {{0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0},
+                                 {1, 2, GL_SHORT, GL_TRUE, 8}}};
+        case VertexFormat::QuantizedPacked:
+            return {format, 12, {{0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0},
+                                 {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 8}}};
+        case VertexFormat::Float:
+        default:
+            return {VertexFormat::Float, sizeof(Vertex),
+                    {{0, 3, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(offsetof(Vertex, position))},
+                     {1, 3, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(offsetof(Vertex, normal))}}};
+    }
+}
+
+} // namespace
+
+const VertexLayout& VertexLayout::get(VertexFormat format) {
+    static const VertexLayout layouts[] = {createLayout(VertexFormat::Float),
+                                           createLayout(VertexFormat::QuantizedOctahedral),
+                                           createLayout(VertexFormat::QuantizedPacked)};
+    return layouts[static_cast<std::size_t>(format)];
+}
+
+void VertexLayout::setup(GLintptr base_offset) const {
+    for (const auto& attribute : attributes) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized, stride,
+                              reinterpret_cast<const void *>(base_offset + attribute.offset));
+    }
+    GL_CHECK();
+}
+
+std::vector<std::string> VertexLayout::getShaderDefines() const {
+    if (format == VertexFormat::QuantizedOctahedral) {
+        return {"OCTAHEDRAL_NORMALS"};
+    }
+    return {};
+}
+
+PositionQuantization::PositionQuantization(const AABB& bounds)
+        : origin(0.f), scale(1.f) {
+    if (bounds.isValid()) {
+        const glm::vec3 extent = bounds.getExtent();
+        origin = bounds.min;
+        scale = std::max(extent.x, std::max(extent.y, extent.z));
+        if (scale <= 0.f) {
+            scale = 1.f;
+        }
+    }
+}
+
+glm::mat4 PositionQuantization::getDequantizationMatrix() const {
+    return glm::scale(glm::translate(glm::mat4(1.f), origin), glm::vec3(scale));
+}
+
+void encodeVertices(const Vertex *vertices, std::size_t count, const VertexLayout& layout,
+                    const PositionQuantization& quantization, std::vector<unsigned char>& output) {
+    output.resize(count * layout.stride);
+    if (layout.format == VertexFormat::Float) {
+        std::memcpy(output.data(), vertices, count * sizeof(Vertex));
+        return;
+    }
+
+    const float inv_scale = 1.f / quantization.scale;
+    for (std::size_t i = 0; i < count; ++i) {
+        unsigned char *out = output.data() + i * layout.stride;
+        // Position
+        const glm::vec3 p = (vertices[i].position - quantization.origin) * inv_scale;
+        const std::uint16_t position[4] = {encodeUnorm16(p.x), encodeUnorm16(p.y), encodeUnorm16(p.z), 0};
+        std::memcpy(out, position, sizeof(position));
+        // Normal
+        if (layout.format == VertexFormat::QuantizedOctahedral) {
+            const glm::vec2 o = encodeOctahedral(vertices[i].normal);
+            const std::int16_t normal[2] = {encodeSnorm16(o.x), encodeSnorm16(o.y)};
+            std::memcpy(out + 8, normal, sizeof(normal));
+        } else {
+            const std::uint32_t normal = encodeInt2101010(vertices[i].normal);
+            std::memcpy(out + 8, &normal, sizeof(normal));
+        }
+    }
+}
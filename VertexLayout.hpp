@@ -0,0 +1,85 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+#ifndef OPENGLPLAYGROUND_VERTEXLAYOUT_HPP
+#define OPENGLPLAYGROUND_VERTEXLAYOUT_HPP
+
+#include "GLUtils.hpp"
+#include "Bounds.hpp"
+
+#include <vector>
+
+// Vertex data
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// Formats the vertices can be stored in on the GPU
+enum class VertexFormat {
+    // Position and normal as floats, 24 bytes
+    Float,
+    // Position as unorm16 in the quantization box, normal octahedral encoded as snorm16, 12 bytes
+    QuantizedOctahedral,
+    // Position as unorm16 in the quantization box, normal as GL_INT_2_10_10_10_REV, 12 bytes
+    QuantizedPacked
+};
+
+// Description of a single vertex attribute
+struct VertexAttribute {
+    // Attribute location in the shader
+    GLuint location;
+    // Number of components
+    GLint components;
+    // Component type
+    GLenum type;
+    // Normalize integer components to [0, 1] or [-1, 1]
+    GLboolean normalized;
+    // Offset from the beginning of the vertex
+    GLsizei offset;
+};
+
+// Layout of an interleaved vertex, drives the attribute setup of a VAO
+struct VertexLayout {
+    // Format described
+    VertexFormat format;
+    // Size of a vertex in bytes
+    GLsizei stride;
+    // Attributes
+    std::vector<VertexAttribute> attributes;
+
+    // Get layout of a given format
+    static const VertexLayout& get(VertexFormat format);
+
+    // Enable and set the attributes pointers for the currently bound VAO and GL_ARRAY_BUFFER, base_offset is the
+    // offset in bytes of the first vertex in the buffer
+    void setup(GLintptr base_offset = 0) const;
+
+    // Defines the shaders need to decode this layout
+    std::vector<std::string> getShaderDefines() const;
+};
+
+// Mapping of the positions to the unorm16 range, the scale is uniform so the normal matrix is unaffected
+struct PositionQuantization {
+    // Origin of the quantization cube
+    glm::vec3 origin;
+    // Size of the quantization cube
+    float scale;
+
+    // Identity quantization
+    PositionQuantization()
+            : origin(0.f), scale(1.f) {}
+
+    // Quantization cube enclosing the given bounds
+    explicit PositionQuantization(const AABB& bounds);
+
+    // Matrix mapping the quantized [0, 1] positions back to object space, to be folded into the model matrix
+    glm::mat4 getDequantizationMatrix() const;
+};
+
+// Encode vertices in the given layout, output is resized to count * stride bytes
+void encodeVertices(const Vertex *vertices, std::size_t count, const VertexLayout& layout,
+                    const PositionQuantization& quantization, std::vector<unsigned char>& output);
+
+#endif //OPENGLPLAYGROUND_VERTEXLAYOUT_HPP
@@ -7,15 +7,25 @@
 
 #include <iostream>
 #include "Shader.hpp"
-#include "Model.hpp"
+#include "ModelLoader.hpp"
+#include "DynamicBVH.hpp"
 #include "FrameCounter.hpp"
+#include "UploadQueue.hpp"
+#include "FrameUniforms.hpp"
+#include "InstanceBuffer.hpp"
 
 void processInput(GLFWwindow *window);
 
 void framebufferSizeCallback(GLFWwindow *window, int width, int height);
 
+void printRangeStatistics(const std::string& name, const RangeStatistics& statistics);
+
 int WIDTH = 1280;
 int HEIGHT = 1024;
+// Print the memory statistics every frame, toggled with M
+bool print_memory = false;
+// Compact the shared mesh buffer on the next frame, requested with C
+bool compact_buffer = false;
 const std::string title("OpenGL playground");
 
 int main() {
@@ -54,89 +64,115 @@ int main() {
     glClearColor(0.2f, 0.3f, 0.3f, 1.f);
 
     // Enable depth test
-    glEnable(GL_DEPTH_TEST);
+    GLState::getGlobal().enable(GL_DEPTH_TEST);
 
     // Enable face culling
-    glEnable(GL_CULL_FACE);
+    GLState::getGlobal().enable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CCW);
 
     // Load model
-    Model dragon_model("/Users/simon/Documents/Workspace/models/dragon.ply");
-
-    // Load shaders
-    Shader diffuse_shader_v("shaders/diffuse.vert", ShaderType::Vertex);
+    ModelImportOptions import_options;
+    import_options.weld_vertices = true;
+    import_options.optimize_meshes = true;
+    import_options.lod_levels = 4;
+    import_options.split_index_ranges = true;
+    import_options.vertex_format = VertexFormat::QuantizedOctahedral;
+    import_options.shared_buffers = true;
+    import_options.occluder_triangles = 4096;
+    import_options.build_meshlets = true;
+    // Model is streamed in the background, its meshes are drawn as soon as they are resident
+    ModelLoader model_loader;
+    const auto dragon = model_loader.load("/Users/simon/Documents/Workspace/models/dragon.ply", import_options);
+    Model& dragon_model = dragon->getModel();
+
+    // Load shaders, the layout is known from the options before the model is loaded
+    const auto shader_defines = VertexLayout::get(import_options.vertex_format).getShaderDefines();
+    Shader diffuse_shader_v("shaders/diffuse.vert", ShaderType::Vertex, shader_defines);
     Shader diffuse_shader_f("shaders/diffuse.frag", ShaderType::Fragment);
     // Create program
     Program diffuse_program({diffuse_shader_v, diffuse_shader_f});
+    // Per object matrices are read from a range of the object buffer
+    ObjectTransforms::setupProgram(diffuse_program);
 
     // Prefetch attributes and uniforms locations
     diffuse_program.prefetchAttributes({"vertex_position", "vertex_normal"});
-    diffuse_program.prefetchUniform("model");
-    diffuse_program.prefetchUniformBlock("Matrices");
+    diffuse_program.prefetchUniformBlock("Object");
     // Print informations
 #ifndef NDEBUG
     diffuse_program.printInformations();
 #endif
 
     // Load shaders
-    Shader normal_shader_v("shaders/normal.vert", ShaderType::Vertex);
+    Shader normal_shader_v("shaders/normal.vert", ShaderType::Vertex, shader_defines);
     Shader normal_shader_f("shaders/normal.frag", ShaderType::Fragment);
     // Create program
     Program normal_program({normal_shader_v, normal_shader_f});
+    // Per object matrices are read from a range of the object buffer
+    ObjectTransforms::setupProgram(normal_program);
 
     // Prefetch attributes and uniforms locations
     normal_program.prefetchAttributes({"vertex_position", "vertex_normal"});
-    normal_program.prefetchUniform("model");
-    normal_program.prefetchUniformBlock("Matrices");
+    normal_program.prefetchUniformBlock("Object");
     // Print informations
 #ifndef NDEBUG
     normal_program.printInformations();
 #endif
 
-    // Create buffer with view and projection matrix
-    const std::vector<glm::mat4> matrices = {
-            glm::lookAt(glm::vec3(0.f, 2.f, 7.f), glm::vec3(0.f, 0.2f, 0.f), glm::vec3(0.f, 1.f, 0.f)),
-            glm::perspective(glm::radians(45.f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 20.f)};
-
-//    // Create a buffer to store
-//    GLuint matrices_buffer;
-//    glGenBuffers(1, &matrices_buffer);
-//    // Bind buffer to uniform buffer
-//    glBindBuffer(GL_UNIFORM_BUFFER, matrices_buffer);
-
-    // Create uniform buffer
-    Buffer matrices_buffer(GL_UNIFORM_BUFFER, GL_STATIC_DRAW);
-    matrices_buffer.bind();
-
-    // Upload data
-    const auto& un_block = diffuse_program.getUniformBlock("Matrices");
-    constexpr bool whole_buffer = true;
-
-    if (whole_buffer) {
-        // Send data to buffer
-        matrices_buffer.submitData(matrices);
-    } else {
-        // Allocate space
-        matrices_buffer.allocateSpace(un_block.getBlockSize());
-        // Send view matrix
-        auto view_desc = un_block.getUniformDescription("view");
-        matrices_buffer.submitSubData<glm::mat4>(
-                std::vector<glm::mat4>(matrices.begin(), matrices.begin() + 1), view_desc.offset);
-        // Send projection matrix
-        auto proj_desc = un_block.getUniformDescription("proj");
-        matrices_buffer.submitSubData<glm::mat4>(
-                std::vector<glm::mat4>(matrices.begin() + 1, matrices.end()), proj_desc.offset);
+    // Load the instanced variant of the diffuse vertex shader, the fragment shader is shared
+    auto instanced_defines = shader_defines;
+    instanced_defines.push_back("INSTANCED");
+    Shader instanced_shader_v("shaders/diffuse.vert", ShaderType::Vertex, instanced_defines);
+    // Create program
+    Program instanced_program({instanced_shader_v, diffuse_shader_f});
+    // Camera matrices are read from a range of the frame uniforms, the instances can not be drawn without them
+    if (!FrameUniforms::setupProgram(instanced_program, "Matrices", MATRICES_BLOCK_BINDING)) {
+        std::cerr << "Instanced program does not read the Matrices block\n";
+        glfwTerminate();
+        exit(EXIT_FAILURE);
     }
 
-    matrices_buffer.unbind();
+    // Prefetch attributes and uniforms locations
+    instanced_program.prefetchAttributes({"vertex_position", "vertex_normal", "instance_model", "instance_color",
+                                          "instance_normal"});
+    instanced_program.prefetchUniform("model");
+    instanced_program.prefetchUniform("normal_model");
+    instanced_program.prefetchUniformBlock("Matrices");
+    // Print informations
+#ifndef NDEBUG
+    instanced_program.printInformations();
+#endif
 
-    // Bind buffer object to shader binding point
-    glBindBufferBase(GL_UNIFORM_BUFFER, diffuse_program.getUniformBlock("Matrices").getBindingPoint(),
-                     matrices_buffer.getID());
-    glBindBufferBase(GL_UNIFORM_BUFFER, normal_program.getUniformBlock("Matrices").getBindingPoint(),
-                     matrices_buffer.getID());
-    GL_CHECK();
+    // View and projection matrices
+    const glm::mat4 matrices[] = {
+            glm::lookAt(glm::vec3(0.f, 2.f, 7.f), glm::vec3(0.f, 0.2f, 0.f), glm::vec3(0.f, 1.f, 0.f)),
+            glm::perspective(glm::radians(45.f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, 20.f)};
+
+    // Matrices of the drawn nodes, recomputed and uploaded once per frame
+    ObjectTransforms objects;
+    // Camera matrices of the instanced program, written to a new range of the frame uniforms every frame
+    FrameUniforms frame_uniforms;
+    const std::size_t matrices_block = frame_uniforms.addBlock(MATRICES_BLOCK_BINDING, sizeof(MatricesConstants));
+
+    // Scene hierarchy over the placed dragons, the user data is the index of the placement
+    DynamicBVH scene;
+    int placement_proxies[2] = {DynamicBVH::NULL_NODE, DynamicBVH::NULL_NODE};
+    std::vector<std::size_t> visible_placements;
+    // First object of each placement
+    std::size_t placement_objects[2] = {0, 0};
+    // Culled meshes, levels of detail and draw commands of each placement
+    ModelVisibility placement_visibility[2];
+    // Row of small tinted dragons behind the placements, drawn with one instanced draw per range
+    constexpr std::size_t NUM_INSTANCES = 5;
+    const glm::vec4 instance_colors[NUM_INSTANCES] = {
+            glm::vec4(1.f, 0.4f, 0.4f, 1.f), glm::vec4(1.f, 0.8f, 0.4f, 1.f), glm::vec4(0.4f, 1.f, 0.4f, 1.f),
+            glm::vec4(0.4f, 0.8f, 1.f, 1.f), glm::vec4(0.8f, 0.4f, 1.f, 1.f)};
+    glm::mat4 instance_models[NUM_INSTANCES];
+    InstanceBuffer instances;
+    // Levels of detail of the instances, shared by all of them
+    ModelVisibility instance_visibility;
+    // Depth of the occluders rasterized on the CPU
+    OcclusionBuffer occlusion;
 
     double last_frame_update = 0.0;
 
@@ -156,30 +192,129 @@ int main() {
         // Process input
         processInput(window);
 
+        // Continue model uploads
+        model_loader.update();
+
+        // Upload the writes queued since the last frame, e.g. by the meshes of models created in between
+        UploadQueue::getGlobal().flush();
+
+        // Move the meshes together in the shared buffer, the draw commands notice the new generation and are rebuilt
+        if (compact_buffer) {
+            compact_buffer = false;
+            MeshBuffer *buffer = dragon_model.getBuffer();
+            if (buffer != nullptr) {
+                std::cout << "Before compaction\n";
+                printRangeStatistics("Vertex", buffer->getVertexStatistics());
+                printRangeStatistics("Index", buffer->getIndexStatistics());
+                buffer->compact();
+                std::cout << "After compaction\n";
+                printRangeStatistics("Vertex", buffer->getVertexStatistics());
+                printRangeStatistics("Index", buffer->getIndexStatistics());
+            }
+        }
+
         // Clear color and depth buffer
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Compute rotation matrix
-        auto translate = glm::translate(glm::mat4(1.f), glm::vec3(-2.f, 0.f, 0.f));
         const auto rotation = glm::rotate(glm::mat4(1.f),
                                           glm::radians(45.f) * static_cast<float>(glfwGetTime()),
                                           glm::vec3(0.f, 1.f, 0.f));
+        // Placements of the left and right dragons
+        const glm::mat4 placements[2] = {
+                glm::translate(glm::mat4(1.f), glm::vec3(-2.f, 0.f, 0.f)) * rotation,
+                glm::translate(glm::mat4(1.f), glm::vec3(2.f, 0.f, 0.f)) * rotation};
+
+        // Apply the node transforms changed since the last frame
+        dragon_model.updateTransforms();
+
+        // Update the scene hierarchy, the bounds are known once the model started streaming in
+        if (dragon_model.getBounds().isValid()) {
+            for (std::size_t i = 0; i < 2; ++i) {
+                const AABB box = dragon_model.getBounds().transform(placements[i]);
+                if (placement_proxies[i] == DynamicBVH::NULL_NODE) {
+                    placement_proxies[i] = scene.insert(box, i);
+                } else {
+                    scene.move(placement_proxies[i], box);
+                }
+            }
+        }
 
-        // Add translation
-        auto model_diffuse = translate * rotation; //glm::translate(scale_rot, glm::vec3(-0.1f, 0.f, 0.f));
+        // Find visible placements
+        visible_placements.clear();
+        scene.query(Frustum(matrices[1] * matrices[0]), visible_placements);
 
-        diffuse_program.use();
-        diffuse_program.setMat4("model", model_diffuse);
-        // Draw mesh
-        dragon_model.draw();
+        // Write the camera matrices of the frame and bind their range
+        frame_uniforms.set(matrices_block, MatricesConstants{matrices[0], matrices[1]});
+        frame_uniforms.update();
 
-        // Draw right dragon
-        translate = glm::translate(glm::mat4(1.f), glm::vec3(2.f, 0.f, 0.f));
-        auto model_normal = translate * rotation;
-        normal_program.use();
-        normal_program.setMat4("model", model_normal);
-        // Draw mesh
-        dragon_model.draw();
+        // Compute the matrices of every visible node in one pass
+        objects.clear();
+        for (const std::size_t placement : visible_placements) {
+            placement_objects[placement] = dragon_model.appendTransforms(placements[placement], objects);
+        }
+        objects.update(matrices[0], matrices[1]);
+
+        // Rasterize the occluders of every visible placement before culling any of them
+        occlusion.clear();
+        for (const std::size_t placement : visible_placements) {
+            dragon_model.renderOccluders(occlusion, placements[placement], matrices[1] * matrices[0]);
+        }
+        occlusion.buildHierarchy();
+
+        for (const std::size_t placement : visible_placements) {
+            // Left dragon is diffuse, right one shows the normals
+            const Program& program = placement == 0 ? diffuse_program : normal_program;
+            program.use();
+            // Cull meshes and pick levels of detail for this placement, kept apart from the other placement
+            ModelVisibility& visibility = placement_visibility[placement];
+            dragon_model.cull(visibility, placements[placement], matrices[1] * matrices[0], &occlusion);
+            dragon_model.selectLods(visibility, placements[placement], matrices[0], matrices[1],
+                                    static_cast<float>(HEIGHT));
+            // Skip the clusters of the selected level that are off screen or face away from the camera
+            dragon_model.cullMeshlets(visibility, placements[placement], matrices[0], matrices[1]);
+            // Draw mesh, the node transforms and the dequantization of the positions are folded into the object matrices
+            dragon_model.draw(visibility, objects, placement_objects[placement]);
+        }
+
+        // Instances turn the other way, their matrices are written to the region of the frame in the instance buffer
+        instances.beginFrame();
+        for (std::size_t i = 0; i < NUM_INSTANCES; ++i) {
+            const float x = 2.f * (static_cast<float>(i) - 0.5f * static_cast<float>(NUM_INSTANCES - 1));
+            instance_models[i] = glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(x, -0.5f, -4.f)),
+                                            glm::vec3(0.5f)) * glm::transpose(rotation);
+        }
+        instances.submit(instance_models, instance_colors, NUM_INSTANCES);
+        instanced_program.use();
+        // Levels are selected for the middle instance, the closest to the camera
+        dragon_model.selectLods(instance_visibility, instance_models[NUM_INSTANCES / 2], matrices[0], matrices[1],
+                                static_cast<float>(HEIGHT));
+        dragon_model.drawInstanced(instance_visibility, instances, instanced_program);
+
+        // Dump memory statistics
+        if (print_memory) {
+            ModelMemoryUsage usage = dragon_model.getMemoryUsage();
+            for (const auto& visibility : placement_visibility) {
+                const ModelMemoryUsage visibility_usage = visibility.getMemoryUsage();
+                usage.gpu_bytes += visibility_usage.gpu_bytes;
+                usage.host_bytes += visibility_usage.host_bytes;
+            }
+            std::cout << "Dragon " << usage.gpu_bytes << " GPU bytes, " << usage.host_bytes << " host bytes\n";
+            MemoryStats::getGlobal().print(std::cout);
+            const UploadQueueStatistics& uploads = UploadQueue::getGlobal().getLastFlush();
+            std::cout << "Last queued upload " << uploads.num_writes << " writes in " << uploads.num_copies
+                      << " copies, " << uploads.getNumMerged() << " merged\n";
+            std::cout << "GL state " << GLState::getGlobal().getFrameCalls() << " binding calls, "
+                      << GLState::getGlobal().getFrameAvoided() << " avoided last frame\n";
+            if (dragon_model.getBuffer() != nullptr) {
+                printRangeStatistics("Vertex", dragon_model.getBuffer()->getVertexStatistics());
+                printRangeStatistics("Index", dragon_model.getBuffer()->getIndexStatistics());
+            }
+        }
+
+        // Close the upload and binding statistics of the frame
+        MemoryStats::getGlobal().endFrame();
+        GLState::getGlobal().endFrame();
 
         // Swap buffer
         glfwSwapBuffers(window);
@@ -190,11 +325,21 @@ int main() {
 
     // Cleanup
 
-    // Destroy matrices buffer
-    matrices_buffer.destroy();
+    // Destroy object matrices and frame uniforms buffers
+    objects.destroy();
+    frame_uniforms.destroy();
 
-    // Destroy model
+    // Destroy draw commands, instances, model and loader
+    for (auto& visibility : placement_visibility) {
+        visibility.destroy();
+    }
+    instance_visibility.destroy();
+    instances.destroy();
     dragon_model.destroy();
+    model_loader.destroy();
+
+    // Destroy staging buffer of the upload queue
+    UploadQueue::getGlobal().destroy();
 
     // destroy shaders
     diffuse_shader_v.destroy();
@@ -205,6 +350,9 @@ int main() {
     normal_shader_f.destroy();
     normal_program.destroy();
 
+    instanced_shader_v.destroy();
+    instanced_program.destroy();
+
     glfwTerminate();
 
     exit(EXIT_SUCCESS);
@@ -214,6 +362,25 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     }
+    // Toggle on the press only, not on every frame the key is held
+    static bool memory_key_down = false;
+    const bool memory_key = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memory_key && !memory_key_down) {
+        print_memory = !print_memory;
+    }
+    memory_key_down = memory_key;
+    static bool compact_key_down = false;
+    const bool compact_key = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (compact_key && !compact_key_down) {
+        compact_buffer = true;
+    }
+    compact_key_down = compact_key;
+}
+
+void printRangeStatistics(const std::string& name, const RangeStatistics& statistics) {
+    std::cout << name << " ranges " << statistics.used << " / " << statistics.capacity << " bytes in "
+              << statistics.num_allocations << " allocations, " << statistics.num_free_blocks << " free blocks, "
+              << 100.f * statistics.getFragmentation() << "% fragmentation\n";
 }
 
 void framebufferSizeCallback(GLFWwindow *, int width, int height) {
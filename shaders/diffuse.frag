@@ -4,6 +4,8 @@ in VS_OUT {
     // Vertex and normal in camera space
     vec3 vertex_camera;
     vec3 normal_camera;
+    // Color of the instance
+    vec4 color;
 } fs_in;
 
 // Output fragment color
@@ -13,5 +15,5 @@ void main() {
     // Compute color based on normal and camera position
     float n_dot_dir = dot(normalize(-fs_in.vertex_camera), fs_in.normal_camera);
     // Output fragment color
-    frag_color = vec4(n_dot_dir, n_dot_dir, n_dot_dir, 1.f);
+    frag_color = vec4(n_dot_dir, n_dot_dir, n_dot_dir, 1.f) * fs_in.color;
 }
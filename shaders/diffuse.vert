@@ -2,28 +2,73 @@
 
 // Array attributes
 layout (location = 0) in vec3 vertex_position;
+#ifdef OCTAHEDRAL_NORMALS
+layout (location = 1) in vec2 vertex_normal;
+#else
 layout (location = 1) in vec3 vertex_normal;
+#endif
+#ifdef INSTANCED
+// Instance attributes
+layout (location = 2) in mat4 instance_model;
+layout (location = 6) in vec4 instance_color;
+layout (location = 7) in mat3 instance_normal;
+#endif
 
-// Matrices uniform block
-uniform Matrices {
+#ifdef INSTANCED
+// Matrices uniform block, rewritten every frame by FrameUniforms
+layout (std140) uniform Matrices {
     mat4 view;
     mat4 proj;
 };
 
-// Model matrix
+// Model matrix, applied before the instance matrix, and its normal matrix
 uniform mat4 model;
+uniform mat3 normal_model;
+#else
+// Object uniform block, computed once per object on the CPU
+layout (std140) uniform Object {
+    mat4 model_view;
+    mat4 mvp;
+    mat3 normal_view;
+    mat3 normal_model;
+};
+#endif
 
 out VS_OUT {
     // Vertex and normal in camera space
     vec3 vertex_camera;
     vec3 normal_camera;
+    // Color of the instance
+    vec4 color;
 } vs_out;
 
+// Decode normal attribute
+vec3 getNormal() {
+#ifdef OCTAHEDRAL_NORMALS
+    vec3 n = vec3(vertex_normal, 1.0 - abs(vertex_normal.x) - abs(vertex_normal.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+#else
+    return vertex_normal;
+#endif
+}
+
 void main() {
+#ifdef INSTANCED
+    // Instance matrices come from attributes, the normal matrices are computed on the CPU. The normal matrix of a
+    // product is the product of the normal matrices, the view is rigid so its own is its upper 3x3
+    mat4 world_view = view * instance_model * model;
+	gl_Position = proj * world_view * vec4(vertex_position, 1.0);
+	vs_out.vertex_camera = (world_view * vec4(vertex_position, 1.0)).xyz;
+	vs_out.normal_camera = normalize(mat3(view) * instance_normal * normal_model * getNormal());
+	vs_out.color = instance_color;
+#else
     // Compute output position
-	gl_Position = proj * view * model * vec4(vertex_position, 1.0);
-	mat3 normal = transpose(inverse(mat3(view * model)));
+	gl_Position = mvp * vec4(vertex_position, 1.0);
 	// Compute variables in camera space
-	vs_out.vertex_camera = (view * model * vec4(vertex_position, 1.0)).xyz;
-	vs_out.normal_camera = normalize(normal * vertex_normal);
-}
\ No newline at end of file
+	vs_out.vertex_camera = (model_view * vec4(vertex_position, 1.0)).xyz;
+	vs_out.normal_camera = normalize(normal_view * getNormal());
+	vs_out.color = vec4(1.0);
+#endif
+}
@@ -2,23 +2,63 @@
 
 // Array attributes
 layout (location = 0) in vec3 vertex_position;
+#ifdef OCTAHEDRAL_NORMALS
+layout (location = 1) in vec2 vertex_normal;
+#else
 layout (location = 1) in vec3 vertex_normal;
+#endif
+#ifdef INSTANCED
+// Instance attributes
+layout (location = 2) in mat4 instance_model;
+layout (location = 6) in vec4 instance_color;
+layout (location = 7) in mat3 instance_normal;
+#endif
 
-// Matrices uniform block
-uniform Matrices {
+#ifdef INSTANCED
+// Matrices uniform block, rewritten every frame by FrameUniforms
+layout (std140) uniform Matrices {
     mat4 view;
     mat4 proj;
 };
 
-// Model matrix
+// Model matrix, applied before the instance matrix, and its normal matrix
 uniform mat4 model;
+uniform mat3 normal_model;
+#else
+// Object uniform block, computed once per object on the CPU
+layout (std140) uniform Object {
+    mat4 model_view;
+    mat4 mvp;
+    mat3 normal_view;
+    mat3 normal_model;
+};
+#endif
 
 // Output normal
 out vec3 interp_normal;
 
+// Decode normal attribute
+vec3 getNormal() {
+#ifdef OCTAHEDRAL_NORMALS
+    vec3 n = vec3(vertex_normal, 1.0 - abs(vertex_normal.x) - abs(vertex_normal.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+#else
+    return vertex_normal;
+#endif
+}
+
 void main() {
+#ifdef INSTANCED
+    // Instance matrices come from attributes, the normal matrices are computed on the CPU. The normal matrix of a
+    // product is the product of the normal matrices
+	gl_Position = proj * view * instance_model * model * vec4(vertex_position, 1.0);
+	interp_normal = normalize(instance_normal * normal_model * getNormal());
+#else
     // Compute output position
-	gl_Position = proj * view * model * vec4(vertex_position, 1.0);
+	gl_Position = mvp * vec4(vertex_position, 1.0);
 	// Compute output normal
-	interp_normal = normalize(transpose(inverse(mat3(model))) * vertex_normal);
+	interp_normal = normalize(normal_model * getNormal());
+#endif
 }
@@ -0,0 +1,95 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+// CPU tests of the frustum culling: the SIMD cull must match the scalar test, then the cull of 500k boxes is timed on
+// the global thread pool. No context is needed
+
+#include "Frustum.hpp"
+#include "ThreadPool.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Number of boxes of the benchmark
+constexpr std::size_t BENCHMARK_BOXES = 500000;
+// Culls timed per variant
+constexpr int BENCHMARK_RUNS = 20;
+
+// Report a failed check
+bool check(bool condition, const char *message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << "\n";
+    }
+    return condition;
+}
+
+// Average time of a cull in milliseconds
+template<typename F>
+double timeCull(const F& cull) {
+    cull();
+    const auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < BENCHMARK_RUNS; ++run) {
+        cull();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / BENCHMARK_RUNS;
+}
+
+} // namespace
+
+int main() {
+    const glm::mat4 view_proj = glm::perspective(glm::radians(45.f), 1.25f, 0.1f, 100.f) *
+                                glm::lookAt(glm::vec3(0.f, 2.f, 7.f), glm::vec3(0.f, 0.2f, 0.f),
+                                            glm::vec3(0.f, 1.f, 0.f));
+    const Frustum frustum(view_proj);
+
+    // Random boxes around the camera, a few percent are visible
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-60.f, 60.f);
+    std::uniform_real_distribution<float> extent(0.01f, 3.f);
+    std::vector<AABB> boxes;
+    CullingVolumes volumes;
+    for (std::size_t i = 0; i < BENCHMARK_BOXES; ++i) {
+        const glm::vec3 center(position(rng), position(rng), position(rng));
+        const glm::vec3 half(extent(rng), extent(rng), extent(rng));
+        boxes.emplace_back(center - half, center + half);
+        volumes.add(boxes.back());
+    }
+
+    // Both variants must match the scalar test, padding boxes are never reported
+    bool success = true;
+    std::vector<unsigned char> flags;
+    std::vector<std::uint32_t> indices;
+    volumes.cull(frustum, flags);
+    volumes.cull(frustum, indices);
+    std::size_t num_visible = 0;
+    std::size_t num_mismatches = 0;
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+        const bool visible = frustum.intersects(boxes[i]);
+        num_visible += visible;
+        num_mismatches += visible != (flags[i] != 0);
+    }
+    success &= check(flags.size() == boxes.size(), "one flag per box");
+    success &= check(num_mismatches == 0, "flags match the scalar test");
+    success &= check(indices.size() == num_visible, "one index per visible box");
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        success &= check(flags[indices[i]] != 0 && (i == 0 || indices[i] > indices[i - 1]),
+                         "indices are the visible boxes in order");
+    }
+
+    // Benchmark, the thread count is the one of the global pool
+    const double flags_ms = timeCull([&]() { volumes.cull(frustum, flags); });
+    const double indices_ms = timeCull([&]() { volumes.cull(frustum, indices); });
+    std::cout << BENCHMARK_BOXES << " boxes, " << num_visible << " visible, "
+              << ThreadPool::getGlobal().getNumThreads() << " threads: " << flags_ms << " ms with flags, "
+              << indices_ms << " ms with indices\n";
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,257 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+// CPU tests of the occlusion culling: boxes behind a wall, conservative coverage and depth of random polygons, and
+// boxes fitted inside a closed mesh. No context is needed
+
+#include "OcclusionCulling.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Random triangles and quads of the coverage check
+constexpr int RANDOM_TRIANGLES = 3000;
+
+// Report a failed check
+bool check(bool condition, const char *message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << "\n";
+    }
+    return condition;
+}
+
+// Camera looking at the origin from +z
+glm::mat4 getViewProj() {
+    return glm::perspective(0.8f, 2.f, 0.1f, 100.f) *
+           glm::lookAt(glm::vec3(0.f, 0.f, 10.f), glm::vec3(0.f), glm::vec3(0.f, 1.f, 0.f));
+}
+
+// Boxes behind a 4x4 wall at z = 0 are hidden, the others are not
+bool testWall() {
+    const glm::mat4 view_proj = getViewProj();
+    OcclusionBuffer occlusion(256, 128);
+    occlusion.clear();
+    const glm::vec3 positions[] = {{-2.f, -2.f, 0.f}, {2.f, -2.f, 0.f}, {2.f, 2.f, 0.f}, {-2.f, 2.f, 0.f}};
+    const std::uint32_t indices[] = {0, 1, 2, 0, 2, 3};
+    occlusion.renderOccluder(positions, indices, 6, view_proj);
+    occlusion.buildHierarchy();
+    const auto occluded = [&](const glm::vec3& min, const glm::vec3& max) {
+        return occlusion.isOccluded(AABB(min, max), view_proj);
+    };
+
+    bool success = true;
+    success &= check(occluded({-0.5f, -0.5f, -3.f}, {0.5f, 0.5f, -2.f}), "small box behind the wall");
+    success &= check(occluded({-1.5f, -1.5f, -5.f}, {1.5f, 1.5f, -1.f}), "large box behind the wall");
+    success &= check(occluded({0.8f, -1.6f, -3.f}, {1.6f, -0.8f, -2.f}), "box behind one triangle");
+    success &= check(occluded({-0.1f, -0.1f, -80.f}, {0.1f, 0.1f, -79.f}), "far box behind the wall");
+    success &= check(!occluded({-0.5f, -0.5f, 1.f}, {0.5f, 0.5f, 2.f}), "box in front of the wall");
+    success &= check(!occluded({-0.5f, -0.5f, -1.f}, {0.5f, 0.5f, 1.f}), "box crossing the wall");
+    success &= check(!occluded({3.f, -0.5f, -3.f}, {4.f, 0.5f, -2.f}), "box beside the wall");
+    success &= check(!occluded({1.5f, -0.5f, -3.f}, {2.5f, 0.5f, -2.f}), "box peeking past the wall");
+    success &= check(!occluded({-1.f, -1.f, 11.f}, {1.f, 1.f, 12.f}), "box behind the camera");
+    return success;
+}
+
+// Count the texels written outside a convex polygon in screen space or nearer than the polygon over them, its depth
+// is the plane of its first three vertices
+std::size_t countWrongTexels(const OcclusionBuffer& occlusion, const glm::vec3 *screen, std::size_t count,
+                             std::size_t& written) {
+    float area = 0.f;
+    for (std::size_t v = 0; v < count; ++v) {
+        area += screen[v].x * screen[(v + 1) % count].y - screen[v].y * screen[(v + 1) % count].x;
+    }
+    const glm::vec3& a = screen[0];
+    const glm::vec3& b = screen[1];
+    const glm::vec3& c = screen[2];
+    const float plane_area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    std::size_t wrong = 0;
+    for (std::size_t y = 0; y < occlusion.getHeight(); ++y) {
+        for (std::size_t x = 0; x < occlusion.getWidth(); ++x) {
+            const float depth = occlusion.getDepth(x, y);
+            if (depth >= 1.f) {
+                continue;
+            }
+            ++written;
+            // Sides of the polygon and depth at the four corners of the texel
+            bool covered = true;
+            float max_depth = 0.f;
+            for (std::size_t corner = 0; corner < 4; ++corner) {
+                const float px = static_cast<float>(x + corner % 2);
+                const float py = static_cast<float>(y + corner / 2);
+                for (std::size_t v = 0; v < count; ++v) {
+                    const glm::vec3& p = screen[v];
+                    const glm::vec3& q = screen[(v + 1) % count];
+                    covered &= ((q.x - p.x) * (py - p.y) - (q.y - p.y) * (px - p.x)) / area >= -1e-4f;
+                }
+                const float u = ((px - a.x) * (c.y - a.y) - (py - a.y) * (c.x - a.x)) / plane_area;
+                const float w = ((b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x)) / plane_area;
+                max_depth = std::max(max_depth, a.z + u * (b.z - a.z) + w * (c.z - a.z));
+            }
+            if (!covered || depth < max_depth - 1e-4f) {
+                ++wrong;
+            }
+        }
+    }
+    return wrong;
+}
+
+// Check if a polygon in screen space turns the same way at all its corners
+bool isConvex(const glm::vec3 *screen, std::size_t count) {
+    std::size_t positive = 0;
+    for (std::size_t v = 0; v < count; ++v) {
+        const glm::vec3& p = screen[v];
+        const glm::vec3& q = screen[(v + 1) % count];
+        const glm::vec3& r = screen[(v + 2) % count];
+        positive += (q.x - p.x) * (r.y - q.y) - (q.y - p.y) * (r.x - q.x) > 0.f;
+    }
+    return positive == 0 || positive == count;
+}
+
+// Every texel written by a random triangle, or by two triangles forming a flat quad, is entirely inside it and gets
+// at least the farthest depth over the texel
+bool testConservativePolygons() {
+    const glm::mat4 view_proj = getViewProj();
+    const std::size_t width = 64;
+    const std::size_t height = 32;
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> coordinate(-1.f, 1.f);
+    const auto random_position = [&]() {
+        return glm::vec3(6.7f * coordinate(rng), 3.3f * coordinate(rng), 5.f * coordinate(rng));
+    };
+    std::size_t written[2] = {0, 0};
+    std::size_t wrong[2] = {0, 0};
+    for (int t = 0; t < RANDOM_TRIANGLES; ++t) {
+        for (std::size_t count = 3; count <= 4; ++count) {
+            // Quads are a parallelogram of the first three positions, so they are flat
+            glm::vec3 positions[4] = {random_position(), random_position(), random_position()};
+            positions[3] = positions[0] + positions[2] - positions[1];
+            const std::uint32_t indices[6] = {0, 1, 2, 0, 2, 3};
+            OcclusionBuffer occlusion(width, height);
+            occlusion.clear();
+            occlusion.renderOccluder(positions, indices, count == 3 ? 3 : 6, view_proj);
+
+            // Same projection as the buffer, polygons crossing the near plane are not drawn
+            glm::vec3 screen[4];
+            bool clipped = false;
+            for (std::size_t v = 0; v < count; ++v) {
+                const glm::vec4 clip = view_proj * glm::vec4(positions[v], 1.f);
+                clipped |= clip.w <= 0.f || clip.z < -clip.w;
+                screen[v] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * static_cast<float>(width),
+                                      (clip.y / clip.w * 0.5f + 0.5f) * static_cast<float>(height),
+                                      clip.z / clip.w * 0.5f + 0.5f);
+            }
+            if (clipped || !isConvex(screen, count)) {
+                continue;
+            }
+            wrong[count - 3] += countWrongTexels(occlusion, screen, count, written[count - 3]);
+        }
+    }
+
+    bool success = true;
+    success &= check(written[0] > 0 && written[1] > 0, "random triangles and quads write texels");
+    success &= check(wrong[0] == 0, "random triangles only write the texels they cover with their farthest depth");
+    success &= check(wrong[1] == 0, "random quads only write the texels they cover with their farthest depth");
+    return success;
+}
+
+// Closed sphere of radius 1 made of rings, triangles face outwards
+MeshData makeSphere(std::size_t rings, std::size_t segments) {
+    MeshData mesh;
+    const float pi = 3.14159265f;
+    for (std::size_t r = 0; r <= rings; ++r) {
+        const float theta = pi * static_cast<float>(r) / static_cast<float>(rings);
+        // Poles are a single vertex
+        const std::size_t count = r == 0 || r == rings ? 1 : segments;
+        for (std::size_t s = 0; s < count; ++s) {
+            const float phi = 2.f * pi * static_cast<float>(s) / static_cast<float>(segments);
+            const glm::vec3 position(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            mesh.vertices.push_back({position, position});
+        }
+    }
+    // Index of a vertex of ring r, wrapping around the segments
+    const auto vertex = [&](std::size_t r, std::size_t s) -> GLuint {
+        if (r == 0) {
+            return 0;
+        }
+        if (r == rings) {
+            return static_cast<GLuint>(1 + (rings - 1) * segments);
+        }
+        return static_cast<GLuint>(1 + (r - 1) * segments + s % segments);
+    };
+    for (std::size_t r = 0; r < rings; ++r) {
+        for (std::size_t s = 0; s < segments; ++s) {
+            const GLuint quad[4] = {vertex(r, s), vertex(r, s + 1), vertex(r + 1, s + 1), vertex(r + 1, s)};
+            if (r > 0) {
+                mesh.indices.insert(mesh.indices.end(), {quad[0], quad[1], quad[2]});
+            }
+            if (r + 1 < rings) {
+                mesh.indices.insert(mesh.indices.end(), {quad[0], quad[2], quad[3]});
+            }
+        }
+    }
+    return mesh;
+}
+
+// Boxes fitted inside a sphere stay behind all its faces and hide what is behind the sphere
+bool testInnerBoxes() {
+    const MeshData sphere = makeSphere(24, 48);
+    const MeshDataView view = sphere.getView();
+    const OccluderMesh boxes = OccluderMesh::fromInnerBoxes(view, 8);
+
+    bool success = true;
+    success &= check(!boxes.empty() && boxes.indices.size() % 36 == 0 && boxes.indices.size() <= 8 * 36,
+                     "sphere gets at most 8 inner boxes");
+    // The sphere is convex, a point is inside when it is behind the plane of every face
+    std::size_t outside = 0;
+    for (const glm::vec3& position : boxes.positions) {
+        for (std::size_t i = 0; i < sphere.indices.size(); i += 3) {
+            const glm::vec3& p0 = sphere.vertices[sphere.indices[i]].position;
+            const glm::vec3& p1 = sphere.vertices[sphere.indices[i + 1]].position;
+            const glm::vec3& p2 = sphere.vertices[sphere.indices[i + 2]].position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            if (glm::dot(normal, p0 + p1 + p2) < 0.f) {
+                normal = -normal;
+            }
+            if (glm::dot(normal, position - p0) > 1e-6f) {
+                ++outside;
+            }
+        }
+    }
+    success &= check(outside == 0, "inner boxes stay inside the sphere");
+
+    // Meshes over the triangle budget fall back to the boxes, the others are kept whole
+    success &= check(OccluderMesh::fromView(view, 200).indices.size() == boxes.indices.size(),
+                     "large mesh is replaced by its inner boxes");
+    success &= check(OccluderMesh::fromView(view, sphere.indices.size()).indices.size() == sphere.indices.size(),
+                     "small mesh is kept whole");
+
+    // A small box right behind the sphere is hidden by the boxes alone
+    const glm::mat4 view_proj = getViewProj();
+    OcclusionBuffer occlusion(256, 128);
+    occlusion.clear();
+    occlusion.renderOccluder(boxes, view_proj);
+    occlusion.buildHierarchy();
+    success &= check(occlusion.isOccluded(AABB(glm::vec3(-0.1f, -0.1f, -2.f), glm::vec3(0.1f, 0.1f, -1.5f)), view_proj),
+                     "box behind the sphere is hidden by its inner boxes");
+    success &= check(!occlusion.isOccluded(AABB(glm::vec3(1.5f, -0.1f, -2.f), glm::vec3(1.7f, 0.1f, -1.5f)),
+                                           view_proj), "box beside the sphere is not hidden");
+    return success;
+}
+
+} // namespace
+
+int main() {
+    bool success = true;
+    success &= testWall();
+    success &= testConservativePolygons();
+    success &= testInnerBoxes();
+    std::cout << (success ? "All occlusion tests passed\n" : "Some occlusion tests failed\n");
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
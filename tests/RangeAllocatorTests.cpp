@@ -0,0 +1,188 @@
+//
+// Created by Simon on 18.10.26.
+//
+
+// CPU tests of the range allocator: allocation, release and merging of free blocks, growth, and compaction with the
+// moves applied to a host copy of the buffer. No context is needed
+
+#include "RangeAllocator.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Allocations and releases of the random test
+constexpr int RANDOM_OPERATIONS = 100000;
+
+// Report a failed check
+bool check(bool condition, const char *message) {
+    if (!condition) {
+        std::cerr << "FAILED: " << message << "\n";
+    }
+    return condition;
+}
+
+// Released neighbours merge back into a single free block
+bool testAllocateFree() {
+    RangeAllocator ranges(1000);
+    bool success = true;
+    const std::uint32_t a = ranges.allocate(100);
+    const std::uint32_t b = ranges.allocate(200, 16);
+    const std::uint32_t c = ranges.allocate(300);
+    success &= check(a != INVALID_RANGE && b != INVALID_RANGE && c != INVALID_RANGE, "allocations fit");
+    success &= check(ranges.getOffset(b) % 16 == 0, "aligned offset");
+    success &= check(ranges.getOffset(a) + ranges.getSize(a) <= ranges.getOffset(b) &&
+                     ranges.getOffset(b) + ranges.getSize(b) <= ranges.getOffset(c), "allocations do not overlap");
+    success &= check(ranges.getUsed() == 600 && ranges.getStatistics().num_allocations == 3, "used bytes");
+    success &= check(ranges.allocate(1000) == INVALID_RANGE, "too large allocation does not fit");
+
+    // Freeing the middle one leaves a hole, freeing its neighbours merges everything
+    ranges.free(b);
+    RangeStatistics statistics = ranges.getStatistics();
+    success &= check(statistics.num_free_blocks == 2 && statistics.getFragmentation() > 0.f, "hole after a free");
+    const std::uint32_t d = ranges.allocate(150);
+    success &= check(d != INVALID_RANGE && ranges.getOffset(d) < ranges.getOffset(c), "hole is reused");
+    ranges.free(d);
+    ranges.free(a);
+    ranges.free(c);
+    statistics = ranges.getStatistics();
+    success &= check(statistics.num_free_blocks == 1 && statistics.largest_free == 1000 && statistics.used == 0,
+                     "free blocks merge back");
+    success &= check(statistics.getFragmentation() == 0.f, "no fragmentation once empty");
+
+    // Growing makes room after the last allocation
+    const std::uint32_t e = ranges.allocate(900);
+    success &= check(ranges.allocate(300) == INVALID_RANGE, "full range");
+    ranges.grow(2000);
+    const std::uint32_t f = ranges.allocate(300);
+    success &= check(e != INVALID_RANGE && f != INVALID_RANGE && ranges.getCapacity() == 2000, "allocation after grow");
+    return success;
+}
+
+// Random allocations and releases never overlap, keep their alignment and are counted
+bool testRandom() {
+    RangeAllocator ranges(1 << 16);
+    std::mt19937 rng(1);
+    std::map<std::uint32_t, std::size_t> live;
+    std::size_t overlaps = 0;
+    std::size_t misaligned = 0;
+    for (int i = 0; i < RANDOM_OPERATIONS; ++i) {
+        if (live.empty() || rng() % 3 != 0) {
+            const std::size_t size = 1 + rng() % (rng() % 4 == 0 ? 20000 : 300);
+            const std::size_t alignment = rng() % 2 == 0 ? 12 : 4;
+            std::uint32_t handle = ranges.allocate(size, alignment);
+            if (handle == INVALID_RANGE) {
+                ranges.grow(2 * ranges.getCapacity());
+                handle = ranges.allocate(size, alignment);
+            }
+            if (!check(handle != INVALID_RANGE, "allocation fits after grow")) {
+                return false;
+            }
+            misaligned += ranges.getOffset(handle) % alignment != 0;
+            live[handle] = size;
+        } else {
+            auto it = live.begin();
+            std::advance(it, static_cast<long>(rng() % live.size()));
+            ranges.free(it->first);
+            live.erase(it);
+        }
+        if (i % 5000 == 0) {
+            std::map<std::size_t, std::size_t> spans;
+            for (const auto& allocation : live) {
+                spans[ranges.getOffset(allocation.first)] = ranges.getSize(allocation.first);
+            }
+            std::size_t end = 0;
+            for (const auto& span : spans) {
+                overlaps += span.first < end;
+                end = span.first + span.second;
+            }
+            overlaps += end > ranges.getCapacity();
+        }
+    }
+    std::size_t used = 0;
+    for (const auto& allocation : live) {
+        used += allocation.second;
+    }
+
+    bool success = true;
+    success &= check(overlaps == 0, "random allocations do not overlap");
+    success &= check(misaligned == 0, "random allocations are aligned");
+    success &= check(ranges.getUsed() == used && ranges.getStatistics().num_allocations == live.size(),
+                     "random allocations are counted");
+    return success;
+}
+
+// Compaction packs the allocations, the moves applied to the data keep the content of every handle
+bool testCompact() {
+    RangeAllocator ranges(1 << 14);
+    std::vector<unsigned char> data(ranges.getCapacity(), 0);
+    std::mt19937 rng(2);
+    std::map<std::uint32_t, std::size_t> live;
+    for (int i = 0; i < 400; ++i) {
+        const std::size_t size = 1 + rng() % 64;
+        const std::uint32_t handle = ranges.allocate(size, rng() % 2 == 0 ? 12 : 4);
+        if (handle == INVALID_RANGE) {
+            break;
+        }
+        std::memset(data.data() + ranges.getOffset(handle), static_cast<int>(handle % 251 + 1), size);
+        live[handle] = size;
+    }
+    // Free every other allocation to scatter the free space
+    for (auto it = live.begin(); it != live.end();) {
+        if (it->first % 2 == 0) {
+            ranges.free(it->first);
+            it = live.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    const RangeStatistics before = ranges.getStatistics();
+
+    std::vector<RangeMove> moves;
+    ranges.compact(moves);
+    // New offsets are never above the old ones, so the moves can be applied in order
+    bool moves_down = true;
+    for (const RangeMove& move : moves) {
+        moves_down &= move.new_offset <= move.old_offset && ranges.getOffset(move.handle) == move.new_offset;
+        std::memmove(data.data() + move.new_offset, data.data() + move.old_offset, move.size);
+    }
+    std::size_t corrupted = 0;
+    std::size_t end = 0;
+    for (const auto& allocation : live) {
+        const std::size_t offset = ranges.getOffset(allocation.first);
+        end = std::max(end, offset + allocation.second);
+        for (std::size_t b = 0; b < allocation.second; ++b) {
+            corrupted += data[offset + b] != allocation.first % 251 + 1;
+        }
+    }
+    const RangeStatistics after = ranges.getStatistics();
+
+    bool success = true;
+    success &= check(before.getFragmentation() > 0.f && !moves.empty(), "scattered free space before compaction");
+    success &= check(moves_down, "moves go down to the new offsets of their handles");
+    success &= check(corrupted == 0, "handles keep their data after the moves");
+    success &= check(ranges.getAllocatedEnd() == end && after.used == before.used, "allocations are packed");
+    // Only the padding of the alignments, below 12 bytes per allocation, stays outside the block at the end
+    success &= check(after.largest_free == ranges.getCapacity() - end &&
+                     after.free - after.largest_free < 12 * live.size() &&
+                     after.getFragmentation() < before.getFragmentation(), "free space is at the end after compaction");
+    return success;
+}
+
+} // namespace
+
+int main() {
+    bool success = true;
+    success &= testAllocateFree();
+    success &= testRandom();
+    success &= testCompact();
+    std::cout << (success ? "All range allocator tests passed\n" : "Some range allocator tests failed\n");
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}